@@ -33,6 +33,9 @@ const double TOL_ERR_FTR = 1e-2;  // Tolerance for the maximum FTR error
 const int NORM = 0;               // To measure errors:
                                   // 1... H1 norm
                                   // 0... L2 norm
+const int FTR_PATCH_SIZE = 1;     // Number of coarse elements on each side
+                                  // of the refined element in FTR patches
+const int FTR_NUM_THREADS = 1;    // Number of threads solving the FTR
  
 // Right-hand side function f(y, x)
 double f(double y, double x) {
@@ -69,6 +72,13 @@ int main() {
   dp->add_matrix_form(0, 0, jacobian);
   dp->add_vector_form(0, residual);
 
+  // Fast trial refinements (FTR), solved on small patches 
+  // around the refined elements
+  FTRSolver ftr(dp, NORM);
+  ftr.set_patch_size(FTR_PATCH_SIZE);
+  ftr.set_num_threads(FTR_NUM_THREADS);
+  ftr.set_newton(NEWTON_TOL_REF, NEWTON_MAXITER);
+
   // Convergence graph wrt. the number of degrees of freedom
   GnuplotGraph graph;
   graph.set_log_y();
@@ -78,15 +88,11 @@ int main() {
 
   // Main adaptivity loop
   int adapt_iterations = 1;
-  double elem_errors[MAX_ELEM_NUM];      // This array decides what 
+  std::vector<double> elem_errors;       // This array decides what 
                                          // elements will be refined.
-  ElemPtr2 ref_elem_pairs[MAX_ELEM_NUM]; // To store element pairs from the 
+  ElemPairArray ref_elem_pairs;          // To store element pairs from the 
                                          // FTR solution. Decides how 
                                          // elements will be hp-refined. 
-  for (int i=0; i < MAX_ELEM_NUM; i++) {
-    ref_elem_pairs[i][0] = new Element();
-    ref_elem_pairs[i][1] = new Element();
-  }
   while(1) {
     printf("============ Adaptivity step %d ============\n", adapt_iterations); 
 
@@ -99,61 +105,9 @@ int main() {
     // calculate the norm of the difference between the FTR
     // solution and the coarse mesh solution, and store the
     // error in the elem_errors[] array.
-    int n_elem = mesh->get_n_active_elem();
-    for (int i=0; i < n_elem; i++) {
-
-      printf("=== Starting FTR of Elem [%d]\n", i);
-
-      // Replicate coarse mesh including solution.
-      Mesh *mesh_ref_local = mesh->replicate();
-
-      // Perform FTR of element 'i'
-      mesh_ref_local->reference_refinement(i, 1);
-      printf("Elem [%d]: fine mesh created (%d DOF).\n", 
-             i, mesh_ref_local->assign_dofs());
-
-      // Newton's loop on the FTR mesh
-      newton(dp, mesh_ref_local, NULL, NEWTON_TOL_REF, NEWTON_MAXITER);
-
-      // Print FTR solution (enumerated) 
-      Linearizer *lxx = new Linearizer(mesh_ref_local);
-      char out_filename[255];
-      sprintf(out_filename, "solution_ref_%d.gp", i);
-      lxx->plot_solution(out_filename);
-      delete lxx;
-
-      // Calculate norm of the difference between the coarse mesh 
-      // and FTR solutions.
-      // NOTE: later we want to look at the difference in some quantity 
-      // of interest rather than error in global norm.
-      double err_est_array[MAX_ELEM_NUM];
-      elem_errors[i] = calc_error_estimate(NORM, mesh, mesh_ref_local, 
-                       err_est_array);
-      printf("Elem [%d]: absolute error (est) = %g\n", i, elem_errors[i]);
-
-      // Copy the reference element pair for element 'i'
-      // into the ref_elem_pairs[i][] array
-      Iterator *I = new Iterator(mesh);
-      Iterator *I_ref = new Iterator(mesh_ref_local);
-      Element *e, *e_ref;
-      while (1) {
-        e = I->next_active_element();
-        e_ref = I_ref->next_active_element();
-        if (e->id == i) {
-  	  e_ref->copy_into(ref_elem_pairs[e->id][0]);
-          // coarse element 'e' was split in space
-          if (e->level != e_ref->level) {
-            e_ref = I_ref->next_active_element();
-            e_ref->copy_into(ref_elem_pairs[e->id][1]);
-          }
-          break;
-        }
-      }
-
-      delete I;
-      delete I_ref;
-      delete mesh_ref_local;
-    }  
+    ref_elem_pairs.resize(mesh->get_n_active_elem());
+    double max_ftr_error = ftr.solve(mesh, elem_errors, 
+                                     ref_elem_pairs.get_pairs());
 
     // If exact solution available, also calculate exact error
     if (EXACT_SOL_PROVIDED) {
@@ -172,11 +126,6 @@ int main() {
       graph.add_values(0, mesh->get_n_dof(), 100 * err_exact_rel);
     }
 
-    // Calculate max FTR error
-    double max_ftr_error = 0;
-    for (int i=0; i < mesh->get_n_active_elem(); i++) {
-      if (elem_errors[i] > max_ftr_error) max_ftr_error = elem_errors[i];
-    }
     printf("Max FTR error = %g\n", max_ftr_error);
 
     // Add entry to DOF convergence graph
@@ -190,13 +139,13 @@ int main() {
 
     // Returns updated coarse mesh with the last solution on it. 
     adapt(NORM, ADAPT_TYPE, THRESHOLD, elem_errors,
-          mesh, ref_elem_pairs);
+          mesh, ref_elem_pairs.get_pairs());
 
     adapt_iterations++;
   }
 
   // Plot meshes, results, and errors
-  adapt_plotting(mesh, ref_elem_pairs,
+  adapt_plotting(mesh, ref_elem_pairs.get_pairs(),
                  NORM, EXACT_SOL_PROVIDED, exact_sol);
 
   // Save convergence graph
@@ -84,19 +84,12 @@ double exact_sol(double x, double u[MAX_EQN_NUM], double dudx[MAX_EQN_NUM]) {
 // NOTE: quantity of interest is any linear functional of solution.
 double quantity_of_interest(Mesh *mesh, double x)
 {
-  // Traversal of the mesh  
-  Iterator *I = new Iterator(mesh);
-  Element *e;
+  int id = mesh->locate_point(x);
+  if (id < 0) error("computation of quantity of interest failed.");
   double val[MAX_EQN_NUM];
   double der[MAX_EQN_NUM];
-  while ((e = I->next_active_element()) != NULL) {
-    if (e->x1 <= x && x <= e->x2) {
-      e->get_solution_point(x, val, der);
-      return val[0];
-    }
-  }
-
-  error("computation of quantity of interest failed.");
+  mesh->get_active_elem(id)->get_solution_point(x, val, der);
+  return val[0];
 }
 
 /******************************************************************************/
@@ -123,15 +116,11 @@ int main() {
 
   // Main adaptivity loop
   int adapt_iterations = 1;
-  double ftr_errors[MAX_ELEM_NUM];      // This array decides what 
+  std::vector<double> ftr_errors;       // This array decides what 
                                          // elements will be refined.
-  ElemPtr2 ref_ftr_pairs[MAX_ELEM_NUM]; // To store element pairs from the 
+  ElemPairArray ref_ftr_pairs;           // To store element pairs from the 
                                          // FTR solution. Decides how 
                                          // elements will be hp-refined. 
-  for (int i=0; i < MAX_ELEM_NUM; i++) {
-    ref_ftr_pairs[i][0] = new Element();
-    ref_ftr_pairs[i][1] = new Element();
-  }
   while(1) {
     printf("============ Adaptivity step %d ============\n", adapt_iterations); 
 
@@ -151,6 +140,8 @@ int main() {
     // solution and the coarse mesh solution, and store the
     // error in the ftr_errors[] array.
     int n_elem = mesh->get_n_active_elem();
+    ftr_errors.resize(n_elem);
+    ref_ftr_pairs.resize(n_elem);
     double max_qoi_err_est = 0;
     for (int i=0; i < n_elem; i++) {
 
@@ -189,7 +180,7 @@ int main() {
       }
       else {
         // Use global norm
-        double err_est_array[MAX_ELEM_NUM];
+        std::vector<double> err_est_array;
         ftr_errors[i] = calc_error_estimate(NORM, mesh, mesh_ref_local, 
                                             err_est_array);
       }
@@ -216,11 +207,11 @@ int main() {
         e = I->next_active_element();
         e_ref = I_ref->next_active_element();
         if (e->id == i) {
-  	  e_ref->copy_into(ref_ftr_pairs[e->id][0]);
+  	  e_ref->copy_into(ref_ftr_pairs.get_pairs()[e->id][0]);
           // coarse element 'e' was split in space
           if (e->level != e_ref->level) {
             e_ref = I_ref->next_active_element();
-            e_ref->copy_into(ref_ftr_pairs[e->id][1]);
+            e_ref->copy_into(ref_ftr_pairs.get_pairs()[e->id][1]);
           }
           break;
         }
@@ -251,13 +242,13 @@ int main() {
 
     // Returns updated coarse mesh with the last solution on it. 
     adapt(NORM, ADAPT_TYPE, THRESHOLD, ftr_errors,
-          mesh, ref_ftr_pairs);
+          mesh, ref_ftr_pairs.get_pairs());
 
     adapt_iterations++;
   }
 
   // Plot meshes, results, and errors
-  adapt_plotting(mesh, ref_ftr_pairs,
+  adapt_plotting(mesh, ref_ftr_pairs.get_pairs(),
                  NORM, EXACT_SOL_PROVIDED, exact_sol);
 
   // Save convergence graph
@@ -0,0 +1,89 @@
+#include "hermes1d.h"
+#include "common_time_period.h"
+
+// ********************************************************************
+// This example measures the time of one matrix-vector product for the 
+// COO, CSC, CSR and BSR formats, for the transposed CSC product and for 
+// the threaded CSR and BSR products. The matrix is block tridiagonal 
+// with dense BLOCK_SIZE x BLOCK_SIZE blocks, similar to the Jacobi 
+// matrix of a system of BLOCK_SIZE equations with the element-wise 
+// dof ordering. The correctness of the products is checked by the 
+// test hermes_common/tests/spmv.
+
+// General input:
+int N = 100000;                         // matrix size
+int N_THREADS = 4;                      // threads for the threaded products
+int N_REPS = 20;                        // products per timing
+int BLOCK_SIZE = 3;                     // size of the blocks
+
+// columns of row 'i' are first_col(i), ..., last_col(i)
+int first_col(int i)
+{
+  return std::max((i / BLOCK_SIZE - 1) * BLOCK_SIZE, 0);
+}
+
+int last_col(int i)
+{
+  return std::min((i / BLOCK_SIZE + 2) * BLOCK_SIZE, N) - 1;
+}
+
+double entry(int i, int j)
+{
+  return 1. / (1 + i % 7 + 2*(j % 5)) + (i == j ? 3*BLOCK_SIZE : 0);
+}
+
+// time of one product in milliseconds
+double time_product(Matrix *A, double *vec, double *result, bool transposed)
+{
+  TimePeriod timer;
+  timer.tick();
+  for (int r = 0; r < N_REPS; r++) {
+    if (transposed)
+      ((CSCMatrix*)A)->times_vector_transposed(vec, result, N);
+    else
+      A->times_vector(vec, result, N);
+  }
+  timer.tick();
+  return 1e3 * timer.last() / N_REPS;
+}
+
+int main() {
+  CooMatrix A(N);
+  for (int i = 0; i < N; i++)
+    for (int j = first_col(i); j <= last_col(i); j++)
+      A.add(i, j, entry(i, j));
+  CSRMatrix B(&A);
+  CSCMatrix C(&A);
+
+  int n_block_rows = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  std::vector<std::vector<int> > block_cols(n_block_rows);
+  for (int i = 0; i < N; i++)
+    for (int j = first_col(i); j <= last_col(i); j++)
+      block_cols[i / BLOCK_SIZE].push_back(j / BLOCK_SIZE);
+  BSRMatrix D(N, BLOCK_SIZE, block_cols);
+  for (int i = 0; i < N; i++)
+    for (int j = first_col(i); j <= last_col(i); j++)
+      D.add(i, j, entry(i, j));
+
+  std::vector<double> vec(N), res(N);
+  for (int i = 0; i < N; i++) vec[i] = sin(0.1*i);
+
+  printf("n = %d, nnz = %d, time of one product:\n", N, B.get_nnz());
+  printf("COO:                %g ms\n", time_product(&A, &vec[0], &res[0], false));
+  printf("CSC:                %g ms\n", time_product(&C, &vec[0], &res[0], false));
+  printf("CSC transposed:     %g ms\n", time_product(&C, &vec[0], &res[0], true));
+  printf("CSR:                %g ms\n", time_product(&B, &vec[0], &res[0], false));
+  printf("BSR (%dx%d blocks):  %g ms\n", BLOCK_SIZE, BLOCK_SIZE,
+         time_product(&D, &vec[0], &res[0], false));
+  B.set_num_threads(N_THREADS);
+  C.set_num_threads(N_THREADS);
+  D.set_num_threads(N_THREADS);
+  printf("CSC transposed (%d threads):  %g ms\n", N_THREADS,
+         time_product(&C, &vec[0], &res[0], true));
+  printf("CSR (%d threads):             %g ms\n", N_THREADS,
+         time_product(&B, &vec[0], &res[0], false));
+  printf("BSR (%d threads):             %g ms\n", N_THREADS,
+         time_product(&D, &vec[0], &res[0], false));
+
+  return 0;
+}
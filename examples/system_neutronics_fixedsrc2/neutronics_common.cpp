@@ -220,15 +220,11 @@ double calc_integrated_flux(Mesh* mesh, int g, double x1, double x2)
 // Calculates neutron flux and neutron current in all groups at point "x"
 void get_solution_at_point(Mesh *mesh, double x, double flux[N_GRP], double J[N_GRP] )
 {
-	Iterator *I = new Iterator(mesh);
-  Element *e;
-  int m;
-  
-  while ((e = I->next_active_element()) != NULL) {
-  	if (x < e->x1 || x > e->x2) continue;
-  	e->get_solution_point(x, flux, J);
-  	m = e->marker;
-  }
+  int id = mesh->locate_point(x);
+  if (id < 0) error("Point outside of the mesh in get_solution_at_point().");
+  Element *e = mesh->get_active_elem(id);
+  e->get_solution_point(x, flux, J);
+  int m = e->marker;
  
  	for (int g = 0; g < N_GRP; g++)
  		J[g] *= -D[m][g];
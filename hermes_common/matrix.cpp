@@ -268,8 +268,11 @@ void CooMatrix::set_zero()
 
 void CooMatrix::free_data()
 {
-  A_cplx.clear();
-  A.clear();
+  rows.clear();
+  cols.clear();
+  data.clear();
+  data_cplx.clear();
+  n_finalized = 0;
   this->size = 0;
 }
 
@@ -335,7 +338,9 @@ void CooMatrix::add(int m, int n, double v)
     if (n+1 > this->size) this->size = n+1;
 
     // add new
-    A[m][n] += v;
+    rows.push_back(m);
+    cols.push_back(n);
+    data.push_back(v);
 }
 
 void CooMatrix::add(int m, int n, cplx v)
@@ -347,153 +352,223 @@ void CooMatrix::add(int m, int n, cplx v)
     if (m+1 > this->size) this->size = m+1;
     if (n+1 > this->size) this->size = n+1;
 
-    A_cplx[m][n] += v;
+    rows.push_back(m);
+    cols.push_back(n);
+    data_cplx.push_back(v);
 }
 
-void CooMatrix::copy_into(Matrix *m)
+void CooMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
 {
-    m->free_data();
-
-    int index = 0;
     if (this->complex)
+        _error("can't use add_block(..., double**) for complex matrix");
+
+    for (int i = 0; i < ilen; i++)
     {
-        for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
+        if (iidx[i] < 0) continue;
+        for (int j = 0; j < jlen; j++)
         {
-            for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-            {
-                m->add(it_row->first,
-                       it_col->first,
-                       cplx(it_col->second.real(), it_col->second.imag()));
+            if (jidx[j] < 0 || mat[i][j] == 0) continue;
+            add(iidx[i], jidx[j], mat[i][j]);
+        }
+    }
+}
 
-                index++;
-            }
+/// Sorts the triplets (row, col, val) by rows and then columns with two
+/// stable counting-sort passes and sums the duplicates. Thanks to the
+/// stability, duplicates are summed in the order in which they were added.
+template<typename T>
+void sort_and_sum_triplets(int size, std::vector<int> &row, std::vector<int> &col,
+                           std::vector<T> &val)
+{
+    int n = row.size();
+    std::vector<int> count(size + 1), by_col(n), perm(n);
+
+    // pass 1: sort by columns
+    std::fill(count.begin(), count.end(), 0);
+    for (int k = 0; k < n; k++) count[col[k]+1]++;
+    for (int i = 0; i < size; i++) count[i+1] += count[i];
+    for (int k = 0; k < n; k++) by_col[count[col[k]]++] = k;
+
+    // pass 2: sort by rows
+    std::fill(count.begin(), count.end(), 0);
+    for (int k = 0; k < n; k++) count[row[k]+1]++;
+    for (int i = 0; i < size; i++) count[i+1] += count[i];
+    for (int k = 0; k < n; k++) perm[count[row[by_col[k]]]++] = by_col[k];
+
+    // sum duplicates
+    std::vector<int> new_row, new_col;
+    std::vector<T> new_val;
+    new_row.reserve(n);
+    new_col.reserve(n);
+    new_val.reserve(n);
+    for (int k = 0; k < n; k++)
+    {
+        int idx = perm[k];
+        if (!new_row.empty() && new_row.back() == row[idx] && new_col.back() == col[idx])
+            new_val.back() += val[idx];
+        else
+        {
+            new_row.push_back(row[idx]);
+            new_col.push_back(col[idx]);
+            new_val.push_back(val[idx]);
         }
     }
+    row.swap(new_row);
+    col.swap(new_col);
+    val.swap(new_val);
+}
+
+void CooMatrix::finalize()
+{
+    if (this->n_finalized == (int) rows.size()) return;
+
+    if (this->complex)
+        sort_and_sum_triplets(this->size, rows, cols, data_cplx);
     else
+        sort_and_sum_triplets(this->size, rows, cols, data);
+
+    this->n_finalized = rows.size();
+}
+
+int CooMatrix::find_position(int m, int n)
+{
+    finalize();
+    int lo = 0, hi = this->n_finalized - 1;
+    while (lo <= hi)
     {
-        for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
-        {
-            for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-            {
-                m->add(it_row->first,
-                       it_col->first,
-                       it_col->second);
+        int mid = (lo + hi) / 2;
+        if (rows[mid] < m || (rows[mid] == m && cols[mid] < n)) lo = mid + 1;
+        else if (rows[mid] > m || cols[mid] > n) hi = mid - 1;
+        else return mid;
+    }
+    return -1;
+}
 
-                index++;
-            }
-        }
+double CooMatrix::get(int m, int n)
+{
+    int pos = find_position(m, n);
+    if (pos == -1) return 0;
+    return data[pos];
+}
+
+cplx CooMatrix::get_cplx(int m, int n)
+{
+    int pos = find_position(m, n);
+    if (pos == -1) return 0;
+    return data_cplx[pos];
+}
+
+void CooMatrix::copy_into(Matrix *m)
+{
+    finalize();
+    m->free_data();
+
+    int nnz = this->n_finalized;
+    for (int k = 0; k < nnz; k++)
+    {
+        if (this->complex)
+            m->add(rows[k], cols[k], data_cplx[k]);
+        else
+            m->add(rows[k], cols[k], data[k]);
     }
 }
 
 void CooMatrix::get_row_col_data(int *row, int *col, double *data)
 {
-    int index = 0;
-    for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+    finalize();
+    for (int k = 0; k < this->n_finalized; k++)
     {
-        for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-        {
-            row[index] = it_row->first;
-            col[index] = it_col->first;
-            data[index] = it_col->second;
-
-            index++;
-        }
+        row[k] = rows[k];
+        col[k] = cols[k];
+        data[k] = this->data[k];
     }
 }
 
 void CooMatrix::get_row_col_data(int *row, int *col, cplx *data)
 {
-    int index = 0;
-    for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
+    finalize();
+    for (int k = 0; k < this->n_finalized; k++)
     {
-        for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-        {
-            row[index] = it_row->first;
-            col[index] = it_col->first;
-            data[index] = it_col->second;
-
-            index++;
-        }
+        row[k] = rows[k];
+        col[k] = cols[k];
+        data[k] = data_cplx[k];
     }
 }
 
 void CooMatrix::get_row_col_data(int *row, int *col, double *data_real, double *data_imag)
 {
-    int index = 0;
-    for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
+    finalize();
+    for (int k = 0; k < this->n_finalized; k++)
     {
-        for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-        {
-            row[index] = it_row->first;
-            col[index] = it_col->first;
-            data_real[index] = it_col->second.real();
-            data_imag[index] = it_col->second.imag();
-
-            index++;
-        }
+        row[k] = rows[k];
+        col[k] = cols[k];
+        data_real[k] = data_cplx[k].real();
+        data_imag[k] = data_cplx[k].imag();
     }
 }
 
 int CooMatrix::get_nnz()
 {
-    int nnz = 0;
-    if (complex)
-        for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
-            nnz += it_row->second.size();
-    else
-        for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
-            nnz += it_row->second.size();
-
-    return nnz;
+    finalize();
+    return this->n_finalized;
 }
 
 void CooMatrix::times_vector(double* vec, double* result, int rank)
 {
+    finalize();
     for (int i=0; i < rank; i++) result[i] = 0;
 
-    for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
-    {
-        for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-        {
-            result[it_row->first] += it_col->second * vec[it_col->first];
-        }
-    }
+    for (int k = 0; k < this->n_finalized; k++)
+        result[rows[k]] += data[k] * vec[cols[k]];
 }
 
 void CooMatrix::print()
 {
+    finalize();
     printf("\nCoo Matrix:\n");
 
-    if (is_complex())
+    for (int k = 0; k < this->n_finalized; k++)
     {
-        for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
-        {
-            for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-            {
-                printf("(%u, %u): (%g, %g)\n",
-                       it_row->first,
-                       it_col->first,
-                       ((cplx) it_col->second).real(),
-                       ((cplx) it_col->second).imag());
-            }
-        }
+        if (is_complex())
+            printf("(%i, %i): (%g, %g)\n", rows[k], cols[k],
+                   data_cplx[k].real(), data_cplx[k].imag());
+        else
+            printf("(%i, %i): %g\n", rows[k], cols[k], data[k]);
     }
-    else
+}
+
+// *********************************************************************************************************************
+// minimum number of rows per thread in the threaded products
+#define SPMV_MIN_ROWS_PER_THREAD 2000
+
+// result[i] = sum of Ax[k]*vec[Ai[k]] for Ap[i] <= k < Ap[i+1], i.e.,
+// the product with a CSR matrix or with the transpose of a CSC matrix.
+// The arrays are passed as arguments so that the compiler does not
+// reload them after every store to 'result', and the two partial sums
+// break the dependency chain of the inner loop. Every row is summed in
+// the same order for any number of threads.
+static void compressed_times_vector(int n, const int *Ap, const int *Ai,
+                                    const double *Ax, const double *vec,
+                                    double *result, int num_threads)
+{
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static) num_threads(num_threads) \
+        if(num_threads > 1 && n >= SPMV_MIN_ROWS_PER_THREAD*num_threads)
+#endif
+    for (int i = 0; i < n; i++)
     {
-        for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+        double val0 = 0, val1 = 0;
+        int k = Ap[i], end = Ap[i+1];
+        for (; k + 1 < end; k += 2)
         {
-            for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
-            {
-                printf("(%u, %u): %g\n",
-                       it_row->first,
-                       it_col->first,
-                       it_col->second);
-            }
+            val0 += Ax[k] * vec[Ai[k]];
+            val1 += Ax[k+1] * vec[Ai[k+1]];
         }
+        if (k < end) val0 += Ax[k] * vec[Ai[k]];
+        result[i] = val0 + val1;
     }
 }
 
-// *********************************************************************************************************************
 CSRMatrix::CSRMatrix(int size) : Matrix()
 {
     init();
@@ -528,6 +603,8 @@ CSRMatrix::CSRMatrix(Matrix *m) : Matrix()
         this->add_from_csc((CSCMatrix*)m);
     else if (dynamic_cast<DenseMatrix*>(m))
         this->add_from_dense((DenseMatrix*)m);
+    else if (dynamic_cast<BSRMatrix*>(m))
+        this->add_from_bsr((BSRMatrix*)m);
     else
         _error("Matrix type not supported.");
 }
@@ -664,6 +741,57 @@ void CSRMatrix::add_from_csc(CSCMatrix *m)
     }
 }
 
+// all entries of the blocks are kept (also zeros), the padding is not
+void CSRMatrix::add_from_bsr(BSRMatrix *m)
+{
+    free_data();
+
+    int bs = m->get_block_size();
+    int *Bp = m->get_Bp();
+    int *Bj = m->get_Bj();
+    double *Bx = m->get_Bx();
+    this->size = m->get_size();
+
+    // count the entries of every row
+    this->Ap = new int[this->size + 1];
+    this->Ap[0] = 0;
+    for (int i = 0; i < this->size; i++)
+    {
+        int bi = i / bs, n_row = 0;
+        for (int k = Bp[bi]; k < Bp[bi+1]; k++)
+            n_row += std::min(bs, this->size - Bj[k]*bs);
+        this->Ap[i+1] = this->Ap[i] + n_row;
+    }
+    this->nnz = this->Ap[this->size];
+    this->Ai = new int[this->nnz];
+    this->Ax = new double[this->nnz];
+
+    // block columns are sorted, so are the columns of every row
+    int count = 0;
+    for (int i = 0; i < this->size; i++)
+    {
+        int bi = i / bs, r = i % bs;
+        for (int k = Bp[bi]; k < Bp[bi+1]; k++)
+        {
+            int n_cols = std::min(bs, this->size - Bj[k]*bs);
+            for (int c = 0; c < n_cols; c++)
+            {
+                this->Ai[count] = Bj[k]*bs + c;
+                this->Ax[count] = Bx[((long)k*bs + r)*bs + c];
+                count++;
+            }
+        }
+    }
+}
+
+void CSRMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (is_complex())
+        _error("CSRMatrix::times_vector() not implemented for complex matrices.");
+    compressed_times_vector(rank, this->Ap, this->Ai, this->Ax, vec, result,
+                            this->num_threads);
+}
+
 void CSRMatrix::print()
 {
     printf("\nCSR Matrix:\n");
@@ -714,12 +842,17 @@ CSCMatrix::CSCMatrix(Matrix *m) : Matrix()
         this->add_from_dense((DenseMatrix *) m);
     else if (dynamic_cast<CSRMatrix *>(m))
         this->add_from_csr((CSRMatrix *) m);
+    else if (dynamic_cast<CSCMatrix *>(m))
+        this->add_from_csc((CSCMatrix *) m);
+    else if (dynamic_cast<BSRMatrix *>(m))
+        this->add_from_bsr((BSRMatrix *) m);
     else
         _error("Matrix type not supported.");
 }
 
 CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax)
 {
+    init();
     this->size = size;
     this->nnz = nnz;
     this->complex = false;
@@ -731,6 +864,7 @@ CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax)
 
 CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx)
 {
+    init();
     this->size = size;
     this->nnz = nnz;
     this->complex = true;
@@ -876,6 +1010,113 @@ void CSCMatrix::add_from_csr(CSRMatrix *m)
     }
 }
 
+void CSCMatrix::add_from_csc(CSCMatrix *m)
+{
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
+
+    // allocate data
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    memcpy(this->Ap, m->get_Ap(), (this->size + 1)*sizeof(int));
+    memcpy(this->Ai, m->get_Ai(), this->nnz*sizeof(int));
+    if (is_complex())
+    {
+        this->Ax_cplx = new cplx[this->nnz];
+        for (int i = 0; i < this->nnz; i++)
+            this->Ax_cplx[i] = m->get_Ax_cplx()[i];
+    }
+    else
+    {
+        this->Ax = new double[this->nnz];
+        memcpy(this->Ax, m->get_Ax(), this->nnz*sizeof(double));
+    }
+}
+
+void CSCMatrix::set_zero()
+{
+    if (is_complex())
+    {
+        for (int i = 0; i < this->nnz; i++)
+            this->Ax_cplx[i] = 0;
+    }
+    else
+    {
+        for (int i = 0; i < this->nnz; i++)
+            this->Ax[i] = 0;
+    }
+}
+
+void CSCMatrix::add_from_bsr(BSRMatrix *m)
+{
+    CSRMatrix csr(m);
+    this->add_from_csr(&csr);
+}
+
+int CSCMatrix::find_position(int m, int n)
+{
+    if (n < 0 || n >= this->size) return -1;
+    // row indices are sorted within every column
+    int lo = this->Ap[n], hi = this->Ap[n+1] - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (this->Ai[mid] < m) lo = mid + 1;
+        else if (this->Ai[mid] > m) hi = mid - 1;
+        else return mid;
+    }
+    return -1;
+}
+
+void CSCMatrix::add(int m, int n, double v)
+{
+    if (is_complex())
+        _error("can't use add(int, int, double) for complex matrix");
+    int pos = find_position(m, n);
+    if (pos == -1)
+    {
+        if (v == 0) return;
+        _error("CSCMatrix::add(): entry is not in the sparsity pattern.");
+    }
+    this->Ax[pos] += v;
+}
+
+double CSCMatrix::get(int m, int n)
+{
+    int pos = find_position(m, n);
+    if (pos == -1) return 0;
+    return this->Ax[pos];
+}
+
+void CSCMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (is_complex())
+        _error("CSCMatrix::times_vector() not implemented for complex matrices.");
+    // (the columns scatter into 'result', so this product is serial)
+    const int *Ap = this->Ap, *Ai = this->Ai;
+    const double *Ax = this->Ax;
+    int n = this->size;
+    for (int i=0; i < rank; i++) result[i] = 0;
+
+    for (int j = 0; j < n; j++)
+    {
+        double v = vec[j];
+        for (int k = Ap[j]; k < Ap[j+1]; k++)
+            result[Ai[k]] += Ax[k] * v;
+    }
+}
+
+void CSCMatrix::times_vector_transposed(double* vec, double* result, int rank)
+{
+    if (is_complex())
+        _error("CSCMatrix::times_vector_transposed() not implemented for complex matrices.");
+    compressed_times_vector(rank, this->Ap, this->Ai, this->Ax, vec, result,
+                            this->num_threads);
+}
+
 void CSCMatrix::print()
 {
     printf("\nCSC Matrix:\n");
@@ -890,6 +1131,206 @@ void CSCMatrix::print()
         print_vector("data", this->Ax, this->nnz);
 }
 
+// *********************************************************************************************************************
+
+BSRMatrix::BSRMatrix(int size, int block_size,
+                     const std::vector<std::vector<int> > &block_cols) : Matrix()
+{
+    if (block_size < 1) _error("Invalid block size of a BSR matrix.");
+    this->complex = false;
+    this->size = size;
+    this->block_size = block_size;
+    this->n_block_rows = (size + block_size - 1) / block_size;
+    if ((int)block_cols.size() != this->n_block_rows)
+        _error("Wrong number of block rows in the BSR pattern.");
+
+    // sorted block columns without duplicates
+    this->Bp = new int[this->n_block_rows + 1];
+    this->Bp[0] = 0;
+    std::vector<int> cols;
+    std::vector<int> all_cols;
+    for (int bi = 0; bi < this->n_block_rows; bi++)
+    {
+        cols = block_cols[bi];
+        std::sort(cols.begin(), cols.end());
+        cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+        if (!cols.empty() && (cols[0] < 0 || cols.back() >= this->n_block_rows))
+            _error("Invalid block column in the BSR pattern.");
+        all_cols.insert(all_cols.end(), cols.begin(), cols.end());
+        this->Bp[bi+1] = all_cols.size();
+    }
+    this->nnz_blocks = all_cols.size();
+    this->Bj = new int[this->nnz_blocks];
+    for (int k = 0; k < this->nnz_blocks; k++) this->Bj[k] = all_cols[k];
+    this->Bx = new double[(long)this->nnz_blocks * block_size * block_size];
+    this->set_zero();
+}
+
+BSRMatrix::~BSRMatrix()
+{
+    free_data();
+}
+
+void BSRMatrix::free_data()
+{
+    if (this->Bp != NULL) { delete[] this->Bp; this->Bp = NULL; }
+    if (this->Bj != NULL) { delete[] this->Bj; this->Bj = NULL; }
+    if (this->Bx != NULL) { delete[] this->Bx; this->Bx = NULL; }
+
+    this->size = 0;
+    this->n_block_rows = 0;
+    this->nnz_blocks = 0;
+}
+
+void BSRMatrix::set_zero()
+{
+    long n = (long)this->nnz_blocks * this->block_size * this->block_size;
+    if (n > 0) memset(this->Bx, 0, n * sizeof(double));
+}
+
+int BSRMatrix::find_position(int m, int n)
+{
+    if (m < 0 || m >= this->size || n < 0 || n >= this->size) return -1;
+    int bs = this->block_size;
+    int bi = m / bs, bj = n / bs;
+    // block columns are sorted within every block row
+    int lo = this->Bp[bi], hi = this->Bp[bi+1] - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (this->Bj[mid] < bj) lo = mid + 1;
+        else if (this->Bj[mid] > bj) hi = mid - 1;
+        else return ((long)mid * bs + m % bs) * bs + n % bs;
+    }
+    return -1;
+}
+
+void BSRMatrix::add(int m, int n, double v)
+{
+    int pos = this->find_position(m, n);
+    if (pos < 0) _error("BSRMatrix::add(): the block is not in the pattern.");
+    this->Bx[pos] += v;
+}
+
+double BSRMatrix::get(int m, int n)
+{
+    int pos = this->find_position(m, n);
+    return (pos < 0) ? 0 : this->Bx[pos];
+}
+
+// product with the block size BS fixed at compile time, the partial
+// sums of a block row stay in registers (the last block row and
+// column may be padded, they are handled separately)
+template<int BS>
+static void bsr_times_vector(int size, int n_block_rows, const int *Bp,
+                             const int *Bj, const double *Bx,
+                             const double *vec, double *result,
+                             int num_threads)
+{
+    int n_full = size / BS;
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static) num_threads(num_threads) \
+        if(num_threads > 1 && size >= SPMV_MIN_ROWS_PER_THREAD*num_threads)
+#endif
+    for (int bi = 0; bi < n_block_rows; bi++)
+    {
+        // (block columns are sorted, only the last one can be padded)
+        int k_end = Bp[bi+1];
+        bool padded_col = (k_end > Bp[bi] && Bj[k_end-1] >= n_full);
+        if (padded_col) k_end--;
+
+        double val[BS];
+        for (int r = 0; r < BS; r++) val[r] = 0;
+        for (int k = Bp[bi]; k < k_end; k++)
+        {
+            const double *b = Bx + (long)k*BS*BS;
+            const double *x = vec + Bj[k]*BS;
+            for (int r = 0; r < BS; r++)
+                for (int c = 0; c < BS; c++)
+                    val[r] += b[r*BS + c] * x[c];
+        }
+
+        int n_rows = BS;
+        if (bi < n_full)
+        {
+            for (int r = 0; r < BS; r++) result[bi*BS + r] = val[r];
+        }
+        else
+        {
+            n_rows = size - bi*BS;
+            for (int r = 0; r < n_rows; r++) result[bi*BS + r] = val[r];
+        }
+        if (padded_col)
+        {
+            const double *b = Bx + (long)k_end*BS*BS;
+            const double *x = vec + Bj[k_end]*BS;
+            int n_cols = size - Bj[k_end]*BS;
+            for (int r = 0; r < n_rows; r++)
+                for (int c = 0; c < n_cols; c++)
+                    result[bi*BS + r] += b[r*BS + c] * x[c];
+        }
+    }
+}
+
+// the same for any block size
+static void bsr_times_vector(int bs, int size, int n_block_rows,
+                             const int *Bp, const int *Bj, const double *Bx,
+                             const double *vec, double *result,
+                             int num_threads)
+{
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static) num_threads(num_threads) \
+        if(num_threads > 1 && size >= SPMV_MIN_ROWS_PER_THREAD*num_threads)
+#endif
+    for (int bi = 0; bi < n_block_rows; bi++)
+    {
+        double *val = result + (long)bi*bs;
+        int n_rows = std::min(bs, size - bi*bs);
+        for (int r = 0; r < n_rows; r++) val[r] = 0;
+        for (int k = Bp[bi]; k < Bp[bi+1]; k++)
+        {
+            const double *b = Bx + (long)k*bs*bs;
+            const double *x = vec + (long)Bj[k]*bs;
+            int n_cols = std::min(bs, size - Bj[k]*bs);
+            for (int r = 0; r < n_rows; r++)
+            {
+                double v = 0;
+                for (int c = 0; c < n_cols; c++) v += b[r*bs + c] * x[c];
+                val[r] += v;
+            }
+        }
+    }
+}
+
+void BSRMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (rank != this->size)
+        _error("BSRMatrix::times_vector(): wrong vector length.");
+    int n = this->size, nbr = this->n_block_rows;
+    switch (this->block_size)
+    {
+        case 1: bsr_times_vector<1>(n, nbr, Bp, Bj, Bx, vec, result, num_threads); break;
+        case 2: bsr_times_vector<2>(n, nbr, Bp, Bj, Bx, vec, result, num_threads); break;
+        case 3: bsr_times_vector<3>(n, nbr, Bp, Bj, Bx, vec, result, num_threads); break;
+        case 4: bsr_times_vector<4>(n, nbr, Bp, Bj, Bx, vec, result, num_threads); break;
+        case 5: bsr_times_vector<5>(n, nbr, Bp, Bj, Bx, vec, result, num_threads); break;
+        default: bsr_times_vector(this->block_size, n, nbr, Bp, Bj, Bx, vec,
+                                  result, num_threads);
+    }
+}
+
+void BSRMatrix::print()
+{
+    printf("\nBSR Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("block size: %i\n", this->block_size);
+    printf("nnz blocks: %i\n", this->nnz_blocks);
+
+    print_vector("block_row_ptr", this->Bp, this->n_block_rows+1);
+    print_vector("block_col_ind", this->Bj, this->nnz_blocks);
+    print_vector("data", this->Bx, this->nnz_blocks*this->block_size*this->block_size);
+}
+
 // ******************************************************************************************************************************
 
 template<typename T>
@@ -15,7 +15,8 @@
 #include <math.h>
 #include <string.h>
 #include <complex>
-#include <map>
+#include <vector>
+#include <algorithm>
 
 typedef std::complex<double> cplx;
 class Matrix;
@@ -28,6 +29,7 @@ class Matrix;
 class CooMatrix;
 class CSRMatrix;
 class CSCMatrix;
+class BSRMatrix;
 
 /// Creates a new (full) matrix with m rows and n columns with entries of the type T.
 /// The entries can be accessed by matrix[i][j]. To delete the matrix, just
@@ -46,7 +48,7 @@ T** _new_matrix(int m, int n = 0)
 
 class Matrix {
 public:
-    Matrix() {}
+    Matrix() : num_threads(1) {}
     virtual ~Matrix() {}
 
     inline virtual void init(bool is_complex = false) { this->complex = is_complex; free_data(); }
@@ -90,9 +92,20 @@ public:
         _error("internal error: times_vector() not implemented.");
     }
 
+    // Number of threads for the products split by rows (CSRMatrix::
+    // times_vector(), CSCMatrix::times_vector_transposed()). Ignored
+    // unless hermes_common is built with OpenMP, and for small matrices.
+    void set_num_threads(int num_threads)
+    {
+        if (num_threads < 1) _error("Invalid number of threads.");
+        this->num_threads = num_threads;
+    }
+    int get_num_threads() { return this->num_threads; }
+
 protected:
     int size;
     bool complex;
+    int num_threads;
 };
 
 class Vector {
@@ -289,6 +302,12 @@ private:
 
 // **********************************************************************************************************
 
+// Coordinate (triplet) matrix. Entries are appended to contiguous 
+// (row, col, value) arrays in O(1), duplicates are allowed. Before the
+// entries are read (get(), get_nnz(), get_row_col_data(), conversion to 
+// other formats, ...), finalize() sorts them by rows and columns with a 
+// radix sort and sums the duplicates, in the order in which they were 
+// added.
 class CooMatrix : public Matrix {
 public:
     CooMatrix(bool complex = false);
@@ -312,20 +331,33 @@ public:
 
     virtual void add(int m, int n, double v);
     virtual void add(int m, int n, cplx v);
+    using Matrix::add_block;
+    // Negative indices and zero entries are skipped.
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat);
+    // Sorts the entries and sums the duplicates (done only if new
+    // entries were added since the last call).
+    void finalize();
     void get_row_col_data(int *row, int *col, double *data);
     void get_row_col_data(int *row, int *col, cplx *data);
     void get_row_col_data(int *row, int *col, double *data_real, double *data_imag);
 
     virtual void copy_into(Matrix *m);
 
-    inline virtual double get(int m, int n) { return A[m][n]; }
-    inline virtual cplx get_cplx(int m, int n) { return A_cplx[m][n]; }
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
 
     virtual void times_vector(double* vec, double* result, int rank);
 
 protected:
-    std::map<size_t, std::map<size_t, double> > A;
-    std::map<size_t, std::map<size_t, cplx> > A_cplx;
+    // index of entry (m, n) in the finalized arrays, -1 if not present
+    int find_position(int m, int n);
+
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<double> data;
+    std::vector<cplx> data_cplx;
+    // number of leading entries that are sorted and without duplicates
+    int n_finalized;
 };
 
 // **********************************************************************************************************
@@ -406,6 +438,7 @@ public:
     void add_from_dense(DenseMatrix *m);
     void add_from_coo(CooMatrix *m);
     void add_from_csc(CSCMatrix *m);
+    void add_from_bsr(BSRMatrix *m);
 
     virtual void add(int m, int n, double v)
     {
@@ -426,6 +459,8 @@ public:
         _error("CSR matrix copy_into() not implemented.");
     }
 
+    virtual void times_vector(double* vec, double* result, int rank);
+
     virtual void print();
 
     inline int *get_Ap() { return this->Ap; }
@@ -460,23 +495,26 @@ public:
     virtual void init();
     virtual void free_data();
 
-    virtual void set_zero()
-    {
-        _error("CSCMatrix::set_zero() not implemented.");
-    }
+    // Zeroes all values, keeps the sparsity pattern.
+    virtual void set_zero();
 
     void add_from_dense(DenseMatrix *m);
     void add_from_coo(CooMatrix *m);
     void add_from_csr(CSRMatrix *m);
+    void add_from_csc(CSCMatrix *m);
+    void add_from_bsr(BSRMatrix *m);
 
-    virtual void add(int m, int n, double v)
-    {
-        _error("CSC matrix add() not implemented.");
-    }
-    virtual double get(int m, int n)
-    {
-        _error("CSC matrix get() not implemented.");
-    }
+    // Adds to an existing entry, the sparsity pattern cannot change.
+    virtual void add(int m, int n, double v);
+    virtual double get(int m, int n);
+    // Returns the index of entry (m, n) in Ai/Ax, or -1 if it is not
+    // in the sparsity pattern.
+    int find_position(int m, int n);
+
+    virtual void times_vector(double* vec, double* result, int rank);
+    // result = A^T*vec (a row of A^T is a column of A, so this is the
+    // product the CSC format is fast at)
+    void times_vector_transposed(double* vec, double* result, int rank);
 
     virtual int get_size()
     {
@@ -507,6 +545,63 @@ private:
     int *Ai;
 };
 
+// **********************************************************************************************************
+
+// Block CSR matrix with dense block_size x block_size blocks, entry
+// (m, n) lies in block (m/block_size, n/block_size). The last block
+// row and column are padded if block_size does not divide the size.
+// The block pattern is given to the constructor and cannot change
+// (add() outside of it is an error), the blocks are stored row by row
+// one after another in Bx. For systems of n_eq equations with
+// block_size = n_eq and dofs ordered by elements, the index arrays are
+// about n_eq^2 times smaller than in CSR/CSC, and the product works on
+// whole blocks (with the block size fixed at compile time up to 5).
+// Direct solvers get it converted to CSC (CSCMatrix(Matrix*)).
+class BSRMatrix : public Matrix
+{
+public:
+    // 'block_cols[i]' are the block columns of block row i (in any
+    // order, duplicates are removed)
+    BSRMatrix(int size, int block_size,
+              const std::vector<std::vector<int> > &block_cols);
+    ~BSRMatrix();
+
+    virtual void free_data();
+    // Zeroes all values, keeps the block pattern.
+    virtual void set_zero();
+
+    virtual void add(int m, int n, double v);
+    virtual double get(int m, int n);
+    // Returns the index of entry (m, n) in Bx, or -1 if its block is
+    // not in the pattern.
+    int find_position(int m, int n);
+    virtual void copy_into(Matrix *m)
+    {
+        _error("BSR matrix copy_into() not implemented.");
+    }
+
+    virtual void times_vector(double* vec, double* result, int rank);
+
+    virtual void print();
+
+    inline int get_block_size() { return this->block_size; }
+    inline int get_n_block_rows() { return this->n_block_rows; }
+    inline int get_nnz_blocks() { return this->nnz_blocks; }
+    inline int *get_Bp() { return this->Bp; }
+    inline int *get_Bj() { return this->Bj; }
+    inline double *get_Bx() { return this->Bx; }
+
+private:
+    int block_size;
+    int n_block_rows;
+    // number of non-zero blocks
+    int nnz_blocks;
+
+    int *Bp;
+    int *Bj;
+    double *Bx;
+};
+
 template<typename T>
 void dense_to_coo(int size, int nnz, T **Ad, int *row, int *col, T *A);
 template<typename T>
@@ -6,6 +6,8 @@
 #include "matrix.h"
 #include "solvers.h"
 
+#include <algorithm>
+
 bool CommonSolver::solve(Matrix *mat, Vector *res)
 {
     if (res->is_complex())
@@ -14,24 +16,241 @@ bool CommonSolver::solve(Matrix *mat, Vector *res)
         return this->_solve(mat, res->get_c_array());
 }
 
-// Standard CG method starting from zero vector
+bool CommonSolver::factorize(Matrix *mat)
+{
+    _error("factorize() not supported by this solver.");
+}
+
+bool CommonSolver::backsolve(double *res, int n_rhs)
+{
+    _error("backsolve() not supported by this solver.");
+}
+
+void CommonSolverCG::set_precond(int precond)
+{
+    if (precond < CG_PRECOND_NONE || precond > CG_PRECOND_IC0)
+        _error("Unknown preconditioner in CommonSolverCG::set_precond().");
+    this->precond = precond;
+}
+
+// IC(0) of A + shift*diag(A), returns false if it breaks down
+bool CommonSolverCG::factorize_ic0(CSRMatrix *A, double shift)
+{
+    int n = A->get_size();
+    int *Ap = A->get_Ap();
+    int *Ai = A->get_Ai();
+    double *Ax = A->get_Ax();
+
+    // lower triangle of A (sorted rows, diagonal last)
+    L_p.assign(n + 1, 0);
+    L_i.clear();
+    L_x.clear();
+    std::vector<std::pair<int, double> > row;
+    for (int i = 0; i < n; i++)
+    {
+        row.clear();
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+            if (Ai[k] <= i) row.push_back(std::make_pair(Ai[k], Ax[k]));
+        std::sort(row.begin(), row.end());
+        if (row.empty() || row.back().first != i)
+            _error("IC(0) needs all diagonal entries of the matrix.");
+        row.back().second *= 1 + shift;
+        for (int k = 0; k < (int)row.size(); k++)
+        {
+            L_i.push_back(row[k].first);
+            L_x.push_back(row[k].second);
+        }
+        L_p[i+1] = L_i.size();
+    }
+
+    // L_ik = (A_ik - sum_{j<k} L_ij*L_kj) / L_kk, the sums run over the
+    // common pattern of rows i and k
+    for (int i = 0; i < n; i++)
+    {
+        int diag = L_p[i+1] - 1;
+        for (int m = L_p[i]; m < diag; m++)
+        {
+            int k = L_i[m];
+            double val = L_x[m];
+            int a = L_p[i], b = L_p[k];
+            while (a < m && b < L_p[k+1] - 1)
+            {
+                if (L_i[a] == L_i[b]) val -= L_x[a++] * L_x[b++];
+                else if (L_i[a] < L_i[b]) a++;
+                else b++;
+            }
+            L_x[m] = val / L_x[L_p[k+1] - 1];
+            L_x[diag] -= L_x[m] * L_x[m];
+        }
+        if (!(L_x[diag] > 0)) return false;
+        L_x[diag] = sqrt(L_x[diag]);
+    }
+    return true;
+}
+
+void CommonSolverCG::setup_precond(CSRMatrix *A)
+{
+    int n = A->get_size();
+    int *Ap = A->get_Ap();
+    int *Ai = A->get_Ai();
+    double *Ax = A->get_Ax();
+
+    if (precond == CG_PRECOND_JACOBI || precond == CG_PRECOND_BLOCK_JACOBI)
+    {
+        inv_diag.assign(n, 0);
+        for (int i = 0; i < n; i++)
+            for (int k = Ap[i]; k < Ap[i+1]; k++)
+                if (Ai[k] == i) inv_diag[i] += Ax[k];
+        for (int i = 0; i < n; i++)
+        {
+            if (inv_diag[i] == 0)
+                _error("Zero diagonal entry in the Jacobi preconditioner.");
+            inv_diag[i] = 1. / inv_diag[i];
+        }
+    }
+
+    if (precond == CG_PRECOND_BLOCK_JACOBI)
+    {
+        if (blocks.empty())
+            _error("No blocks given for the block Jacobi preconditioner.");
+        // dense Cholesky factors of the blocks, indices covered by
+        // a block do not use the diagonal
+        std::vector<int> local(n, -1);
+        block_start.assign(1, 0);
+        block_chol.clear();
+        for (int b = 0; b < (int)blocks.size(); b++)
+        {
+            const std::vector<int> &idx = blocks[b];
+            int nb = idx.size();
+            for (int i = 0; i < nb; i++)
+            {
+                if (idx[i] < 0 || idx[i] >= n)
+                    _error("Invalid index in a block of the block Jacobi preconditioner.");
+                local[idx[i]] = i;
+                inv_diag[idx[i]] = 0;
+            }
+            int start = block_chol.size();
+            block_chol.resize(start + nb*nb, 0);
+            double *c = &block_chol[start];
+            for (int i = 0; i < nb; i++)
+                for (int k = Ap[idx[i]]; k < Ap[idx[i]+1]; k++)
+                    if (local[Ai[k]] >= 0) c[i*nb + local[Ai[k]]] += Ax[k];
+            for (int j = 0; j < nb; j++)
+            {
+                for (int k = 0; k < j; k++)
+                    c[j*nb + j] -= c[j*nb + k] * c[j*nb + k];
+                if (!(c[j*nb + j] > 0))
+                    _error("A block of the block Jacobi preconditioner is not positive definite.");
+                c[j*nb + j] = sqrt(c[j*nb + j]);
+                for (int i = j + 1; i < nb; i++)
+                {
+                    for (int k = 0; k < j; k++)
+                        c[i*nb + j] -= c[i*nb + k] * c[j*nb + k];
+                    c[i*nb + j] /= c[j*nb + j];
+                }
+            }
+            for (int i = 0; i < nb; i++) local[idx[i]] = -1;
+            block_start.push_back(block_chol.size());
+        }
+    }
+
+    if (precond == CG_PRECOND_IC0)
+    {
+        double shift = 0;
+        while (!factorize_ic0(A, shift))
+        {
+            shift = (shift == 0) ? 1e-3 : 2*shift;
+            if (shift > 1e3)
+                _error("IC(0) failed, the matrix is not positive definite.");
+        }
+        if (shift > 0 && !quiet)
+            printf("CG solver: IC(0) with diagonal shift %g\n", shift);
+    }
+}
+
+// z = M^{-1} r
+void CommonSolverCG::apply_precond(double *r, double *z)
+{
+    int n = (precond == CG_PRECOND_IC0) ? (int)L_p.size() - 1 : inv_diag.size();
+    if (precond == CG_PRECOND_JACOBI || precond == CG_PRECOND_BLOCK_JACOBI)
+    {
+        for (int i = 0; i < n; i++) z[i] = inv_diag[i] * r[i];
+    }
+    if (precond == CG_PRECOND_BLOCK_JACOBI)
+    {
+        std::vector<double> y;
+        for (int b = 0; b < (int)blocks.size(); b++)
+        {
+            const std::vector<int> &idx = blocks[b];
+            int nb = idx.size();
+            double *c = &block_chol[block_start[b]];
+            y.resize(nb);
+            for (int i = 0; i < nb; i++)
+            {
+                double val = r[idx[i]];
+                for (int k = 0; k < i; k++) val -= c[i*nb + k] * y[k];
+                y[i] = val / c[i*nb + i];
+            }
+            for (int i = nb - 1; i >= 0; i--)
+            {
+                double val = y[i];
+                for (int k = i + 1; k < nb; k++) val -= c[k*nb + i] * y[k];
+                y[i] = val / c[i*nb + i];
+            }
+            for (int i = 0; i < nb; i++) z[idx[i]] += y[i];
+        }
+    }
+    if (precond == CG_PRECOND_IC0)
+    {
+        // L*y = r, then L^T*z = y (column-wise with the rows of L)
+        for (int i = 0; i < n; i++)
+        {
+            double val = r[i];
+            int diag = L_p[i+1] - 1;
+            for (int k = L_p[i]; k < diag; k++) val -= L_x[k] * z[L_i[k]];
+            z[i] = val / L_x[diag];
+        }
+        for (int i = n - 1; i >= 0; i--)
+        {
+            int diag = L_p[i+1] - 1;
+            z[i] /= L_x[diag];
+            for (int k = L_p[i]; k < diag; k++) z[L_i[k]] -= L_x[k] * z[i];
+        }
+    }
+}
+
+// Standard (preconditioned) CG method starting from zero vector
 // (because we solve for the increment)
 // x... comes as right-hand side, leaves as solution
 bool CommonSolverCG::_solve(Matrix* A, double *x, double tol, int maxiter)
 {
-    printf("CG solver\n");
+    if (!quiet) printf("CG solver\n");
+
+    CSRMatrix *Acsr = dynamic_cast<CSRMatrix*>(A);
+    bool own_csr = (Acsr == NULL);
+    if (own_csr)
+    {
+        Acsr = new CSRMatrix(A);
+        Acsr->set_num_threads(A->get_num_threads());
+    }
+    if (precond != CG_PRECOND_NONE) setup_precond(Acsr);
 
     int n_dof = A->get_size();
     double *r = new double[n_dof];
     double *p = new double[n_dof];
+    double *z = new double[n_dof];
     double *help_vec = new double[n_dof];
-    if (r == NULL || p == NULL || help_vec == NULL) {
+    if (r == NULL || p == NULL || z == NULL || help_vec == NULL) {
         _error("a vector could not be allocated in solve_linear_system_iter().");
     }
     // r = b - A*x0  (where b is x and x0 = 0)
     for (int i=0; i < n_dof; i++) r[i] = x[i];
-    // p = r
-    for (int i=0; i < n_dof; i++) p[i] = r[i];
+    // p = z = M^{-1}*r
+    if (precond == CG_PRECOND_NONE)
+        for (int i=0; i < n_dof; i++) z[i] = r[i];
+    else
+        apply_precond(r, z);
+    for (int i=0; i < n_dof; i++) p[i] = z[i];
 
     // setting initial condition x = 0
     for (int i=0; i < n_dof; i++) x[i] = 0;
@@ -39,35 +258,44 @@ bool CommonSolverCG::_solve(Matrix* A, double *x, double tol, int maxiter)
     // CG iteration
     int iter_current = 0;
     double tol_current;
+    double r_times_z = vec_dot(r, z, n_dof);
     while (1)
     {
-        mat_dot(A, p, help_vec, n_dof);
-        double r_times_r = vec_dot(r, r, n_dof);
-        double alpha = r_times_r / vec_dot(p, help_vec, n_dof);
+        Acsr->times_vector(p, help_vec, n_dof);
+        double alpha = r_times_z / vec_dot(p, help_vec, n_dof);
         for (int i=0; i < n_dof; i++) {
             x[i] += alpha*p[i];
             r[i] -= alpha*help_vec[i];
         }
-        double r_times_r_new = vec_dot(r, r, n_dof);
         iter_current++;
-        tol_current = sqrt(r_times_r_new);
+        tol_current = sqrt(vec_dot(r, r, n_dof));
         if (tol_current < tol
             || iter_current >= maxiter) break;
-        double beta = r_times_r_new/r_times_r;
-        for (int i=0; i < n_dof; i++) p[i] = r[i] + beta*p[i];
+        if (precond == CG_PRECOND_NONE)
+            for (int i=0; i < n_dof; i++) z[i] = r[i];
+        else
+            apply_precond(r, z);
+        double r_times_z_new = vec_dot(r, z, n_dof);
+        double beta = r_times_z_new/r_times_z;
+        r_times_z = r_times_z_new;
+        for (int i=0; i < n_dof; i++) p[i] = z[i] + beta*p[i];
     }
     bool flag;
     if (tol_current <= tol)
         flag = true;
     else
         flag = false;
+    num_iters = iter_current;
 
     if (r != NULL) delete [] r;
     if (p != NULL) delete [] p;
+    if (z != NULL) delete [] z;
     if (help_vec != NULL) delete [] help_vec;
+    if (own_csr) delete Acsr;
 
-    printf("CG solver: maxiter: %i, tol: %e\n",
-           iter_current, tol_current);
+    if (!quiet)
+        printf("CG solver: maxiter: %i, tol: %e\n",
+               iter_current, tol_current);
 
     return flag;
 }
@@ -84,28 +312,195 @@ bool CommonSolverDenseLU::_solve(Matrix* A, double *x)
 {
     printf("DenseLU solver\n");
 
-    DenseMatrix *Aden = NULL;
+    bool flag = factorize(A) && backsolve(x);
+    free_factorization();
+    return flag;
+}
+
+bool CommonSolverDenseLU::factorize(Matrix* A)
+{
+    free_factorization();
+    size = A->get_size();
+    lu = _new_matrix<double>(size, size);
+    memset(lu[0], 0, (long)size * size * sizeof(double));
 
     if (DenseMatrix *mden = dynamic_cast<DenseMatrix*>(A))
-        Aden = mden;
+    {
+        for (int i = 0; i < size; i++)
+            memcpy(lu[i], mden->get_A()[i], size * sizeof(double));
+    }
+    else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(A))
+    {
+        int *Ap = mcsc->get_Ap();
+        int *Ai = mcsc->get_Ai();
+        double *Ax = mcsc->get_Ax();
+        for (int j = 0; j < size; j++)
+            for (int k = Ap[j]; k < Ap[j+1]; k++)
+                lu[Ai[k]][j] += Ax[k];
+    }
     else if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(A))
-        Aden = new DenseMatrix(mcoo);
+    {
+        int nnz = mcoo->get_nnz();
+        int *row = new int[nnz];
+        int *col = new int[nnz];
+        double *data = new double[nnz];
+        mcoo->get_row_col_data(row, col, data);
+        for (int k = 0; k < nnz; k++)
+            lu[row[k]][col[k]] += data[k];
+        delete[] row;
+        delete[] col;
+        delete[] data;
+    }
     else
         _error("Matrix type not supported.");
 
-    int n = Aden->get_size();
-    int *indx = new int[n];
-    double **_mat = Aden->get_A();
+    indx = new int[size];
     double d;
-    ludcmp(_mat, n, indx, &d);
-    lubksb(_mat, n, indx, x);
+    ludcmp(lu, size, indx, &d);
+    return true;
+}
+
+bool CommonSolverDenseLU::backsolve(double *x, int n_rhs)
+{
+    if (lu == NULL)
+        _error("CommonSolverDenseLU: no factorization, call factorize() first.");
+    for (int r = 0; r < n_rhs; r++)
+        lubksb(lu, size, indx, x + (long)r * size);
+    return true;
+}
 
-    delete[] indx;
-    if (!dynamic_cast<DenseMatrix*>(A))
-        delete Aden;
+void CommonSolverDenseLU::free_factorization()
+{
+    if (lu != NULL) delete[] lu;
+    if (indx != NULL) delete[] indx;
+    lu = NULL;
+    indx = NULL;
+    size = 0;
 }
 
 bool CommonSolverDenseLU::_solve(Matrix* A, cplx *x)
 {
     _error("CommonSolverDenseLU::solve(Matrix *mat, cplx *res) not implemented.");
 }
+
+// ***********************************************************************************************************************
+
+bool CommonSolverBandLU::_solve(Matrix* A, double *x)
+{
+    bool flag = factorize(A) && backsolve(x);
+    free_factorization();
+    return flag;
+}
+
+// Column j of the band storage holds rows j-ku-kl, ..., j+kl, the first 
+// kl entries are for the fill-in caused by row interchanges.
+#define AB(i, j) ab[(long)(j) * (2*kl + ku + 1) + (i) - (j) + ku + kl]
+
+bool CommonSolverBandLU::factorize(Matrix* A)
+{
+    free_factorization();
+
+    CSCMatrix *Acsc = NULL;
+    if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(A))
+        Acsc = mcsc;
+    else
+        Acsc = new CSCMatrix(A);
+
+    int n = size = Acsc->get_size();
+    int *Ap = Acsc->get_Ap();
+    int *Ai = Acsc->get_Ai();
+    double *Ax = Acsc->get_Ax();
+
+    // lower and upper bandwidth
+    kl = ku = 0;
+    for (int j = 0; j < n; j++)
+        for (int k = Ap[j]; k < Ap[j+1]; k++) {
+            if (Ai[k] - j > kl) kl = Ai[k] - j;
+            if (j - Ai[k] > ku) ku = j - Ai[k];
+        }
+    if (!quiet)
+        printf("Band LU solver: n = %i, kl = %i, ku = %i\n", n, kl, ku);
+
+    long ab_size = (long)n * (2*kl + ku + 1);
+    ab = new double[ab_size];
+    memset(ab, 0, ab_size * sizeof(double));
+    for (int j = 0; j < n; j++)
+        for (int k = Ap[j]; k < Ap[j+1]; k++)
+            AB(Ai[k], j) += Ax[k];
+    if (Acsc != A)
+        delete Acsc;
+
+    piv = new int[n];
+    for (int k = 0; k < n; k++)
+    {
+        int last_row = std::min(n - 1, k + kl);
+        int last_col = std::min(n - 1, k + ku + kl);
+        int p = k;
+        for (int i = k + 1; i <= last_row; i++)
+            if (fabs(AB(i, k)) > fabs(AB(p, k))) p = i;
+        piv[k] = p;
+        if (AB(p, k) == 0.0)
+            _error("Band LU solver: singular matrix.");
+        if (p != k)
+            for (int j = k; j <= last_col; j++)
+                std::swap(AB(k, j), AB(p, j));
+        for (int i = k + 1; i <= last_row; i++)
+        {
+            double l = (AB(i, k) /= AB(k, k));
+            if (l == 0.0) continue;
+            for (int j = k + 1; j <= last_col; j++)
+                AB(i, j) -= l * AB(k, j);
+        }
+    }
+    return true;
+}
+
+bool CommonSolverBandLU::backsolve(double *x, int n_rhs)
+{
+    if (ab == NULL)
+        _error("CommonSolverBandLU: no factorization, call factorize() first.");
+    int n = size;
+    // forward substitution (L is applied with the row interchanges),
+    // every column of the factors is used for all right-hand sides
+    for (int k = 0; k < n; k++)
+    {
+        int last_row = std::min(n - 1, k + kl);
+        for (int r = 0; r < n_rhs; r++)
+        {
+            double *b = x + (long)r * n;
+            if (piv[k] != k) std::swap(b[k], b[piv[k]]);
+            for (int i = k + 1; i <= last_row; i++)
+                b[i] -= AB(i, k) * b[k];
+        }
+    }
+    // back substitution
+    for (int k = n - 1; k >= 0; k--)
+    {
+        int last_col = std::min(n - 1, k + ku + kl);
+        for (int r = 0; r < n_rhs; r++)
+        {
+            double *b = x + (long)r * n;
+            double sum = b[k];
+            for (int j = k + 1; j <= last_col; j++)
+                sum -= AB(k, j) * b[j];
+            b[k] = sum / AB(k, k);
+        }
+    }
+    return true;
+}
+
+#undef AB
+
+void CommonSolverBandLU::free_factorization()
+{
+    if (ab != NULL) delete[] ab;
+    if (piv != NULL) delete[] piv;
+    ab = NULL;
+    piv = NULL;
+    size = kl = ku = 0;
+}
+
+bool CommonSolverBandLU::_solve(Matrix* A, cplx *x)
+{
+    _error("CommonSolverBandLU::solve(Matrix *mat, cplx *res) not implemented.");
+}
@@ -6,34 +6,103 @@
 #ifndef __HERMES_COMMON_SOLVERS_H
 #define __HERMES_COMMON_SOLVERS_H
 
+#include <vector>
+
 class Matrix;
 class Vector;
+class CSRMatrix;
 
 // abstract class
 class CommonSolver
 {
 public:
+    virtual ~CommonSolver() {}
     virtual bool _solve(Matrix *mat, double *res) = 0;
     virtual bool _solve(Matrix *mat, cplx *res) = 0;
     virtual bool solve(Matrix *mat, Vector *res);
     inline char *get_log() { return log; }
 
+    // Reuse of factorizations (direct solvers only):
+    // analyze() does the symbolic phase for the sparsity pattern of 'mat'
+    //   (optional, factorize() calls it when the pattern changes),
+    // factorize() computes and keeps the factorization of 'mat',
+    // backsolve() solves the system with the last factorized matrix and
+    //   can be called repeatedly. 'res' holds 'n_rhs' right-hand sides 
+    //   one after another, they are replaced by the solutions.
+    // free_factorization() releases the symbolic and numeric data.
+    virtual bool is_factorization_supported() { return false; }
+    virtual bool analyze(Matrix *mat) { return true; }
+    virtual bool factorize(Matrix *mat);
+    virtual bool backsolve(double *res, int n_rhs=1);
+    virtual void free_factorization() {}
+
 private:
     char *log;
 };
 
-// c++ cg
+// c++ cg, optionally preconditioned (both the matrix and the
+// preconditioner must be symmetric positive definite):
+// CG_PRECOND_NONE.........no preconditioner
+// CG_PRECOND_JACOBI.......diagonal of the matrix
+// CG_PRECOND_BLOCK_JACOBI.dense blocks of the matrix on the index sets
+//                         given by set_blocks() (e.g. the dofs of the
+//                         elements), the other indices use the diagonal
+// CG_PRECOND_IC0..........incomplete Cholesky factorization without
+//                         fill-in (the diagonal is shifted if it breaks
+//                         down)
+// The matrix is converted to CSR once per solve, so every iteration
+// is a plain CSR product.
+enum
+{
+    CG_PRECOND_NONE,
+    CG_PRECOND_JACOBI,
+    CG_PRECOND_BLOCK_JACOBI,
+    CG_PRECOND_IC0
+};
+
 class CommonSolverCG : public CommonSolver
 {
 public:
+    CommonSolverCG() : precond(CG_PRECOND_NONE), quiet(false), num_iters(0) {}
     bool _solve(Matrix *mat, double *res)
     {
-        _solve(mat, res, 1e-6, 1000);
+        return _solve(mat, res, 1e-6, 1000);
     }
     bool _solve(Matrix *mat, double *res,
                double tol,
                int maxiter);
     bool _solve(Matrix *mat, cplx *res);
+
+    void set_precond(int precond);
+    // index sets for CG_PRECOND_BLOCK_JACOBI (overlapping blocks
+    // are added)
+    void set_blocks(const std::vector<std::vector<int> > &blocks)
+    {
+        this->blocks = blocks;
+    }
+    // quiet mode: nothing is printed in _solve()
+    void set_quiet(bool quiet) { this->quiet = quiet; }
+    // number of iterations of the last solve
+    int get_num_iters() { return num_iters; }
+
+private:
+    void setup_precond(CSRMatrix *A);
+    void apply_precond(double *r, double *z);
+    bool factorize_ic0(CSRMatrix *A, double shift);
+
+    int precond;
+    bool quiet;
+    int num_iters;
+    std::vector<std::vector<int> > blocks;
+    // inverse diagonal (Jacobi, and the indices in no block)
+    std::vector<double> inv_diag;
+    // Cholesky factors of the blocks (dense, one after another)
+    std::vector<double> block_chol;
+    std::vector<int> block_start;
+    // IC(0) factor L, CSR rows of the lower triangle with the
+    // diagonal entry last
+    std::vector<int> L_p, L_i;
+    std::vector<double> L_x;
 };
 inline bool solve_linear_system_cg(Matrix *mat, double *res,
                                    double tolerance,
@@ -52,8 +121,20 @@ inline bool solve_linear_system_cg(Matrix *mat, cplx *res)
 class CommonSolverDenseLU : public CommonSolver
 {
 public:
+    CommonSolverDenseLU() : lu(NULL), indx(NULL), size(0) {}
+    ~CommonSolverDenseLU() { free_factorization(); }
     bool _solve(Matrix *mat, double *res);
     bool _solve(Matrix *mat, cplx *res);
+
+    bool is_factorization_supported() { return true; }
+    bool factorize(Matrix *mat);
+    bool backsolve(double *res, int n_rhs=1);
+    void free_factorization();
+
+private:
+    double **lu;
+    int *indx;
+    int size;
 };
 inline void solve_linear_system_dense_lu(Matrix *mat, double *res)
 {
@@ -66,12 +147,61 @@ inline void solve_linear_system_dense_lu(Matrix *mat, cplx *res)
     solver._solve(mat, res);
 }
 
+// c++ band lu
+// LU factorization with partial pivoting of a banded matrix, the
+// bandwidth is detected from the sparsity pattern. The cost is
+// O(n*kl*(kl+ku)) operations and O(n*(2*kl+ku+1)) memory, where kl and ku
+// are the lower and upper bandwidths.
+class CommonSolverBandLU : public CommonSolver
+{
+public:
+    CommonSolverBandLU() : ab(NULL), piv(NULL), size(0), kl(0), ku(0),
+                           quiet(false) {}
+    ~CommonSolverBandLU() { free_factorization(); }
+    bool _solve(Matrix *mat, double *res);
+    bool _solve(Matrix *mat, cplx *res);
+    // quiet mode: the bandwidth is not printed in factorize()
+    void set_quiet(bool quiet) { this->quiet = quiet; }
+
+    bool is_factorization_supported() { return true; }
+    bool factorize(Matrix *mat);
+    bool backsolve(double *res, int n_rhs=1);
+    void free_factorization();
+
+private:
+    double *ab;     // LU factors in band storage
+    int *piv;       // row interchanges
+    int size, kl, ku;
+    bool quiet;
+};
+inline void solve_linear_system_band_lu(Matrix *mat, double *res)
+{
+    CommonSolverBandLU solver;
+    solver._solve(mat, res);
+}
+
 // c++ umfpack - optional
 class CommonSolverUmfpack : public CommonSolver
 {
 public:
+    CommonSolverUmfpack() : symbolic(NULL), numeric(NULL), size(0) {}
+    ~CommonSolverUmfpack() { free_factorization(); }
     bool _solve(Matrix *mat, double *res);
     bool _solve(Matrix *mat, cplx *res);
+
+    // false if the library is not compiled in
+    bool is_factorization_supported();
+    bool analyze(Matrix *mat);
+    bool factorize(Matrix *mat);
+    bool backsolve(double *res, int n_rhs=1);
+    void free_factorization();
+
+private:
+    void *symbolic, *numeric;
+    int size;
+    // copy of the factorized matrix (UMFPACK needs it for the solves)
+    std::vector<int> Ap, Ai;
+    std::vector<double> Ax;
 };
 inline void solve_linear_system_umfpack(Matrix *mat, double *res)
 {
@@ -133,9 +263,22 @@ inline void solve_linear_system_sparselib_ir(Matrix *mat, double *res, double to
 class CommonSolverSuperLU : public CommonSolver
 {
 public:
+    CommonSolverSuperLU() : factors(NULL) {}
+    ~CommonSolverSuperLU() { free_factorization(); }
     bool _solve(Matrix *mat, double *res);
     bool _solve2(Matrix *mat, double *res);
     bool _solve(Matrix *mat, cplx *res);
+
+    // false if the library is not compiled in
+    bool is_factorization_supported();
+    bool analyze(Matrix *mat);
+    bool factorize(Matrix *mat);
+    bool backsolve(double *res, int n_rhs=1);
+    void free_factorization();
+
+private:
+    // SuperLU data (L, U, permutations), see superlu_solver.cpp
+    struct SuperLUFactors *factors;
 };
 inline void solve_linear_system_superlu(Matrix *mat, double *res)
 {
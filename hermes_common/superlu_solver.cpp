@@ -133,6 +133,159 @@ bool CommonSolverSuperLU::_solve(Matrix *mat, cplx *res)
     _error("CommonSolverSuperLU::solve(Matrix *mat, cplx *res) not implemented.");
 }
 
+// factors kept between factorize() and backsolve()
+struct SuperLUFactors
+{
+    int size;
+    int *perm_c;        // column permutation (from analyze())
+    int *perm_r;        // row permutations from partial pivoting
+    bool factorized;
+    SuperMatrix L;      // factor L
+    SuperMatrix U;      // factor U
+};
+
+bool CommonSolverSuperLU::is_factorization_supported()
+{
+    return true;
+}
+
+// column ordering
+bool CommonSolverSuperLU::analyze(Matrix *mat)
+{
+    CSCMatrix *Acsc = NULL;
+
+    if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
+        Acsc = new CSCMatrix(mcoo);
+    else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
+        Acsc = mcsc;
+    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
+        Acsc = new CSCMatrix(mcsr);
+    else
+        _error("Matrix type not supported.");
+
+    free_factorization();
+    int size = Acsc->get_size();
+    factors = new SuperLUFactors;
+    factors->size = size;
+    factors->factorized = false;
+    factors->perm_c = intMalloc(size);
+    factors->perm_r = intMalloc(size);
+    if (!factors->perm_c) ABORT("Malloc fails for perm_c[].");
+    if (!factors->perm_r) ABORT("Malloc fails for perm_r[].");
+
+    SuperMatrix A;
+    dCreate_CompCol_Matrix(&A, size, size, Acsc->get_nnz(), Acsc->get_Ax(),
+                           Acsc->get_Ai(), Acsc->get_Ap(), SLU_NC, SLU_D, SLU_GE);
+    // COLAMD ordering
+    get_perm_c(3, &A, factors->perm_c);
+    // (the arrays belong to Acsc)
+    Destroy_SuperMatrix_Store(&A);
+
+    if (!dynamic_cast<CSCMatrix*>(mat))
+        delete Acsc;
+    return true;
+}
+
+// LU factorization with the column ordering from analyze()
+bool CommonSolverSuperLU::factorize(Matrix *mat)
+{
+    CSCMatrix *Acsc = NULL;
+
+    if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
+        Acsc = new CSCMatrix(mcoo);
+    else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
+        Acsc = mcsc;
+    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
+        Acsc = new CSCMatrix(mcsr);
+    else
+        _error("Matrix type not supported.");
+
+    // (the ordering of a different pattern of the same size is still
+    // a valid permutation, call analyze() to recompute it)
+    int size = Acsc->get_size();
+    if (factors == NULL || factors->size != size)
+        analyze(Acsc);
+    if (factors->factorized)
+    {
+        Destroy_SuperNode_Matrix(&factors->L);
+        Destroy_CompCol_Matrix(&factors->U);
+        factors->factorized = false;
+    }
+
+    superlu_options_t options;
+    set_default_options(&options);
+    options.ColPerm = MY_PERMC;
+
+    SuperMatrix A, B;
+    dCreate_CompCol_Matrix(&A, size, size, Acsc->get_nnz(), Acsc->get_Ax(),
+                           Acsc->get_Ai(), Acsc->get_Ap(), SLU_NC, SLU_D, SLU_GE);
+    // dgssv() needs a right-hand side, the solves are done in backsolve()
+    double *rhs = new double[size];
+    memset(rhs, 0, size*sizeof(double));
+    dCreate_Dense_Matrix(&B, size, 1, rhs, size, SLU_DN, SLU_D, SLU_GE);
+
+    SuperLUStat_t stat;
+    int info;
+    StatInit(&stat);
+    dgssv(&options, &A, factors->perm_c, factors->perm_r,
+          &factors->L, &factors->U, &B, &stat, &info);
+    StatFree(&stat);
+
+    Destroy_SuperMatrix_Store(&A);
+    Destroy_SuperMatrix_Store(&B);
+    delete[] rhs;
+    if (!dynamic_cast<CSCMatrix*>(mat))
+        delete Acsc;
+
+    if (info != 0)
+    {
+        printf("dgssv() error returns INFO = %d\n", info);
+        if (info <= size)
+        {
+            Destroy_SuperNode_Matrix(&factors->L);
+            Destroy_CompCol_Matrix(&factors->U);
+        }
+        _error("SuperLU: factorization failed.");
+    }
+    factors->factorized = true;
+    return true;
+}
+
+bool CommonSolverSuperLU::backsolve(double *res, int n_rhs)
+{
+    if (factors == NULL || !factors->factorized)
+        _error("CommonSolverSuperLU: no factorization, call factorize() first.");
+
+    SuperMatrix B;
+    dCreate_Dense_Matrix(&B, factors->size, n_rhs, res, factors->size,
+                         SLU_DN, SLU_D, SLU_GE);
+    SuperLUStat_t stat;
+    int info;
+    StatInit(&stat);
+    dgstrs(NOTRANS, &factors->L, &factors->U, factors->perm_c, factors->perm_r,
+           &B, &stat, &info);
+    StatFree(&stat);
+    Destroy_SuperMatrix_Store(&B);
+
+    if (info != 0)
+        _error("SuperLU: dgstrs() failed.");
+    return true;
+}
+
+void CommonSolverSuperLU::free_factorization()
+{
+    if (factors == NULL) return;
+    if (factors->factorized)
+    {
+        Destroy_SuperNode_Matrix(&factors->L);
+        Destroy_CompCol_Matrix(&factors->U);
+    }
+    SUPERLU_FREE (factors->perm_r);
+    SUPERLU_FREE (factors->perm_c);
+    delete factors;
+    factors = NULL;
+}
+
 #else
 
 bool CommonSolverSuperLU::_solve(Matrix *mat, double *res)
@@ -145,4 +298,28 @@ bool CommonSolverSuperLU::_solve(Matrix *mat, cplx *res)
     _error("CommonSolverSuperLU::solve(Matrix *mat, cplx *res) not implemented.");
 }
 
+bool CommonSolverSuperLU::is_factorization_supported()
+{
+    return false;
+}
+
+bool CommonSolverSuperLU::analyze(Matrix *mat)
+{
+    _error("CommonSolverSuperLU::analyze(Matrix *mat) not implemented.");
+}
+
+bool CommonSolverSuperLU::factorize(Matrix *mat)
+{
+    _error("CommonSolverSuperLU::factorize(Matrix *mat) not implemented.");
+}
+
+bool CommonSolverSuperLU::backsolve(double *res, int n_rhs)
+{
+    _error("CommonSolverSuperLU::backsolve(double *res, int n_rhs) not implemented.");
+}
+
+void CommonSolverSuperLU::free_factorization()
+{
+}
+
 #endif
@@ -110,6 +110,43 @@ void test_matrix4()
     */
 }
 
+// duplicates are summed in the order of insertion, entries added 
+// after the matrix was read are merged with the existing ones
+void test_matrix6()
+{
+    CooMatrix m(4);
+    m.add(3, 1, 1.0);
+    m.add(0, 2, 2.0);
+    m.add(3, 0, 4.0);
+    m.add(0, 2, 0.5);
+    m.add(1, 1, 0.0);
+    _assert(m.get_nnz() == 4);
+    _assert(m.get(0, 2) == 2.5);
+    _assert(m.get(1, 1) == 0.0);
+    _assert(m.get(2, 2) == 0.0);
+
+    int row[5], col[5];
+    double data[5];
+    m.get_row_col_data(row, col, data);
+    int row_ok[4] = {0, 1, 3, 3}, col_ok[4] = {2, 1, 0, 1};
+    for (int k = 0; k < 4; k++)
+        _assert(row[k] == row_ok[k] && col[k] == col_ok[k]);
+
+    m.add(3, 1, -3.0);
+    m.add(2, 3, 1.5);
+    _assert(m.get_nnz() == 5);
+    _assert(m.get(3, 1) == -2.0);
+
+    double x[4] = {1, 2, 3, 4}, y[4];
+    m.times_vector(x, y, 4);
+    _assert(y[0] == 7.5 && y[1] == 0 && y[2] == 6 && y[3] == 0);
+
+    CSCMatrix n(&m);
+    _assert(n.get_nnz() == 5);
+    _assert(n.get(2, 3) == 1.5);
+    _assert(n.get(3, 1) == -2.0);
+}
+
 #include "python_api.h"
 
 void test_matrix5()
@@ -142,6 +179,8 @@ int main(int argc, char* argv[])
         test_matrix2();
         test_matrix3();
         test_matrix4();
+        // (test_matrix5() needs Python)
+        test_matrix6();
         test_matrix5();
 
         return ERROR_SUCCESS;
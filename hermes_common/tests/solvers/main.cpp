@@ -92,6 +92,72 @@ void test_solver_cg()
     _assert(fabs(res[3] - 0.2) < EPS);
 }
 
+// symmetric positive definite matrix, the solution is (1, 2, ..., 6)
+// with all preconditioners (the matrix is given in CSC, COO and dense
+// formats)
+void test_solver_cg_precond()
+{
+    CooMatrix A(6);
+    for (int i = 0; i < 6; i++)
+        A.add(i, i, 4 + i);
+    for (int i = 0; i < 5; i++)
+    {
+        A.add(i, i + 1, -1);
+        A.add(i + 1, i, -1);
+    }
+    A.add(0, 4, 0.5);
+    A.add(4, 0, 0.5);
+    CSCMatrix B(&A);
+    DenseMatrix C(&A);
+    Matrix *mats[3] = {&A, &B, &C};
+
+    double x[6] = {1., 2., 3., 4., 5., 6.};
+    double b[6];
+    B.times_vector(x, b, 6);
+
+    std::vector<std::vector<int> > blocks(2);
+    blocks[0].push_back(0);
+    blocks[0].push_back(1);
+    blocks[0].push_back(2);
+    blocks[1].push_back(4);
+    blocks[1].push_back(3);
+
+    int preconds[4] = {CG_PRECOND_NONE, CG_PRECOND_JACOBI,
+                       CG_PRECOND_BLOCK_JACOBI, CG_PRECOND_IC0};
+    for (int k = 0; k < 4; k++)
+    {
+        for (int m = 0; m < 3; m++)
+        {
+            CommonSolverCG solver;
+            solver.set_precond(preconds[k]);
+            solver.set_blocks(blocks);
+            solver.set_quiet(true);
+            double res[6];
+            for (int i = 0; i < 6; i++) res[i] = b[i];
+            _assert(solver._solve(mats[m], res, EPS, 100));
+            _assert(solver.get_num_iters() <= 6);
+            for (int i = 0; i < 6; i++)
+                _assert(fabs(res[i] - (i + 1)) < 1e-10);
+        }
+    }
+
+    // without fill-in IC(0) of a tridiagonal matrix is exact
+    CooMatrix T(6);
+    for (int i = 0; i < 6; i++)
+        T.add(i, i, 2);
+    for (int i = 0; i < 5; i++)
+    {
+        T.add(i, i + 1, -1);
+        T.add(i + 1, i, -1);
+    }
+    CommonSolverCG solver;
+    solver.set_precond(CG_PRECOND_IC0);
+    solver.set_quiet(true);
+    double res[6] = {1., 1., 1., 1., 1., 1.};
+    _assert(solver._solve(&T, res, EPS, 100));
+    _assert(solver.get_num_iters() == 1);
+}
+
 void test_solver_scipy_1()
 {
     CooMatrix A(4);
@@ -417,6 +483,56 @@ void test_solver_superlu()
     _assert(fabs(res[4] - 5.) < EPS);
 }
 
+// factorize once, solve for several right-hand sides (one by one
+// and as a block), then refactorize a matrix with the same pattern
+void test_solver_factorization(CommonSolver *solver)
+{
+    CooMatrix A(5);
+    A.add(0, 0, 2);
+    A.add(0, 1, 3);
+    A.add(1, 0, 3);
+    A.add(1, 2, 4);
+    A.add(1, 4, 6);
+    A.add(2, 1, -1);
+    A.add(2, 2, -3);
+    A.add(2, 3, 2);
+    A.add(3, 2, 1);
+    A.add(4, 1, 4);
+    A.add(4, 2, 2);
+    A.add(4, 4, 1);
+    CSCMatrix B(&A);
+
+    _assert(solver->is_factorization_supported());
+    _assert(solver->analyze(&B));
+    _assert(solver->factorize(&B));
+
+    double res[5] = {8., 45., -3., 3., 19.};
+    _assert(solver->backsolve(res));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res[i] - (i + 1)) < EPS);
+
+    // A*(1, 1, 1, 1, 1) and A*(1, 2, 3, 4, 5)
+    double res2[10] = {5., 13., -2., 1., 7.,
+                       8., 45., -3., 3., 19.};
+    _assert(solver->backsolve(res2, 2));
+    for (int i = 0; i < 5; i++)
+    {
+        _assert(fabs(res2[i] - 1.) < EPS);
+        _assert(fabs(res2[5 + i] - (i + 1)) < EPS);
+    }
+
+    // 2*A
+    for (int k = 0; k < B.get_nnz(); k++)
+        B.get_Ax()[k] *= 2;
+    _assert(solver->factorize(&B));
+    double res3[5] = {16., 90., -6., 6., 38.};
+    _assert(solver->backsolve(res3));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res3[i] - (i + 1)) < EPS);
+
+    solver->free_factorization();
+}
+
 int main(int argc, char* argv[])
 {
     try {
@@ -428,6 +544,15 @@ int main(int argc, char* argv[])
         test_solver_dense_lu1();
         test_solver_dense_lu2();
         test_solver_cg();
+        test_solver_cg_precond();
+        {
+            CommonSolverDenseLU solver;
+            test_solver_factorization(&solver);
+        }
+        {
+            CommonSolverBandLU solver;
+            test_solver_factorization(&solver);
+        }
 
         // NumPy + SciPy
 #ifdef COMMON_WITH_SCIPY
@@ -440,11 +565,29 @@ int main(int argc, char* argv[])
 #ifdef COMMON_WITH_UMFPACK
         test_solver_umfpack_real();
         test_solver_umfpack_imag();
+        {
+            CommonSolverUmfpack solver;
+            test_solver_factorization(&solver);
+        }
+#else
+        {
+            CommonSolverUmfpack solver;
+            _assert(!solver.is_factorization_supported());
+        }
 #endif
 
         // SuperLU
 #ifdef COMMON_WITH_SUPERLU
         test_solver_superlu();
+        {
+            CommonSolverSuperLU solver;
+            test_solver_factorization(&solver);
+        }
+#else
+        {
+            CommonSolverSuperLU solver;
+            _assert(!solver.is_factorization_supported());
+        }
 #endif
 
         return ERROR_SUCCESS;
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+
+// This test makes sure that the matrix-vector products of the COO, CSR,
+// CSC and BSR formats (and the transposed product of CSC) agree with a
+// reference product, that the threaded CSR, transposed CSC and BSR
+// products give exactly the serial results, and that BSR matrices are
+// converted to CSR and CSC correctly. The matrix is block tridiagonal
+// with dense 3x3 blocks, similar to the Jacobi matrix of a system of
+// three equations. The timings are in examples/spmv_benchmark.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// General input:
+int N = 20000;                          // Matrix size (large enough
+                                        // for all threads to get rows)
+int N_THREADS = 4;                      // Threads for the threaded products
+int BLOCK_SIZE = 3;                     // Size of the blocks
+
+void _assert(bool a)
+{
+    if (!a) throw std::runtime_error("Assertion failed.");
+}
+
+// columns of row 'i' are first_col(i), ..., last_col(i)
+int first_col(int i)
+{
+    return std::max((i / BLOCK_SIZE - 1) * BLOCK_SIZE, 0);
+}
+
+int last_col(int i)
+{
+    return std::min((i / BLOCK_SIZE + 2) * BLOCK_SIZE, N) - 1;
+}
+
+double entry(int i, int j)
+{
+    return 1. / (1 + i % 7 + 2*(j % 5)) + (i == j ? 3*BLOCK_SIZE : 0);
+}
+
+double max_diff(double *a, double *b, int n)
+{
+    double diff = 0;
+    for (int i = 0; i < n; i++) diff = std::max(diff, fabs(a[i] - b[i]));
+    return diff;
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        CooMatrix A(N);
+        for (int i = 0; i < N; i++)
+            for (int j = first_col(i); j <= last_col(i); j++)
+                A.add(i, j, entry(i, j));
+        CSRMatrix B(&A);
+        CSCMatrix C(&A);
+
+        // reference products A*vec and A^T*vec
+        std::vector<double> vec(N), ref(N, 0), ref_t(N, 0), res(N), res_t(N);
+        for (int i = 0; i < N; i++) vec[i] = sin(0.1*i);
+        for (int i = 0; i < N; i++)
+            for (int j = first_col(i); j <= last_col(i); j++)
+            {
+                ref[i] += entry(i, j) * vec[j];
+                ref_t[j] += entry(i, j) * vec[i];
+            }
+
+        A.times_vector(&vec[0], &res[0], N);
+        _assert(max_diff(&res[0], &ref[0], N) < 1e-12);
+        B.times_vector(&vec[0], &res[0], N);
+        _assert(max_diff(&res[0], &ref[0], N) < 1e-12);
+        C.times_vector(&vec[0], &res[0], N);
+        _assert(max_diff(&res[0], &ref[0], N) < 1e-12);
+        C.times_vector_transposed(&vec[0], &res_t[0], N);
+        _assert(max_diff(&res_t[0], &ref_t[0], N) < 1e-12);
+
+        // the rows are summed in the same order by every thread
+        B.times_vector(&vec[0], &res[0], N);
+        B.set_num_threads(N_THREADS);
+        std::vector<double> res_threads(N);
+        B.times_vector(&vec[0], &res_threads[0], N);
+        _assert(res_threads == res);
+        C.set_num_threads(N_THREADS);
+        C.times_vector_transposed(&vec[0], &res_threads[0], N);
+        _assert(res_threads == res_t);
+
+        // BSR matrix with the same entries (N is not a multiple of
+        // BLOCK_SIZE, so the last block row and column are padded)
+        int n_block_rows = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<std::vector<int> > block_cols(n_block_rows);
+        for (int i = 0; i < N; i++)
+            for (int j = first_col(i); j <= last_col(i); j++)
+                block_cols[i / BLOCK_SIZE].push_back(j / BLOCK_SIZE);
+        BSRMatrix D(N, BLOCK_SIZE, block_cols);
+        for (int i = 0; i < N; i++)
+            for (int j = first_col(i); j <= last_col(i); j++)
+                D.add(i, j, entry(i, j));
+        D.times_vector(&vec[0], &res[0], N);
+        _assert(max_diff(&res[0], &ref[0], N) < 1e-12);
+        D.set_num_threads(N_THREADS);
+        D.times_vector(&vec[0], &res_threads[0], N);
+        _assert(res_threads == res);
+        D.set_num_threads(1);
+
+        // conversions (zeros inside of the blocks would be kept)
+        CSRMatrix D_csr(&D);
+        CSCMatrix D_csc(&D);
+        int nnz_blocks = 0;
+        for (int bi = 0; bi < n_block_rows; bi++)
+            for (int k = D.get_Bp()[bi]; k < D.get_Bp()[bi+1]; k++)
+                nnz_blocks += std::min(BLOCK_SIZE, N - bi*BLOCK_SIZE) *
+                              std::min(BLOCK_SIZE, N - D.get_Bj()[k]*BLOCK_SIZE);
+        _assert(D_csr.get_nnz() == nnz_blocks);
+        _assert(D_csc.get_nnz() == nnz_blocks);
+        D_csr.times_vector(&vec[0], &res[0], N);
+        _assert(max_diff(&res[0], &ref[0], N) < 1e-12);
+        D_csc.times_vector_transposed(&vec[0], &res_t[0], N);
+        _assert(max_diff(&res_t[0], &ref_t[0], N) < 1e-12);
+        for (int j = 0; j < N; j += 997)
+            for (int i = first_col(j); i <= last_col(j); i++)
+                _assert(D_csc.get(i, j) == entry(i, j));
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
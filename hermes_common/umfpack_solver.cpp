@@ -39,6 +39,19 @@ bool CommonSolverUmfpack::_solve(Matrix *mat, double *res)
 {
     printf("UMFPACK solver\n");
 
+    bool flag = factorize(mat) && backsolve(res);
+    free_factorization();
+    return flag;
+}
+
+bool CommonSolverUmfpack::is_factorization_supported()
+{
+    return true;
+}
+
+// symbolic analysis
+bool CommonSolverUmfpack::analyze(Matrix *mat)
+{
     CSCMatrix *Acsc = NULL;
 
     if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
@@ -50,46 +63,82 @@ bool CommonSolverUmfpack::_solve(Matrix *mat, double *res)
     else
         _error("Matrix type not supported.");
 
+    free_factorization();
+    size = Acsc->get_size();
     int nnz = Acsc->get_nnz();
-    int size = Acsc->get_size();
+    Ap.assign(Acsc->get_Ap(), Acsc->get_Ap() + size + 1);
+    Ai.assign(Acsc->get_Ai(), Acsc->get_Ai() + nnz);
 
-    // solve
     umfpack_di_defaults(control_array);
-
-    /* symbolic analysis */
-    void *symbolic, *numeric;
     int status_symbolic = umfpack_di_symbolic(size, size,
-                                              Acsc->get_Ap(), Acsc->get_Ai(), NULL, &symbolic,
+                                              &Ap[0], &Ai[0], NULL, &symbolic,
                                               control_array, info_array);
     print_status(status_symbolic);
 
-    /* LU factorization */
-    int status_numeric = umfpack_di_numeric(Acsc->get_Ap(), Acsc->get_Ai(), Acsc->get_Ax(), symbolic, &numeric,
-                                            control_array, info_array);
-    print_status(status_numeric);
+    if (!dynamic_cast<CSCMatrix*>(mat))
+        delete Acsc;
+    return true;
+}
 
-    umfpack_di_free_symbolic(&symbolic);
+// LU factorization, the symbolic analysis is reused if the
+// sparsity pattern did not change
+bool CommonSolverUmfpack::factorize(Matrix *mat)
+{
+    CSCMatrix *Acsc = NULL;
 
-    double *x;
-    x = (double*) malloc(size * sizeof(double));
+    if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
+        Acsc = new CSCMatrix(mcoo);
+    else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
+        Acsc = mcsc;
+    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
+        Acsc = new CSCMatrix(mcsr);
+    else
+        _error("Matrix type not supported.");
 
-    /* solve system */
-    int status_solve = umfpack_di_solve(UMFPACK_A,
-                                        Acsc->get_Ap(), Acsc->get_Ai(), Acsc->get_Ax(), x, res, numeric,
-                                        control_array, info_array);
+    int nnz = Acsc->get_nnz();
+    bool same_pattern = symbolic != NULL && size == Acsc->get_size()
+        && (int) Ai.size() == nnz
+        && std::equal(Ap.begin(), Ap.end(), Acsc->get_Ap())
+        && std::equal(Ai.begin(), Ai.end(), Acsc->get_Ai());
+    if (!same_pattern)
+        analyze(Acsc);
 
-    print_status(status_solve);
+    if (numeric) umfpack_di_free_numeric(&numeric);
+    numeric = NULL;
+    Ax.assign(Acsc->get_Ax(), Acsc->get_Ax() + nnz);
+    int status_numeric = umfpack_di_numeric(&Ap[0], &Ai[0], &Ax[0], symbolic, &numeric,
+                                            control_array, info_array);
+    print_status(status_numeric);
 
-    umfpack_di_free_numeric(&numeric);
+    if (!dynamic_cast<CSCMatrix*>(mat))
+        delete Acsc;
+    return true;
+}
 
-    if (symbolic) umfpack_di_free_symbolic(&symbolic);
-    if (numeric) umfpack_di_free_numeric(&numeric);
+bool CommonSolverUmfpack::backsolve(double *res, int n_rhs)
+{
+    if (numeric == NULL)
+        _error("CommonSolverUmfpack: no factorization, call factorize() first.");
 
-    memcpy(res, x, size*sizeof(double));
+    double *x = new double[size];
+    for (int r = 0; r < n_rhs; r++)
+    {
+        double *b = res + (long)r * size;
+        int status_solve = umfpack_di_solve(UMFPACK_A,
+                                            &Ap[0], &Ai[0], &Ax[0], x, b, numeric,
+                                            control_array, info_array);
+        print_status(status_solve);
+        memcpy(b, x, size*sizeof(double));
+    }
     delete[] x;
+    return true;
+}
 
-    if (!dynamic_cast<CSCMatrix*>(mat))
-        delete Acsc;
+void CommonSolverUmfpack::free_factorization()
+{
+    if (symbolic) umfpack_di_free_symbolic(&symbolic);
+    if (numeric) umfpack_di_free_numeric(&numeric);
+    symbolic = numeric = NULL;
 }
 
 bool CommonSolverUmfpack::_solve(Matrix *mat, cplx *res)
@@ -183,6 +232,30 @@ bool CommonSolverUmfpack::_solve(Matrix *mat, double *res)
     _error("CommonSolverUmfpack::solve(Matrix *mat, double *res) not implemented.");
 }
 
+bool CommonSolverUmfpack::is_factorization_supported()
+{
+    return false;
+}
+
+bool CommonSolverUmfpack::analyze(Matrix *mat)
+{
+    _error("CommonSolverUmfpack::analyze(Matrix *mat) not implemented.");
+}
+
+bool CommonSolverUmfpack::factorize(Matrix *mat)
+{
+    _error("CommonSolverUmfpack::factorize(Matrix *mat) not implemented.");
+}
+
+bool CommonSolverUmfpack::backsolve(double *res, int n_rhs)
+{
+    _error("CommonSolverUmfpack::backsolve(double *res, int n_rhs) not implemented.");
+}
+
+void CommonSolverUmfpack::free_factorization()
+{
+}
+
 bool CommonSolverUmfpack::_solve(Matrix *mat, cplx *res)
 {
     _error("CommonSolverUmfpack::solve(Matrix *mat, cplx *res) not implemented.");
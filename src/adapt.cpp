@@ -4,10 +4,13 @@
 // Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
 
 #include "common.h"
+#include "adapt.h"
 #include "matrix.h"
 #include "transforms.h"
 #include "linearizer.h"
 
+#include <map>
+
 // This is great help to debug automatic adaptivity. Generated are 
 // Gnuplot files for all refinement candidates, showing both the 
 // reference solution and the projection. Thus one can visually 
@@ -157,14 +160,15 @@ double calc_error_estimate(int norm, Mesh* mesh, Mesh* mesh_ref,
 			   double *err_array)
 {
   double err_total_squared = 0;
-  Iterator *I = new Iterator(mesh);
-  Iterator *I_ref = new Iterator(mesh_ref);
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  std::vector<Element*> &elems_ref = mesh_ref->get_active_elems();
+  int n_elem = elems.size();
 
   // simultaneous traversal of 'mesh' and 'mesh_ref'
-  Element *e;
-  int counter = 0;
-  while ((e = I->next_active_element()) != NULL) {
-    Element *e_ref = I_ref->next_active_element();
+  int m_ref = 0;
+  for (int m=0; m < n_elem; m++) {
+    Element *e = elems[m];
+    Element *e_ref = elems_ref[m_ref++];
     double err_squared;
     if (e->level == e_ref->level) { // element 'e' was not refined in space
                                     // for reference solution
@@ -172,21 +176,28 @@ double calc_error_estimate(int norm, Mesh* mesh, Mesh* mesh_ref,
     }
     else { // element 'e' was refined in space for reference solution
       Element* e_ref_left = e_ref;
-      Element* e_ref_right = I_ref->next_active_element();
+      Element* e_ref_right = elems_ref[m_ref++];
       err_squared = calc_elem_est_error_squared_hp(norm, e, 
                     e_ref_left, e_ref_right);
     }
     err_array[e->id] = err_squared;
     err_total_squared += err_squared;
-    counter++;
   }
 
-  for (int i=0; i < counter; i++) {
+  for (int i=0; i < n_elem; i++) {
     err_array[i] = sqrt(err_array[i]);
   }
   return sqrt(err_total_squared);
 }
 
+double calc_error_estimate(int norm, Mesh* mesh, Mesh* mesh_ref,
+			   std::vector<double> &err_array)
+{
+  err_array.resize(mesh->get_n_active_elem());
+  if (err_array.empty()) return 0;
+  return calc_error_estimate(norm, mesh, mesh_ref, &err_array[0]);
+}
+
 double calc_error_estimate(int norm, Mesh* mesh, 
                            ElemPtr2* ref_element_pairs)
 {
@@ -269,17 +280,18 @@ int int_cmp(const void *a, const void *b)
 // err_squared_array[] will be sorted. 
 void sort_element_errors(int n, double *err_squared_array, int *id_array) 
 {
-    double array[MAX_ELEM_NUM][2];
+    if (n <= 0) return;
+    std::vector<double> array(2*n);
     for (int i=0; i<n; i++) {
-      array[i][0] = err_squared_array[i];
-      array[i][1] = id_array[i];
+      array[2*i] = err_squared_array[i];
+      array[2*i+1] = id_array[i];
     }
 
-    qsort(array, n, 2*sizeof(double), int_cmp);
+    qsort(&array[0], n, 2*sizeof(double), int_cmp);
 
     for (int i=0; i<n; i++) {
-      err_squared_array[i] = array[i][0];
-      id_array[i] = (int) array[i][1];
+      err_squared_array[i] = array[2*i];
+      id_array[i] = (int) array[2*i+1];
     }
 }
 
@@ -349,6 +361,46 @@ void fill_proj_rhs_H1(int fns_num, int pts_num,
   }
 }
 
+static ProjMatrixCache proj_matrix_cache;
+
+ProjMatrix *ProjMatrixCache::insert(const ProjMatrixKey &key, double **matrix)
+{
+  int n = key.fns_num;
+  ProjMatrix *pm = new ProjMatrix(n);
+  for (int i=0; i < n; i++) {
+    for (int j=0; j < n; j++) pm->lu[i][j] = pm->chol[i][j] = matrix[i][j];
+  }
+  delete [] matrix;
+  double d;
+  ludcmp(pm->lu, n, pm->indx, &d);
+  for (int i=0; i < n && pm->chol_ok; i++) {
+    for (int j=0; j <= i; j++) {
+      double g = pm->chol[i][j];
+      for (int m=0; m < j; m++) g -= pm->chol[i][m]*pm->chol[j][m];
+      if (i > j) pm->chol[i][j] = g / pm->chol[j][j];
+      else if (g > 0) pm->chol[i][i] = sqrt(g);
+      else {
+        pm->chol_ok = false;
+        break;
+      }
+    }
+  }
+
+  this->mutex.lock();
+  std::map<ProjMatrixKey, ProjMatrix*>::iterator it = this->entries.find(key);
+  if (it != this->entries.end()) {
+    // inserted by another thread in the meantime
+    delete pm;
+    pm = it->second;
+  }
+  else if ((int)this->entries.size() < PROJ_MATRIX_CACHE_SIZE) {
+    pm->cached = true;
+    this->entries[key] = pm;
+  }
+  this->mutex.unlock();
+  return pm;
+}
+
 // Calculate the projection coefficients for every 
 // transformed Legendre polynomial and every solution 
 // component. The basis are the transformed Legendre 
@@ -359,23 +411,19 @@ void calc_proj_coeffs_H1(int n_eq, int fns_num, int pts_num,
                          double pol_val[MAX_QUAD_PTS_NUM][MAX_P+1],
                          double pol_der[MAX_QUAD_PTS_NUM][MAX_P+1],
                          double phys_weights[MAX_QUAD_PTS_NUM], 
-                         double proj_coeffs[MAX_EQN_NUM][MAX_P+1])
+                         double proj_coeffs[MAX_EQN_NUM][MAX_P+1],
+                         int order, double length, ProjMatrixCache *cache)
 { 
-  // allocate and fill projection matrix
-  double** matrix = get_proj_matrix_H1(n_eq, fns_num, pts_num,
-                                       pol_val, pol_der, 
-                                       phys_weights); 
-
-  // replace matrix with its LU decomposition
-  // permutations caused by partial pivoting are 
-  // recorded in the vector indx
-  int *indx = new int[MAX_P+1];
-  double d;
-  ludcmp(matrix, fns_num, indx, &d);
-
-  // allocate projection rhs vector
-  double *rhs = new double[MAX_P+1];
-
+  if (cache == NULL) cache = &proj_matrix_cache;
+  // LU decomposition of the projection matrix (the matrix 
+  // is only assembled and factorized for a new key)
+  ProjMatrixKey key = {fns_num, order, -1, length};
+  ProjMatrix *pm = cache->find(key);
+  if (pm == NULL) 
+    pm = cache->insert(key, get_proj_matrix_H1(n_eq, fns_num, 
+                       pts_num, pol_val, pol_der, phys_weights));
+
+  double rhs[MAX_P+1];
   for(int c=0; c<n_eq; c++) {          // loop over solution components 
     // fill projection rhs
     fill_proj_rhs_H1(fns_num, pts_num,
@@ -384,17 +432,13 @@ void calc_proj_coeffs_H1(int n_eq, int fns_num, int pts_num,
 		     phys_weights, rhs); 
 
     // solve system
-    lubksb(matrix, fns_num, indx, rhs);
+    lubksb(pm->lu, fns_num, pm->indx, rhs);
 
     // copy sol[] to proj_coeffs[c]
     for(int m=0; m < fns_num; m++) proj_coeffs[c][m] = rhs[m];
   }
 
-  // FIXME: can this frequent creation and deletion 
-  // of this matrix be avoided?
-  delete [] matrix;
-  delete [] indx;
-  delete [] rhs;
+  if (!pm->cached) delete pm;
 }
 
 // Assumes that reference solution is defined on two half-elements 'e_ref_left'
@@ -454,7 +498,8 @@ double check_cand_coarse_hp_fine_hp(int norm, Element *e, Element *e_ref_left,
                            leg_pol_val_left, 
                            leg_pol_der_left, 
                            phys_weights_left, 
-                           proj_coeffs_left);
+                           proj_coeffs_left,
+                           order_left, e_ref_left->x2 - e_ref_left->x1);
 
   // evaluate the projection in 'e_ref_left' for every solution component
   // and every integration point
@@ -536,7 +581,8 @@ double check_cand_coarse_hp_fine_hp(int norm, Element *e, Element *e_ref_left,
                            leg_pol_val_right, 
                            leg_pol_der_right, 
                            phys_weights_right, 
-                           proj_coeffs_right);
+                           proj_coeffs_right,
+                           order_right, e_ref_right->x2 - e_ref_right->x1);
 
   // evaluate the projection in 'e_ref_right' for every solution component
   // and every integration point
@@ -732,7 +778,8 @@ double check_cand_coarse_hp_fine_p(int norm, Element *e, Element *e_ref,
                            leg_pol_val_left, 
                            leg_pol_der_left, 
                            phys_weights_left, 
-                           proj_coeffs_left);
+                           proj_coeffs_left,
+                           order_left, (e->x1 + e->x2)/2. - e->x1);
 
   // evaluate the projection on the left half for every solution component
   // and every integration point
@@ -812,7 +859,8 @@ double check_cand_coarse_hp_fine_p(int norm, Element *e, Element *e_ref,
                            leg_pol_val_right, 
                            leg_pol_der_right, 
                            phys_weights_right, 
-                           proj_coeffs_right);
+                           proj_coeffs_right,
+                           order_right, e->x2 - (e->x1 + e->x2)/2.);
 
   // evaluate the projection on the right half for every solution component
   // and every integration point
@@ -1041,32 +1089,30 @@ double check_cand_coarse_p_fine_hp(int norm, Element *e, Element *e_ref_left,
     }
   }
   else { 
-    // calculate first part of the projection matrix
-    double** matrix_left;  
-    matrix_left = get_proj_matrix_H1(n_eq, fns_num, pts_num_left,
-                                     leg_pol_val_left, leg_pol_der_left, 
-                                     phys_weights_left); 
-    // calculate second part of the projection matrix
-    double** matrix_right;  
-    matrix_right = get_proj_matrix_H1(n_eq, fns_num, pts_num_right,
-                                      leg_pol_val_right, leg_pol_der_right, 
-                                      phys_weights_right); 
-    // add the two matrices 
-    double ** matrix = _new_matrix<double>(MAX_P+1, MAX_P+1);
-    for(int i=0; i < fns_num; i++) { 
-      for(int j=0; j < fns_num; j++) { 
-        matrix[i][j] = matrix_left[i][j] + matrix_right[i][j];
+    // LU decomposition of the projection matrix, the sum of the 
+    // parts from both halves (only assembled for a new key)
+    ProjMatrixKey key = {fns_num, order_left, order_right, e->x2 - e->x1};
+    ProjMatrix *pm = proj_matrix_cache.find(key);
+    if (pm == NULL) {
+      double** matrix_left;  
+      matrix_left = get_proj_matrix_H1(n_eq, fns_num, pts_num_left,
+                                       leg_pol_val_left, leg_pol_der_left, 
+                                       phys_weights_left); 
+      double** matrix_right;  
+      matrix_right = get_proj_matrix_H1(n_eq, fns_num, pts_num_right,
+                                        leg_pol_val_right, leg_pol_der_right, 
+                                        phys_weights_right); 
+      for(int i=0; i < fns_num; i++) { 
+        for(int j=0; j < fns_num; j++) { 
+          matrix_left[i][j] += matrix_right[i][j];
+        }
       }
+      delete [] matrix_right;
+      pm = proj_matrix_cache.insert(key, matrix_left);
     }
-    // perform LU factorization (result stored in matrix and indx)
-    int *indx = new int[MAX_P+1];
-    double d;
-    ludcmp(matrix, fns_num, indx, &d);
 
     // for every equation, construct the rhs and solve the system
-    double *rhs_left = new double[MAX_P+1];
-    double *rhs_right = new double[MAX_P+1];    
-    double *rhs = new double[MAX_P+1];
+    double rhs_left[MAX_P+1], rhs_right[MAX_P+1], rhs[MAX_P+1];
     for (int c=0; c<n_eq; c++) {
       fill_proj_rhs_H1(fns_num, pts_num_left,
                        phys_u_ref_left[c], phys_dudx_ref_left[c],
@@ -1077,15 +1123,10 @@ double check_cand_coarse_p_fine_hp(int norm, Element *e, Element *e_ref_left,
                        leg_pol_val_right, leg_pol_der_right,
 		       phys_weights_right, rhs_right);
       for(int i=0; i < fns_num; i++) rhs[i] = rhs_left[i] + rhs_right[i];
-      lubksb(matrix, fns_num, indx, rhs);
+      lubksb(pm->lu, fns_num, pm->indx, rhs);
       for(int m=0; m < fns_num; m++) proj_coeffs[c][m] = rhs[m];
     }
-    delete [] matrix_left;
-    delete [] matrix_right;
-    delete [] matrix;
-    delete [] rhs_left;
-    delete [] rhs_right;
-    delete [] rhs;
+    if (!pm->cached) delete pm;
   }
 
   // evaluate the projection in 'e_ref_left' for every solution component
@@ -1317,7 +1358,8 @@ double check_cand_coarse_p_fine_p(int norm, Element *e, Element *e_ref,
                            leg_pol_val, 
                            leg_pol_der, 
                            phys_weights, 
-                           proj_coeffs);
+                           proj_coeffs,
+                           order, e->x2 - e->x1);
 
   // evaluate the projection in 'e' for every solution component
   // and every integration point
@@ -1522,11 +1564,158 @@ double calc_error_exact(int norm, Mesh *mesh,
   return sqrt(total_err_squared);
 }
 
+// Reference solution and transformed Legendre polynomials at the 
+// quadrature points of one part of a projection interval.
+struct ProjPart {
+  int order;                 // quadrature order
+  double length;             // length of the interval of the polynomials
+  int pts_num;
+  double weights[MAX_QUAD_PTS_NUM];
+  double u_ref[MAX_EQN_NUM][MAX_QUAD_PTS_NUM];
+  double dudx_ref[MAX_EQN_NUM][MAX_QUAD_PTS_NUM];
+  double pol_val[MAX_QUAD_PTS_NUM][MAX_P+1];
+  double pol_der[MAX_QUAD_PTS_NUM][MAX_P+1];
+};
+
+// Fills 'part' in the interval (x1, x2). The reference solution 'e_ref' 
+// is evaluated with 'sln_flag' and the Legendre polynomials on (a, b) 
+// with 'leg_flag' (0... whole interval, -1/1... left/right half, see 
+// get_solution_quad() and legendre_val_phys_quad()).
+static void fill_proj_part(int norm, int order, int fns_num, 
+                           Element *e_ref, int sln_flag, double x1, double x2,
+                           int leg_flag, double a, double b, ProjPart &part)
+{
+  double phys_x[MAX_QUAD_PTS_NUM];
+  part.order = order;
+  part.length = b - a;
+  create_phys_element_quadrature(x1, x2, order, phys_x, part.weights, 
+                                 &part.pts_num); 
+  e_ref->get_solution_quad(sln_flag, order, part.u_ref, part.dudx_ref); 
+  legendre_val_phys_quad(leg_flag, order, fns_num, a, b, part.pol_val);
+  if (norm == 1) legendre_der_phys_quad(leg_flag, order, fns_num, a, b, 
+                                        part.pol_der);
+}
+
+// Calculates the squared L2 (norm == 0) or H1 (norm == 1) errors of 
+// the projections of the reference solution on polynomials of degrees 
+// 0, 1, ..., p_max, summed over the parts and solution components. 
+// The projections are hierarchic: the transformed Legendre polynomials 
+// are orthonormal in L2, and in H1 they are orthonormalized using the 
+// Cholesky factorization of the projection matrix (its leading blocks 
+// are the factorizations for the lower degrees). So the coefficients 
+// of all projections are prefixes of the coefficients for 'p_max', 
+// and the errors for all degrees are obtained in one sweep. 
+// NOTE: the polynomials in 'parts' are overwritten.
+static void calc_proj_errors_squared(int norm, int n_eq, int p_max, 
+                                     int n_parts, ProjPart *parts, 
+                                     double err_squared[MAX_P+1])
+{
+  int fns_num = p_max + 1;
+  if (norm == 1) {
+    // Cholesky factorization of the projection matrix (the parts are 
+    // one interval, or the two halves of the interval of the polynomials)
+    ProjMatrixKey key = {fns_num, parts[0].order, 
+                         n_parts > 1 ? parts[1].order : -1, parts[0].length};
+    ProjMatrix *pm = proj_matrix_cache.find(key);
+    if (pm == NULL) {
+      double **matrix = _new_matrix<double>(fns_num, fns_num);
+      for (int i=0; i < fns_num; i++) {
+        for (int j=0; j < fns_num; j++) {
+          matrix[i][j] = 0;
+          for (int s=0; s < n_parts; s++) {
+            ProjPart &pt = parts[s];
+            for (int k=0; k < pt.pts_num; k++) 
+              matrix[i][j] += (pt.pol_val[k][i]*pt.pol_val[k][j] + 
+                               pt.pol_der[k][i]*pt.pol_der[k][j]) * pt.weights[k];
+          }
+        }
+      }
+      pm = proj_matrix_cache.insert(key, matrix);
+    }
+    if (!pm->chol_ok) 
+      error("Singular projection matrix in calc_proj_errors_squared().");
+    double **L = pm->chol;
+    // orthonormal basis
+    for (int s=0; s < n_parts; s++) {
+      ProjPart &pt = parts[s];
+      for (int k=0; k < pt.pts_num; k++) {
+        for (int m=0; m < fns_num; m++) {
+          double val = pt.pol_val[k][m], der = pt.pol_der[k][m];
+          for (int i=0; i < m; i++) {
+            val -= L[m][i]*pt.pol_val[k][i];
+            der -= L[m][i]*pt.pol_der[k][i];
+          }
+          pt.pol_val[k][m] = val / L[m][m];
+          pt.pol_der[k][m] = der / L[m][m];
+        }
+      }
+    }
+    if (!pm->cached) delete pm;
+  }
+
+  for (int m=0; m < fns_num; m++) err_squared[m] = 0;
+  for (int c=0; c < n_eq; c++) {   // loop over solution components
+    // projection coefficients
+    double proj_coeffs[MAX_P+1];
+    for (int m=0; m < fns_num; m++) {
+      proj_coeffs[m] = 0;
+      for (int s=0; s < n_parts; s++) {
+        ProjPart &pt = parts[s];
+        for (int k=0; k < pt.pts_num; k++) {
+          double val = pt.u_ref[c][k] * pt.pol_val[k][m];
+          if (norm == 1) val += pt.dudx_ref[c][k] * pt.pol_der[k][m];
+          proj_coeffs[m] += val * pt.weights[k];
+        }
+      }
+    }
+    // errors of the projections of all degrees
+    for (int s=0; s < n_parts; s++) {
+      ProjPart &pt = parts[s];
+      for (int k=0; k < pt.pts_num; k++) {
+        double proj_val = 0, proj_der = 0;
+        for (int m=0; m < fns_num; m++) {
+          proj_val += proj_coeffs[m] * pt.pol_val[k][m];
+          double diff_val = pt.u_ref[c][k] - proj_val;
+          double err_pt = diff_val * diff_val;
+          if (norm == 1) {
+            proj_der += proj_coeffs[m] * pt.pol_der[k][m];
+            double diff_der = pt.dudx_ref[c][k] - proj_der;
+            err_pt += diff_der * diff_der;
+          }
+          err_squared[m] += err_pt * pt.weights[k];
+        }
+      }
+    }
+  }
+}
+
+// Writes Gnuplot files with the projection on candidate 'cand' 
+// (see PLOT_CANDIDATE_PROJECTIONS).
+static void plot_cand_projection(int norm, Element *e, Element *e_ref, 
+                                 Element *e_ref2, int3 cand, int ref_sol_type)
+{
+  double err;
+  int dof;
+  if (cand[0] == 0 && ref_sol_type == 0)
+    check_cand_coarse_p_fine_p(norm, e, e_ref, cand[1], err, dof);
+  if (cand[0] == 0 && ref_sol_type == 1)
+    check_cand_coarse_p_fine_hp(norm, e, e_ref, e_ref2, cand[1], err, dof);
+  if (cand[0] == 1 && ref_sol_type == 0)
+    check_cand_coarse_hp_fine_p(norm, e, e_ref, cand[1], cand[2], err, dof);
+  if (cand[0] == 1 && ref_sol_type == 1)
+    check_cand_coarse_hp_fine_hp(norm, e, e_ref, e_ref2, cand[1], cand[2], 
+                                 err, dof);
+}
+
 // Selects best hp-refinement from the given list (distinguishes whether 
 // the reference refinement on that element was p- or hp-refinement). 
 // Each refinement candidate is a triple of integers. First one means 
 // p-refinement (0) or hp-refinement (1). Second and/or second and third 
 // number are the new proposed polynomial degrees.
+// The reference solution is projected only once on 'e' and once on 
+// each of its halves, with the highest degrees among the candidates, 
+// and the errors of all candidates are taken from these projections 
+// (see calc_proj_errors_squared()).
 int select_hp_refinement(Element *e, Element *e_ref, Element *e_ref2, 
                          int num_cand, int3 *cand_list, 
                          int ref_sol_type, int norm) 
@@ -1536,20 +1725,70 @@ int select_hp_refinement(Element *e, Element *e_ref, Element *e_ref2,
     e_ref_left = e_ref;
     e_ref_right = e_ref2;
   }
+  int n_eq = e->n_eq;
+  double x_mid = (e->x1 + e->x2)/2.;
 
-  // Calculate projection error and the number of degrees of 
-  // freedom of the original element
-  double err_orig;
-  int dof_orig;
-  // reference solution was p-refined 
+  // highest degrees of the candidates in 'e' and in its halves
+  int p_max = e->p, p_max_left = -1, p_max_right = -1;
+  for (int i=0; i<num_cand; i++) {
+    if (cand_list[i][0] == 0) p_max = std::max(p_max, cand_list[i][1]);
+    else {
+      p_max_left = std::max(p_max_left, cand_list[i][1]);
+      p_max_right = std::max(p_max_right, cand_list[i][2]);
+    }
+  }
+
+  // squared projection errors in 'e' for all degrees up to 'p_max'
+  double err_squared[MAX_P+1];
+  ProjPart parts[2];
   if (ref_sol_type == 0) {
-    check_cand_coarse_p_fine_p(norm, e, e_ref, e->p, err_orig, dof_orig);
+    fill_proj_part(norm, 2*std::max(e->p, p_max), p_max + 1, 
+                   e_ref, 0, e->x1, e->x2, 0, e->x1, e->x2, parts[0]);
+    calc_proj_errors_squared(norm, n_eq, p_max, 1, parts, err_squared);
   }
-  // reference solution was hp-refined 
-  if (ref_sol_type == 1) {
-    check_cand_coarse_p_fine_hp(norm, e, e_ref_left, e_ref_right, e->p,
-      err_orig, dof_orig);
+  else {
+    fill_proj_part(norm, 2*std::max(e_ref_left->p, p_max), p_max + 1, 
+                   e_ref_left, 0, e_ref_left->x1, e_ref_left->x2, 
+                   -1, e->x1, e->x2, parts[0]);
+    fill_proj_part(norm, 2*std::max(e_ref_right->p, p_max), p_max + 1, 
+                   e_ref_right, 0, e_ref_right->x1, e_ref_right->x2, 
+                   1, e->x1, e->x2, parts[1]);
+    calc_proj_errors_squared(norm, n_eq, p_max, 2, parts, err_squared);
   }
+
+  // the same in the left and right halves of 'e' (hp-candidates)
+  double err_squared_left[MAX_P+1], err_squared_right[MAX_P+1];
+  if (p_max_left >= 0) {
+    if (ref_sol_type == 0) {
+      fill_proj_part(norm, 2*std::max(e_ref->p, p_max_left), p_max_left + 1,
+                     e_ref, -1, e->x1, x_mid, 0, e->x1, x_mid, parts[0]);
+      calc_proj_errors_squared(norm, n_eq, p_max_left, 1, parts, 
+                               err_squared_left);
+      fill_proj_part(norm, 2*std::max(e_ref->p, p_max_right), p_max_right + 1,
+                     e_ref, 1, x_mid, e->x2, 0, x_mid, e->x2, parts[0]);
+      calc_proj_errors_squared(norm, n_eq, p_max_right, 1, parts, 
+                               err_squared_right);
+    }
+    else {
+      fill_proj_part(norm, 2*std::max(e_ref_left->p, p_max_left), 
+                     p_max_left + 1, e_ref_left, 0, 
+                     e_ref_left->x1, e_ref_left->x2, 
+                     0, e_ref_left->x1, e_ref_left->x2, parts[0]);
+      calc_proj_errors_squared(norm, n_eq, p_max_left, 1, parts, 
+                               err_squared_left);
+      fill_proj_part(norm, 2*std::max(e_ref_right->p, p_max_right), 
+                     p_max_right + 1, e_ref_right, 0, 
+                     e_ref_right->x1, e_ref_right->x2, 
+                     0, e_ref_right->x1, e_ref_right->x2, parts[0]);
+      calc_proj_errors_squared(norm, n_eq, p_max_right, 1, parts, 
+                               err_squared_right);
+    }
+  }
+
+  // Projection error and the number of degrees of 
+  // freedom of the original element
+  double err_orig = sqrt(err_squared[e->p]);
+  int dof_orig = e->p + 1;
   if (PRINT_CANDIDATES) {
     printf("  Elem (%g, %g): err_orig = %g, dof_orig = %d\n", 
            e->x1, e->x2, err_orig, dof_orig);
@@ -1559,33 +1798,26 @@ int select_hp_refinement(Element *e, Element *e_ref, Element *e_ref2,
   double crit_min = 1e10;
   double crit;
   // Traverse the list of all refinement candidates,
-  // for each calculate the projection of the reference
-  // solution on it, and the number of dofs it would 
-  // contribute if selected
+  // for each take the error of the projection of the 
+  // reference solution on it, and the number of dofs it 
+  // would contribute if selected
   for (int i=0; i<num_cand; i++) {
     double err_cand;
     int dof_cand;
-    if (cand_list[i][0] == 0 && ref_sol_type == 0) {
-      int p_new = cand_list[i][1];
-      check_cand_coarse_p_fine_p(norm, e, e_ref, p_new, err_cand, dof_cand);
-    }
-    if (cand_list[i][0] == 0 && ref_sol_type == 1) {
+    if (cand_list[i][0] == 0) {
       int p_new = cand_list[i][1];
-      check_cand_coarse_p_fine_hp(norm, e, e_ref_left, e_ref_right, 
-        p_new, err_cand, dof_cand);
-    }
-    if (cand_list[i][0] == 1 && ref_sol_type == 0) {
-      int p_new_left = cand_list[i][1];
-      int p_new_right = cand_list[i][2];
-      check_cand_coarse_hp_fine_p(norm, e, e_ref, p_new_left, 
-        p_new_right, err_cand, dof_cand);
+      err_cand = sqrt(err_squared[p_new]);
+      dof_cand = p_new + 1;
     }
-    if (cand_list[i][0] == 1 && ref_sol_type == 1) {
+    else {
       int p_new_left = cand_list[i][1];
       int p_new_right = cand_list[i][2];
-      check_cand_coarse_hp_fine_hp(norm, e, e_ref_left, e_ref_right, 
-        p_new_left, p_new_right, err_cand, dof_cand);
+      err_cand = sqrt(err_squared_left[p_new_left] + 
+                      err_squared_right[p_new_right]);
+      dof_cand = p_new_left + p_new_right + 1;
     }
+    if (PLOT_CANDIDATE_PROJECTIONS) 
+      plot_cand_projection(norm, e, e_ref, e_ref2, cand_list[i], ref_sol_type);
 
     // The projection error is zero (reference 
     // solution is recovered exactly). 
@@ -6,6 +6,9 @@
 #ifndef _ADAPT_H_
 #define _ADAPT_H_
 
+#include <vector>
+#include <map>
+
 #include "common.h"
 #include "legendre.h"
 #include "lobatto.h"
@@ -33,6 +36,9 @@ double calc_elem_est_error_squared_hp(int norm, Element *e,
 // error is returned.
 double calc_error_estimate(int norm, Mesh* mesh, Mesh* mesh_ref, 
 			   double *err_array);
+// The same, 'err_array' is resized to the number of active elements.
+double calc_error_estimate(int norm, Mesh* mesh, Mesh* mesh_ref, 
+			   std::vector<double> &err_array);
 
 // Calculates L2 or H1 norm of the difference between the coarse
 // and reference solutions in all active elements of 'mesh'. Total
@@ -47,6 +53,104 @@ double calc_solution_norm(int norm, Mesh* mesh, ElemPtr2* ref_element_pairs);
 // Sort err_array[] and returning array of sorted element indices
 void sort_element_errors(int n, double *err_array, int *id_array); 
 
+// The H1 projection matrix depends only on the number of functions, 
+// the quadrature order(s) and the length of the interval. Either the 
+// basis and the quadrature are in the same interval (order_right == -1), 
+// or the basis is in the whole interval and the quadrature in its 
+// halves, with orders 'order_left' and 'order_right'.
+struct ProjMatrixKey {
+  int fns_num, order_left, order_right;
+  double length;
+  bool operator<(const ProjMatrixKey &k) const {
+    if (this->fns_num != k.fns_num) return this->fns_num < k.fns_num;
+    if (this->order_left != k.order_left) return this->order_left < k.order_left;
+    if (this->order_right != k.order_right) return this->order_right < k.order_right;
+    return this->length < k.length;
+  }
+};
+
+// Factorized H1 projection matrix.
+struct ProjMatrix {
+  ProjMatrix(int fns_num) {
+    this->fns_num = fns_num;
+    this->lu = _new_matrix<double>(fns_num, fns_num);
+    this->chol = _new_matrix<double>(fns_num, fns_num);
+    this->indx = new int[fns_num];
+    this->chol_ok = true;
+    this->cached = false;
+  }
+  ~ProjMatrix() {
+    delete [] this->lu;
+    delete [] this->chol;
+    delete [] this->indx;
+  }
+  int fns_num;
+  double **lu;       // LU factorization (see ludcmp())
+  int *indx;         // permutation of the LU factorization
+  double **chol;     // Cholesky factor (lower triangle)
+  bool chol_ok;      // false if the matrix is not positive definite
+  bool cached;       // owned by the cache, otherwise delete it after use
+};
+
+// Cache of factorized H1 projection matrices shared by all threads. 
+// Entries are never changed or removed once they are inserted, so 
+// they can be used without locking.
+class ProjMatrixCache {
+public:
+  ~ProjMatrixCache() {
+    std::map<ProjMatrixKey, ProjMatrix*>::iterator it;
+    for (it = this->entries.begin(); it != this->entries.end(); it++) 
+      delete it->second;
+  }
+  // Returns the entry for 'key', NULL if there is none.
+  ProjMatrix *find(const ProjMatrixKey &key) {
+    this->mutex.lock();
+    std::map<ProjMatrixKey, ProjMatrix*>::iterator it = this->entries.find(key);
+    ProjMatrix *pm = (it == this->entries.end()) ? NULL : it->second;
+    this->mutex.unlock();
+    return pm;
+  }
+  // Factorizes 'matrix' (of size key.fns_num, it is deleted) and stores 
+  // it under 'key'. When the cache is full, the returned entry is not 
+  // cached (pm->cached == false) and the caller must delete it.
+  ProjMatrix *insert(const ProjMatrixKey &key, double **matrix);
+  int get_num_entries() {
+    this->mutex.lock();
+    int n = this->entries.size();
+    this->mutex.unlock();
+    return n;
+  }
+
+private:
+  std::map<ProjMatrixKey, ProjMatrix*> entries;
+  RecursiveMutex mutex;
+};
+
+// max number of cached projection matrices
+const int PROJ_MATRIX_CACHE_SIZE = 4096;
+
+// Allocates and fills the H1 projection matrix of the first 'fns_num'
+// polynomials 'pol_val', 'pol_der' (delete [] it after use).
+double** get_proj_matrix_H1(int n_eq, int fns_num, int pts_num,
+                            double pol_val[MAX_QUAD_PTS_NUM][MAX_P+1],
+                            double pol_der[MAX_QUAD_PTS_NUM][MAX_P+1],
+                            double phys_weights[MAX_QUAD_PTS_NUM]);
+
+// Calculates the coefficients of the H1 projection of 'phys_u_ref', 
+// 'phys_dudx_ref' on the polynomials 'pol_val', 'pol_der' in an 
+// interval of length 'length' with quadrature order 'order'. The 
+// factorized projection matrix is taken from 'cache' (NULL means 
+// the cache shared by the adaptivity functions).
+void calc_proj_coeffs_H1(int n_eq, int fns_num, int pts_num,
+                         double phys_u_ref[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                         double phys_dudx_ref[MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                         double pol_val[MAX_QUAD_PTS_NUM][MAX_P+1],
+                         double pol_der[MAX_QUAD_PTS_NUM][MAX_P+1],
+                         double phys_weights[MAX_QUAD_PTS_NUM], 
+                         double proj_coeffs[MAX_EQN_NUM][MAX_P+1],
+                         int order, double length, 
+                         ProjMatrixCache *cache=NULL);
+
 // Assumes that reference solution is defined on two half-elements 'e_ref_left'
 // and 'e_ref_right'. The reference solution is projected onto the space of 
 // (discontinuous) polynomials of degree 'p_left' on 'e_ref_left'
@@ -5,6 +5,12 @@
 
 #include "common.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 void error(const char *msg)
 {
   printf("Error: %s\n", msg);
@@ -36,3 +42,73 @@ void intro() {
   printf(" For more details visit http://hpfem.org/.\n");
   printf("-------------------------------------------\n");
 }
+
+#ifdef _WIN32
+RecursiveMutex::RecursiveMutex()
+{
+  CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+  InitializeCriticalSection(cs);
+  this->impl = cs;
+}
+
+RecursiveMutex::~RecursiveMutex()
+{
+  DeleteCriticalSection((CRITICAL_SECTION *)this->impl);
+  delete (CRITICAL_SECTION *)this->impl;
+}
+
+void RecursiveMutex::lock()
+{
+  EnterCriticalSection((CRITICAL_SECTION *)this->impl);
+}
+
+void RecursiveMutex::unlock()
+{
+  LeaveCriticalSection((CRITICAL_SECTION *)this->impl);
+}
+#else
+RecursiveMutex::RecursiveMutex()
+{
+  // recursive, tables may be initialized from another init function
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  this->impl = mutex;
+}
+
+RecursiveMutex::~RecursiveMutex()
+{
+  pthread_mutex_destroy((pthread_mutex_t *)this->impl);
+  delete (pthread_mutex_t *)this->impl;
+}
+
+void RecursiveMutex::lock()
+{
+  pthread_mutex_lock((pthread_mutex_t *)this->impl);
+}
+
+void RecursiveMutex::unlock()
+{
+  pthread_mutex_unlock((pthread_mutex_t *)this->impl);
+}
+#endif
+
+// process-wide lock for init_once_locked()
+static RecursiveMutex init_lock;
+
+void init_once_locked(int *flag, void (*init)(int), int arg)
+{
+  init_lock.lock();
+  if (!*(volatile int *)flag) {
+    init(arg);
+#if defined(__GNUC__)
+    __atomic_store_n(flag, 1, __ATOMIC_RELEASE);
+#else
+    *(volatile int *)flag = 1;
+#endif
+  }
+  init_lock.unlock();
+}
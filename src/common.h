@@ -19,6 +19,10 @@
 #define BOUNDARY_LEFT 0
 #define BOUNDARY_RIGHT 1
 
+// dof orderings (see Mesh::set_dof_ordering())
+#define DOF_ORDERING_COMPONENTS 0
+#define DOF_ORDERING_ELEMENTS 1
+
 // for material flags
 const int ANY = -1234;
 
@@ -32,9 +36,16 @@ const int MAX_P = 30;                  // max poly degree allowed in elements
 const int MAX_QUAD_ORDER = 200;        // max order of Gaussian quadrature implemented
 const int MAX_QUAD_PTS_NUM = 101;      // max number of quadrature points
 
+// Rows of the precalculated shape function tables are padded to
+// a multiple of 8 doubles (64 bytes, one cache line).
+const int MAX_P_PAD = (MAX_P + 1 + 7) / 8 * 8;
+const int MAX_QUAD_PTS_PAD = (MAX_QUAD_PTS_NUM + 7) / 8 * 8;
+
 const int MAX_CAND_NUM = 100;          // maximum allowed number of hp-refinement
                                        // candidates of an element
 
+// The library has no limit on the number of elements and dofs, these 
+// two constants are only kept for existing user code with static arrays.
 const int MAX_ELEM_NUM = 10000;        // maximum number of elements
 const int MAX_N_DOF = 10000;           // maximum number of degrees of freedom
 const int MAX_EQN_NUM = 10;            // maximum number of equations in the system
@@ -61,8 +72,42 @@ typedef int int2[2];
 typedef int int3[3];
 typedef double (*shape_fn_t)(double);
 
+// alignment of static arrays (in bytes)
+#if defined(__GNUC__)
+#define H1D_ALIGN(n) __attribute__((aligned(n)))
+#elif defined(_MSC_VER)
+#define H1D_ALIGN(n) __declspec(align(n))
+#else
+#define H1D_ALIGN(n)
+#endif
+
 // auxiliary functions
 void intro();
+
+// Recursive mutex for tables and caches shared by all threads.
+class RecursiveMutex {
+public:
+    RecursiveMutex();
+    ~RecursiveMutex();
+    void lock();
+    void unlock();
+private:
+    void *impl;
+};
+
+// Lazy initialization of precalculated tables: init_once_locked() calls
+// init(arg) exactly once for every 'flag' (zero initially), also when 
+// several threads need the table at the same time. init_done() is the 
+// cheap check to be done first.
+void init_once_locked(int *flag, void (*init)(int), int arg);
+inline bool init_done(int *flag)
+{
+#if defined(__GNUC__)
+  return __atomic_load_n(flag, __ATOMIC_ACQUIRE);
+#else
+  return *(volatile int *)flag;
+#endif
+}
 #define MEM_CHECK(var) if (var == NULL) { printf("Out of memory."); exit(1); }
 #define verbose(msg)
 #define warn(msg)
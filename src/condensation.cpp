@@ -0,0 +1,207 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#include "condensation.h"
+
+#include <vector>
+#include <algorithm>
+
+// Local data of one element, stored between the elimination
+// of bubbles and their recovery.
+struct CondensedElem {
+  int n_v, n_b;
+  int v[2*MAX_EQN_NUM];          // global vertex dofs
+  std::vector<int> b;            // global bubble dofs
+  std::vector<double> X;         // A_BB^{-1} A_BV, n_b x n_v (row-major)
+  std::vector<double> y;         // A_BB^{-1} b_B
+  std::vector<double> S;         // -A_VB X, n_v x n_v (row-major)
+  std::vector<double> g;         // -A_VB y
+};
+
+// Eliminates the bubbles of element 'e'. Returns false if the
+// bubble block is singular.
+static bool condense_elem(Element *e, int n_eq, CSCMatrix *A, double *rhs,
+                          CondensedElem &ce)
+{
+  ce.n_v = 0;
+  ce.b.clear();
+  for (int c=0; c < n_eq; c++) {
+    for (int j=0; j < 2; j++)
+      if (e->dof[c][j] >= 0) ce.v[ce.n_v++] = e->dof[c][j];
+    for (int j=2; j <= e->p; j++) ce.b.push_back(e->dof[c][j]);
+  }
+  int n_v = ce.n_v;
+  int n_b = ce.n_b = ce.b.size();
+  ce.S.assign(n_v*n_v, 0);
+  ce.g.assign(n_v, 0);
+  if (n_b == 0) return true;
+
+  // A_BB, its LU factorization, X = A_BB^{-1} A_BV and y = A_BB^{-1} b_B
+  double **A_BB = _new_matrix<double>(n_b, n_b);
+  double max_entry = 0;
+  for (int i=0; i < n_b; i++) {
+    double row_max = 0;
+    for (int k=0; k < n_b; k++) {
+      A_BB[i][k] = A->get(ce.b[i], ce.b[k]);
+      row_max = std::max(row_max, fabs(A_BB[i][k]));
+    }
+    if (row_max == 0) {
+      delete [] A_BB;
+      return false;
+    }
+    max_entry = std::max(max_entry, row_max);
+  }
+  int *indx = new int[n_b];
+  double d;
+  ludcmp(A_BB, n_b, indx, &d);
+  bool ok = true;
+  for (int i=0; i < n_b; i++)
+    if (fabs(A_BB[i][i]) <= 1e-14 * max_entry) ok = false;
+
+  if (ok) {
+    std::vector<double> col(n_b);
+    ce.X.resize(n_b*n_v);
+    for (int j=0; j < n_v; j++) {
+      for (int i=0; i < n_b; i++) col[i] = A->get(ce.b[i], ce.v[j]);
+      lubksb(A_BB, n_b, indx, &col[0]);
+      for (int i=0; i < n_b; i++) ce.X[i*n_v + j] = col[i];
+    }
+    ce.y.resize(n_b);
+    for (int i=0; i < n_b; i++) ce.y[i] = rhs[ce.b[i]];
+    lubksb(A_BB, n_b, indx, &ce.y[0]);
+
+    // contribution to the Schur complement: -A_VB X, -A_VB y
+    for (int i=0; i < n_v; i++) {
+      for (int k=0; k < n_b; k++) {
+        double a = A->get(ce.v[i], ce.b[k]);
+        if (a == 0) continue;
+        for (int j=0; j < n_v; j++) ce.S[i*n_v + j] -= a * ce.X[k*n_v + j];
+        ce.g[i] -= a * ce.y[k];
+      }
+    }
+  }
+
+  delete [] indx;
+  delete [] A_BB;
+  return ok;
+}
+
+CondensedSolver::CondensedSolver(Mesh *mesh, CommonSolver *vertex_solver)
+{
+  this->mesh = mesh;
+  this->vertex_solver = vertex_solver;
+  this->num_threads = 1;
+  this->n_vertex_dof = 0;
+}
+
+void CondensedSolver::set_num_threads(int num_threads)
+{
+  if (num_threads < 1) error("Invalid number of threads.");
+#ifndef H1D_WITH_OPENMP
+  if (num_threads > 1)
+    warning("hermes1d was built without OpenMP, condensing in one thread.");
+#endif
+  this->num_threads = num_threads;
+}
+
+bool CondensedSolver::_solve(Matrix *mat, double *res)
+{
+  int n_dof = mesh->get_n_dof();
+  int n_eq = mesh->get_n_eq();
+  if (mat->get_size() != n_dof)
+    error("Matrix size does not match the mesh in CondensedSolver.");
+
+  CSCMatrix *Acsc = dynamic_cast<CSCMatrix*>(mat);
+  if (Acsc == NULL) Acsc = new CSCMatrix(mat);
+
+  // vertex dofs are numbered 0, 1, ... in the condensed system
+  std::vector<int> vertex_idx(n_dof, -1);
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+  int n_v = 0;
+  for (int m=0; m < n_elem; m++) {
+    for (int c=0; c < n_eq; c++)
+      for (int j=0; j < 2; j++) {
+        int d = elems[m]->dof[c][j];
+        if (d >= 0 && vertex_idx[d] < 0) vertex_idx[d] = n_v++;
+      }
+  }
+  this->n_vertex_dof = n_v;
+
+  // elimination of bubbles (elements are independent)
+  std::vector<CondensedElem> ce(n_elem);
+  int singular = 0;
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_threads) reduction(+:singular)
+#endif
+  for (int m=0; m < n_elem; m++) {
+    if (!condense_elem(elems[m], n_eq, Acsc, res, ce[m])) singular++;
+  }
+  if (singular > 0)
+    error("Singular bubble block, static condensation not applicable.");
+
+  // Schur complement: vertex-vertex part of the matrix plus
+  // the element contributions, summed in the element order
+  CooMatrix *S = new CooMatrix(n_v);
+  int *Ap = Acsc->get_Ap();
+  int *Ai = Acsc->get_Ai();
+  double *Ax = Acsc->get_Ax();
+  for (int j=0; j < n_dof; j++) {
+    if (vertex_idx[j] < 0) continue;
+    for (int k=Ap[j]; k < Ap[j+1]; k++)
+      if (vertex_idx[Ai[k]] >= 0 && Ax[k] != 0)
+        S->add(vertex_idx[Ai[k]], vertex_idx[j], Ax[k]);
+  }
+  double *u_v = new double[n_v];
+  for (int i=0; i < n_dof; i++)
+    if (vertex_idx[i] >= 0) u_v[vertex_idx[i]] = res[i];
+  for (int m=0; m < n_elem; m++) {
+    int iidx[2*MAX_EQN_NUM];
+    double *rows[2*MAX_EQN_NUM];
+    for (int i=0; i < ce[m].n_v; i++) {
+      iidx[i] = vertex_idx[ce[m].v[i]];
+      rows[i] = &ce[m].S[i*ce[m].n_v];
+      u_v[iidx[i]] += ce[m].g[i];
+    }
+    S->add_block(iidx, ce[m].n_v, iidx, ce[m].n_v, rows);
+  }
+
+  // solution of the vertex system
+  bool flag = true;
+  if (n_v > 0) {
+    if (vertex_solver) flag = vertex_solver->_solve(S, u_v);
+    else {
+      CommonSolverBandLU band_lu;
+      band_lu.set_quiet(true);
+      flag = band_lu._solve(S, u_v);
+    }
+  }
+  delete S;
+
+  // recovery of bubbles: u_B = y - X u_V
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static) num_threads(this->num_threads)
+#endif
+  for (int m=0; m < n_elem; m++) {
+    int n_v_elem = ce[m].n_v;
+    for (int i=0; i < ce[m].n_b; i++) {
+      double val = ce[m].y[i];
+      for (int j=0; j < n_v_elem; j++)
+        val -= ce[m].X[i*n_v_elem + j] * u_v[vertex_idx[ce[m].v[j]]];
+      res[ce[m].b[i]] = val;
+    }
+  }
+  for (int i=0; i < n_dof; i++)
+    if (vertex_idx[i] >= 0) res[i] = u_v[vertex_idx[i]];
+
+  delete [] u_v;
+  if (Acsc != mat) delete Acsc;
+  return flag;
+}
+
+bool CondensedSolver::_solve(Matrix *mat, cplx *res)
+{
+  _error("CondensedSolver::solve(Matrix *mat, cplx *res) not implemented.");
+}
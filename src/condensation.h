@@ -0,0 +1,48 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#ifndef _CONDENSATION_H_
+#define _CONDENSATION_H_
+
+#include "common.h"
+#include "mesh.h"
+#include "matrix.h"
+#include "solvers.h"
+
+// Static condensation of bubble functions.
+// In 1D, the bubble functions (Lobatto index >= 2) of an element only
+// couple to each other and to the vertex functions of the same element.
+// This solver eliminates them element by element, solves the vertex
+// Schur complement (which is block-tridiagonal, with blocks of size
+// n_eq) via 'vertex_solver', and recovers the bubble coefficients
+// locally. The dof numbering must be the one of mesh->assign_dofs().
+// If 'vertex_solver' is NULL, the banded LU solver is used (the vertex
+// dofs are numbered element by element, so the bandwidth is ~2*n_eq).
+// Note: the bubble block of every element must be nonsingular, this
+// holds for elliptic problems but not, e.g., for a pure first-order
+// operator u' on elements of degree 2.
+class CondensedSolver : public CommonSolver
+{
+public:
+    CondensedSolver(Mesh *mesh, CommonSolver *vertex_solver=NULL);
+
+    bool _solve(Matrix *mat, double *res);
+    bool _solve(Matrix *mat, cplx *res);
+
+    void set_mesh(Mesh *mesh) { this->mesh = mesh; }
+    // The elimination and recovery of bubbles is done in parallel
+    // (hermes1d must be built with OpenMP).
+    void set_num_threads(int num_threads);
+    // Number of vertex dofs in the last condensed system.
+    int get_n_vertex_dof() { return this->n_vertex_dof; }
+
+private:
+    Mesh *mesh;
+    CommonSolver *vertex_solver;
+    int num_threads;
+    int n_vertex_dof;
+};
+
+#endif
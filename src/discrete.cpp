@@ -3,29 +3,31 @@
 // file for the exact terms).
 // Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
 
+#include <algorithm>
+
 #include "matrix.h"
 #include "discrete.h"
 #include "mesh.h"
 
 #include "solvers.h"
+#include "condensation.h"
 
 DiscreteProblem::DiscreteProblem() {
-  // precalculating values and derivatives 
-  // of all polynomials at all possible 
-  // integration points
-  fprintf(stderr, "Precalculating Legendre polynomials...");
-  fflush(stderr);
-  precalculate_legendre_1d();
-  precalculate_legendre_1d_left();
-  precalculate_legendre_1d_right();
-  fprintf(stderr, "done.\n");
-
-  fprintf(stderr, "Precalculating Lobatto shape functions...");
-  fflush(stderr);
-  precalculate_lobatto_1d();
-  precalculate_lobatto_1d_left();
-  precalculate_lobatto_1d_right();
-  fprintf(stderr, "done.\n");
+  this->num_threads = 1;
+
+  // (values and derivatives of Legendre polynomials and Lobatto 
+  // shape functions at the integration points are precalculated 
+  // on first use, see lobatto_ref_tab_init())
+}
+
+void DiscreteProblem::set_num_threads(int num_threads)
+{
+    if (num_threads < 1) error("Invalid number of threads.");
+#ifndef H1D_WITH_OPENMP
+    if (num_threads > 1) 
+      warning("hermes1d was built without OpenMP, assembling in one thread.");
+#endif
+    this->num_threads = num_threads;
 }
 
 void DiscreteProblem::add_matrix_form(int i, int j, matrix_form fn, int marker)
@@ -54,144 +56,294 @@ void DiscreteProblem::add_vector_form_surf(int i, vector_form_surf fn, int bdy_i
     this->vector_forms_surf.push_back(form);
 }
 
-// process volumetric weak forms
-void DiscreteProblem::process_vol_forms(Mesh *mesh, Matrix *mat, double *res, 
-					int matrix_flag) {
-  int n_eq = mesh->get_n_eq();
-  Element *elems = mesh->get_base_elems();
-  int n_elem = mesh->get_n_base_elem();
-  Iterator *I = new Iterator(mesh);
+// Local coefficients of solution 0 on element 'e' given by 'sv' 
+// (see Element::get_solution_quad() for the layout).
+static void get_elem_coeffs(Element *e, SolutionVector *sv, 
+                            double *local_coeffs)
+{
+  int n_fns = e->p + 1;
+  for (int c=0; c < e->n_eq; c++) {
+    int *dof = e->dof[c];
+    double *coeffs = e->coeffs[0][c];
+    double *lc = local_coeffs + c*n_fns;
+    for (int j=0; j < n_fns; j++) {
+      if (dof[j] < 0) lc[j] = coeffs[j];
+      else if (sv->dir == NULL) lc[j] = sv->y[dof[j]];
+      else lc[j] = sv->y[dof[j]] + sv->eps*sv->dir[dof[j]];
+    }
+  }
+}
 
-  Element *e;
-  while ((e = I->next_active_element()) != NULL) {
-    //printf("Processing elem %d\n", m);
-    int    pts_num;                                     // num of quad points
-    double phys_pts[MAX_QUAD_PTS_NUM];                  // quad points
-    double phys_weights[MAX_QUAD_PTS_NUM];              // quad weights
-    double phys_u[MAX_QUAD_PTS_NUM];                    // basis function 
-    double phys_dudx[MAX_QUAD_PTS_NUM];                 // basis function x-derivative
-    double phys_v[MAX_QUAD_PTS_NUM];                    // test function
-    double phys_dvdx[MAX_QUAD_PTS_NUM];                 // test function x-derivative
-    if (n_eq > MAX_EQN_NUM) error("number of equations exceeded in process_vol_forms().");
-    // all previous solutions (all components)
-    double phys_u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM];     
-    // x-derivatives of all previous solutions (all components)
-    double phys_du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM];  
-    // decide quadrature order and set up 
-    // quadrature weights and points in element m
-    // CAUTION: This is heuristic
-    int order = 4*e->p;
-
-    // prepare quadrature points and weights in element 'e'
-    create_phys_element_quadrature(e->x1, e->x2,  
-                               order, phys_pts, phys_weights, &pts_num); 
-
-    // evaluate previous solution and its derivative 
-    // at all quadrature points in the element, 
-    // for every solution component
-    // 0... in the entire element
-    for(int sln=0; sln < e->n_sln; sln++) {
-      e->get_solution_quad(0, order, phys_u_prev[sln], phys_du_prevdx[sln], sln); 
+// Evaluate volumetric weak forms on element 'e'. For every matching
+// matrix form the full (p+1)x(p+1) local block is appended to 'mat_buf'
+// (row by row), for every matching vector form the p+1 local values are
+// appended to 'res_buf'. Entries belonging to inactive (Dirichlet) test 
+// or basis functions are zero. Nothing global is touched here, so this 
+// can be called concurrently on different elements. If 'sv' is not 
+// NULL, solution 0 is given by it.
+void DiscreteProblem::eval_vol_forms_elem(Element *e, int matrix_flag, 
+                                          std::vector<double> &mat_buf, 
+                                          std::vector<double> &res_buf, 
+                                          SolutionVector *sv) {
+  int    pts_num;                                     // num of quad points
+  double phys_pts[MAX_QUAD_PTS_NUM];                  // quad points
+  double phys_weights[MAX_QUAD_PTS_NUM];              // quad weights
+  // values and x-derivatives of all shape functions on 'e'
+  double phys_shape_val[MAX_P+1][MAX_QUAD_PTS_NUM];
+  double phys_shape_der[MAX_P+1][MAX_QUAD_PTS_NUM];
+  // all previous solutions (all components)
+  double phys_u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM];     
+  // x-derivatives of all previous solutions (all components)
+  double phys_du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM];  
+  // decide quadrature order and set up 
+  // quadrature weights and points in element m
+  // CAUTION: This is heuristic
+  int order = 4*e->p;
+  int n_fns = e->p + 1;
+
+  // prepare quadrature points and weights in element 'e'
+  create_phys_element_quadrature(e->x1, e->x2,  
+                             order, phys_pts, phys_weights, &pts_num); 
+
+  // transform all shape functions to element 'e'
+  for(int i=0; i < n_fns; i++) {
+    element_shapefn(e->x1, e->x2, i, order, 
+                    phys_shape_val[i], phys_shape_der[i]); 
+  }
+
+  // evaluate previous solution and its derivative 
+  // at all quadrature points in the element, 
+  // for every solution component
+  // 0... in the entire element
+  double local_coeffs[MAX_EQN_NUM*(MAX_P+1)];
+  if (sv != NULL) get_elem_coeffs(e, sv, local_coeffs);
+  for(int sln=0; sln < e->n_sln; sln++) {
+    e->get_solution_quad(0, order, phys_u_prev[sln], phys_du_prevdx[sln], sln, 
+                         (sln == 0 && sv != NULL) ? local_coeffs : NULL); 
+  }
+
+  // volumetric bilinear forms
+  if(matrix_flag == 0 || matrix_flag == 1) 
+  {
+    for (int ww = 0; ww < this->matrix_forms_vol.size(); ww++)
+    {
+      MatrixFormVol *mfv = &this->matrix_forms_vol[ww];
+      if (e->marker == mfv->marker ||  mfv->marker == ANY) {
+        int *iidx = e->dof[mfv->i]; // matrix rows
+        int *jidx = e->dof[mfv->j]; // matrix columns
+
+        // loop over test functions (rows)
+        for(int i=0; i < n_fns; i++) {
+          // loop over basis functions (columns)
+          for(int j=0; j < n_fns; j++) {
+            // skip inactive test or basis functions
+            if(iidx[i] == -1 || jidx[j] == -1) {
+              mat_buf.push_back(0.0);
+              continue;
+            }
+            // evaluate the bilinear form
+            double val_ij = mfv->fn(pts_num, phys_pts, phys_weights, 
+                      phys_shape_val[j], phys_shape_der[j], 
+                      phys_shape_val[i], phys_shape_der[i],
+                      phys_u_prev, phys_du_prevdx, NULL); 
+            //truncating
+            if (fabs(val_ij) < 1e-12) val_ij = 0.0; 
+            mat_buf.push_back(val_ij);
+          }
+        }
+      }
     }
+  }
 
-    // volumetric bilinear forms
-    if(matrix_flag == 0 || matrix_flag == 1) 
+  // volumetric part of residual
+  if(matrix_flag == 0 || matrix_flag == 2) {
+    for (int ww = 0; ww < this->vector_forms_vol.size(); ww++)
     {
-      for (int ww = 0; ww < this->matrix_forms_vol.size(); ww++)
-      {
-	MatrixFormVol *mfv = &this->matrix_forms_vol[ww];
-	if (e->marker == mfv->marker ||  mfv->marker == ANY) {
-  	  int c_i = mfv->i;  
-	  int c_j = mfv->j;  
-
-	  // loop over test functions (rows)
-	  for(int i=0; i<e->p + 1; i++) {
-	    // if i-th test function is active
-	    int pos_i = e->dof[c_i][i]; // row in matrix
-            //printf("elem (%g, %g): pos_i = %d\n", e->x1, e->x2, pos_i);
-	    if(pos_i != -1) {
-	      // transform i-th test function to element 'm'
-              //printf("Elem (%g, %g): i = %d, order = %d\n", e->x1, e->x2, i, order);
-	      element_shapefn(e->x1, e->x2,  
-			      i, order, phys_v, phys_dvdx); 
-	      // if we are constructing the matrix
-	      if(matrix_flag == 0 || matrix_flag == 1) {
-	        // loop over basis functions (columns)
-	        for(int j=0; j < e->p + 1; j++) {
-		  int pos_j = e->dof[c_j][j]; // matrix column
-                  //printf("elem (%g, %g): pos_j = %d\n", e->x1, e->x2, pos_j);
-		  // if j-th basis function is active
-		  if(pos_j != -1) {
-		    // transform j-th basis function to element 'm'
-		    element_shapefn(e->x1, e->x2,  
-				    j, order, phys_u, phys_dudx); 
-		    // evaluate the bilinear form
-		    double val_ij = mfv->fn(pts_num, phys_pts,
-			      phys_weights, phys_u, phys_dudx, phys_v, phys_dvdx,
-			      phys_u_prev, phys_du_prevdx, NULL); 
-		    //truncating
-		    if (fabs(val_ij) < 1e-12) val_ij = 0.0; 
-		    // add the result to the matrix
-		    if (val_ij != 0) mat->add(pos_i, pos_j, val_ij);
-		    if (DEBUG) {
-		      printf("Adding to matrix pos %d, %d value %g (comp %d, %d)\n", 
-		      pos_i, pos_j, val_ij, c_i, c_j);
-		    }
-	          }
-	        }
-	      }
-	    }
+      VectorFormVol *vfv = &this->vector_forms_vol[ww];
+      if (e->marker == vfv->marker ||  vfv->marker == ANY) {
+        int *iidx = e->dof[vfv->i]; // rows in residual vector
+
+        // loop over test functions (rows)
+        for(int i=0; i < n_fns; i++) {
+          // skip inactive test functions
+          if(iidx[i] == -1) {
+            res_buf.push_back(0.0);
+            continue;
           }
-	}
+          double val_i = vfv->fn(pts_num, phys_pts, phys_weights, 
+                                 phys_u_prev, phys_du_prevdx, 
+                                 phys_shape_val[i], phys_shape_der[i], 
+                                 NULL);
+          // truncating
+          if(fabs(val_i) < 1e-12) val_i = 0.0; 
+          res_buf.push_back(val_i);
+        }
       }
     }
+  }
+}
 
-    // volumetric part of residual
-    if(matrix_flag == 0 || matrix_flag == 2) {
-      for (int ww = 0; ww < this->vector_forms_vol.size(); ww++)
-      {
-        VectorFormVol *vfv = &this->vector_forms_vol[ww];
-	if (e->marker == vfv->marker ||  vfv->marker == ANY) {
-          int c_i = vfv->i;  
-
-          // loop over test functions (rows)
-          for(int i=0; i<e->p + 1; i++) {
-	    // if i-th test function is active
-	    int pos_i = e->dof[c_i][i]; // row in residual vector
-	    if(pos_i != -1) {
-	      // transform i-th test function to element 'm'
-	      element_shapefn(e->x1, e->x2,  
-			      i, order, phys_v, phys_dvdx); 
-	      // contribute to residual vector
-	      if(matrix_flag == 0 || matrix_flag == 2) {
-	        double val_i = vfv->fn(pts_num, phys_pts, phys_weights, 
-				       phys_u_prev, phys_du_prevdx, phys_v,
-				       phys_dvdx, NULL);
-	        // truncating
-	        if(fabs(val_i) < 1e-12) val_i = 0.0; 
-	        // add the contribution to the residual vector
- 	        if (val_i != 0) res[pos_i] += val_i;
-	        if (DEBUG) {
-		  if (val_i != 0) {
-	            printf("Adding to residual pos %d value %g (comp %d)\n", 
-                    pos_i, val_i, c_i);
-                  }
-                }
-              }
-	    }
-	  }
+// Scatter the local blocks of element 'e' produced by eval_vol_forms_elem()
+// into the global matrix and residual vector. 'mat_vals' and 'res_vals' 
+// point to the element's data in the buffers and are advanced past it.
+// Inactive (Dirichlet) rows and columns carry index -1 and are skipped 
+// by add_block(). If 'mat_pos' is not NULL, the matrix has an 
+// AssemblyPattern and the values are written directly to the 
+// precomputed positions in 'pattern_vals'.
+void DiscreteProblem::scatter_vol_forms_elem(Element *e, int matrix_flag, 
+                                             double *&mat_vals, 
+                                             double *&res_vals,
+                                             int *&mat_pos,
+                                             double *pattern_vals,
+                                             Matrix *mat, double *res) {
+  int n_fns = e->p + 1;
+
+  // volumetric bilinear forms
+  if(matrix_flag == 0 || matrix_flag == 1) {
+    for (int ww = 0; ww < this->matrix_forms_vol.size(); ww++)
+    {
+      MatrixFormVol *mfv = &this->matrix_forms_vol[ww];
+      if (e->marker == mfv->marker ||  mfv->marker == ANY) {
+        // rows of the local block
+        double *local_mat[MAX_P+1];
+        for(int i=0; i < n_fns; i++) local_mat[i] = mat_vals + i*n_fns;
+        if (DEBUG) {
+          for(int i=0; i < n_fns; i++) 
+            for(int j=0; j < n_fns; j++) 
+              if (local_mat[i][j] != 0) 
+                printf("Adding to matrix pos %d, %d value %g (comp %d, %d)\n", 
+                e->dof[mfv->i][i], e->dof[mfv->j][j], local_mat[i][j], 
+                mfv->i, mfv->j);
+        }
+        // add the local block to the matrix
+        if (mat_pos != NULL) {
+          for(int k=0; k < n_fns*n_fns; k++) 
+            if (mat_pos[k] != -1) pattern_vals[mat_pos[k]] += mat_vals[k];
+          mat_pos += n_fns*n_fns;
         }
+        else mat->add_block(e->dof[mfv->i], n_fns, e->dof[mfv->j], n_fns, 
+                            local_mat);
+        mat_vals += n_fns*n_fns;
       }
     }
-  } // end while
+  }
 
-  delete I;
+  // volumetric part of residual
+  if(matrix_flag == 0 || matrix_flag == 2) {
+    for (int ww = 0; ww < this->vector_forms_vol.size(); ww++)
+    {
+      VectorFormVol *vfv = &this->vector_forms_vol[ww];
+      if (e->marker == vfv->marker ||  vfv->marker == ANY) {
+        int *iidx = e->dof[vfv->i]; // rows in residual vector
+        for(int i=0; i < n_fns; i++) {
+          if (iidx[i] == -1 || res_vals[i] == 0) continue;
+          res[iidx[i]] += res_vals[i];
+          if (DEBUG) {
+            printf("Adding to residual pos %d value %g (comp %d)\n", 
+                   iidx[i], res_vals[i], vfv->i);
+          }
+        }
+        res_vals += n_fns;
+      }
+    }
+  }
+}
+
+// process volumetric weak forms
+// All p+1 shape functions are evaluated once per element, the local
+// (p+1)x(p+1) block of every matrix form is computed in full and then
+// scattered into the global matrix via a single add_block() call.
+// With more than one thread, the active elements are split into 
+// contiguous chunks which are evaluated concurrently into per-chunk 
+// buffers. The buffers are then scattered chunk by chunk in the element
+// order, so every global entry is summed in exactly the same order as
+// in the serial loop and the result is bitwise identical.
+void DiscreteProblem::process_vol_forms(Mesh *mesh, Matrix *mat, double *res, 
+					int matrix_flag, SolutionVector *sv) {
+  int n_eq = mesh->get_n_eq();
+  if (n_eq > MAX_EQN_NUM) error("number of equations exceeded in process_vol_forms().");
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+
+  // value-only assembly into a matrix with precomputed pattern
+  int *mat_pos = NULL, *mat_pos_end = NULL;
+  double *pattern_vals = NULL;
+  AssemblyPattern *pmat = dynamic_cast<AssemblyPattern*>(mat);
+  if (pmat != NULL && (matrix_flag == 0 || matrix_flag == 1)) {
+    if (!pmat->is_valid(mesh)) 
+      error("Pattern matrix was created for a different mesh or dofs.");
+    if (!pmat->vol_pos.empty()) {
+      mat_pos = &pmat->vol_pos[0];
+      mat_pos_end = mat_pos + pmat->vol_pos.size();
+      pattern_vals = pmat->get_values();
+    }
+  }
+
+  if (this->num_threads <= 1) {
+    // (the buffers are large enough for every element, 
+    // the element loop does not allocate)
+    std::vector<double> mat_buf, res_buf;
+    if (matrix_flag == 0 || matrix_flag == 1) 
+      mat_buf.reserve(this->matrix_forms_vol.size()*(MAX_P+1)*(MAX_P+1));
+    if (matrix_flag == 0 || matrix_flag == 2) 
+      res_buf.reserve(this->vector_forms_vol.size()*(MAX_P+1));
+    for (int m=0; m < n_elem; m++) {
+      Element *e = elems[m];
+      mat_buf.clear();
+      res_buf.clear();
+      eval_vol_forms_elem(e, matrix_flag, mat_buf, res_buf, sv);
+      double *mat_vals = mat_buf.empty() ? NULL : &mat_buf[0];
+      double *res_vals = res_buf.empty() ? NULL : &res_buf[0];
+      if (mat_pos != NULL && mat_pos + mat_buf.size() > mat_pos_end)
+        error("Pattern matrix does not match the matrix forms.");
+      scatter_vol_forms_elem(e, matrix_flag, mat_vals, res_vals, mat_pos, 
+                             pattern_vals, mat, res);
+    }
+    if (mat_pos != mat_pos_end)
+      error("Pattern matrix does not match the matrix forms.");
+    return;
+  }
+
+  // contiguous chunks of elements, one per thread
+  int n_chunks = std::min(this->num_threads, std::max(n_elem, 1));
+  std::vector<std::vector<double> > mat_bufs(n_chunks), res_bufs(n_chunks);
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(n_chunks)
+#endif
+  for (int c=0; c < n_chunks; c++) {
+    int first = (int)((long)n_elem * c / n_chunks);
+    int last = (int)((long)n_elem * (c+1) / n_chunks);
+    for (int m=first; m < last; m++) {
+      eval_vol_forms_elem(elems[m], matrix_flag, mat_bufs[c], res_bufs[c], 
+                          sv);
+    }
+  }
+
+  // deterministic merge in the element order
+  for (int c=0; c < n_chunks; c++) {
+    int first = (int)((long)n_elem * c / n_chunks);
+    int last = (int)((long)n_elem * (c+1) / n_chunks);
+    double *mat_vals = mat_bufs[c].empty() ? NULL : &mat_bufs[c][0];
+    double *res_vals = res_bufs[c].empty() ? NULL : &res_bufs[c][0];
+    if (mat_pos != NULL && mat_pos + mat_bufs[c].size() > mat_pos_end)
+      error("Pattern matrix does not match the matrix forms.");
+    for (int m=first; m < last; m++) {
+      scatter_vol_forms_elem(elems[m], matrix_flag, mat_vals, res_vals, 
+                             mat_pos, pattern_vals, mat, res);
+    }
+    // release the chunk's memory as early as possible
+    std::vector<double>().swap(mat_bufs[c]);
+    std::vector<double>().swap(res_bufs[c]);
+  }
+  if (mat_pos != mat_pos_end)
+    error("Pattern matrix does not match the matrix forms.");
 }
 
 // process boundary weak forms
 void DiscreteProblem::process_surf_forms(Mesh *mesh, Matrix *mat, double *res, 
-					 int matrix_flag, int bdy_index) {
-  Iterator *I = new Iterator(mesh);
+					 int matrix_flag, int bdy_index, 
+                                         SolutionVector *sv) {
+  std::vector<Element*> &elems = mesh->get_active_elems();
   Element *e; 
 
   // evaluate previous solution and its derivative at the end point
@@ -202,19 +354,22 @@ void DiscreteProblem::process_surf_forms(Mesh *mesh, Matrix *mat, double *res,
   // decide whether we are on the left-most or right-most one
   double x_ref, x_phys; 
   if(bdy_index == BOUNDARY_LEFT) {
-    e = I->first_active_element(); 
+    e = elems.front(); 
     x_ref = -1; // left end of reference element
     x_phys = mesh->get_left_endpoint();
   }
   else {
-    e = I->last_active_element(); 
+    e = elems.back(); 
     x_ref = 1;  // right end of reference element
     x_phys = mesh->get_right_endpoint();
   }
 
   // get solution value and derivative at the boundary point
+  double local_coeffs[MAX_EQN_NUM*(MAX_P+1)];
+  if (sv != NULL) get_elem_coeffs(e, sv, local_coeffs);
   for(int sln=0; sln < e->n_sln; sln++) {
-    e->get_solution_point(x_phys, phys_u_prev[sln], phys_du_prevdx[sln], sln); 
+    e->get_solution_point(x_phys, phys_u_prev[sln], phys_du_prevdx[sln], sln, 
+                          (sln == 0 && sv != NULL) ? local_coeffs : NULL); 
   }
 
   // surface bilinear forms
@@ -287,7 +442,122 @@ void DiscreteProblem::process_surf_forms(Mesh *mesh, Matrix *mat, double *res,
       }
     }
   }
-  delete I;
+}
+
+// Symbolic phase of the assembly. The sparsity pattern is given by 
+// the dof arrays of active elements: for every volumetric matrix form 
+// all pairs of active test and basis functions of an element, plus 
+// the same for surface matrix forms on the boundary elements. 
+// pattern[i] are the (block) columns of (block) row i, or the rows of 
+// column i if 'by_columns', sorted and without duplicates.
+void DiscreteProblem::get_matrix_pattern(Mesh *mesh, int block_size, 
+                                         bool by_columns,
+                                         std::vector<std::vector<int> > &pattern) {
+  int n_dof = mesh->get_n_dof();
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+  Element *e;
+
+  pattern.assign((n_dof + block_size - 1) / block_size, std::vector<int>());
+  for (int m=0; m < n_elem; m++) {
+    e = elems[m];
+    int n_fns = e->p + 1;
+    for (int ww = 0; ww < this->matrix_forms_vol.size(); ww++) {
+      MatrixFormVol *mfv = &this->matrix_forms_vol[ww];
+      if (e->marker != mfv->marker && mfv->marker != ANY) continue;
+      for(int j=0; j < n_fns; j++) {
+        int pos_j = e->dof[mfv->j][j];
+        if (pos_j == -1) continue;
+        for(int i=0; i < n_fns; i++) {
+          int pos_i = e->dof[mfv->i][i];
+          if (pos_i == -1) continue;
+          if (by_columns) pattern[pos_j/block_size].push_back(pos_i/block_size);
+          else pattern[pos_i/block_size].push_back(pos_j/block_size);
+        }
+      }
+    }
+  }
+  for (int ww = 0; ww < this->matrix_forms_surf.size(); ww++) {
+    MatrixFormSurf *mfs = &this->matrix_forms_surf[ww];
+    if (mfs->bdy_index == BOUNDARY_LEFT) e = elems[0];
+    else e = elems[n_elem - 1];
+    for(int j=0; j < e->p + 1; j++) {
+      int pos_j = e->dof[mfs->j][j];
+      if (pos_j == -1) continue;
+      for(int i=0; i < e->p + 1; i++) {
+        int pos_i = e->dof[mfs->i][i];
+        if (pos_i == -1) continue;
+        if (by_columns) pattern[pos_j/block_size].push_back(pos_i/block_size);
+        else pattern[pos_i/block_size].push_back(pos_j/block_size);
+      }
+    }
+  }
+  for (int k=0; k < pattern.size(); k++) {
+    std::sort(pattern[k].begin(), pattern[k].end());
+    pattern[k].erase(std::unique(pattern[k].begin(), pattern[k].end()), 
+                     pattern[k].end());
+  }
+}
+
+// Element-to-nonzero scatter map, same traversal as process_vol_forms().
+void DiscreteProblem::set_vol_positions(Mesh *mesh, AssemblyPattern *mat) {
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+  mat->vol_pos.clear();
+  for (int m=0; m < n_elem; m++) {
+    Element *e = elems[m];
+    int n_fns = e->p + 1;
+    for (int ww = 0; ww < this->matrix_forms_vol.size(); ww++) {
+      MatrixFormVol *mfv = &this->matrix_forms_vol[ww];
+      if (e->marker != mfv->marker && mfv->marker != ANY) continue;
+      for(int i=0; i < n_fns; i++) {
+        for(int j=0; j < n_fns; j++) {
+          int pos_i = e->dof[mfv->i][i], pos_j = e->dof[mfv->j][j];
+          if (pos_i == -1 || pos_j == -1) mat->vol_pos.push_back(-1);
+          else mat->vol_pos.push_back(mat->find_position(pos_i, pos_j));
+        }
+      }
+    }
+  }
+}
+
+PatternCSCMatrix *DiscreteProblem::create_csc_matrix(Mesh *mesh) {
+  int n_dof = mesh->get_n_dof();
+
+  // row indices for every column
+  std::vector<std::vector<int> > cols;
+  this->get_matrix_pattern(mesh, 1, true, cols);
+
+  // compress into CSC arrays (row indices sorted within every column)
+  int *Ap = new int[n_dof + 1];
+  Ap[0] = 0;
+  for (int j=0; j < n_dof; j++) Ap[j+1] = Ap[j] + cols[j].size();
+  int nnz = Ap[n_dof];
+  int *Ai = new int[nnz];
+  double *Ax = new double[nnz];
+  for (int j=0; j < n_dof; j++) {
+    for (int k=0; k < cols[j].size(); k++) Ai[Ap[j] + k] = cols[j][k];
+    std::vector<int>().swap(cols[j]);
+  }
+  PatternCSCMatrix *mat = new PatternCSCMatrix(mesh, n_dof, nnz, Ap, Ai, Ax);
+  mat->set_zero();
+  this->set_vol_positions(mesh, mat);
+
+  return mat;
+}
+
+PatternBSRMatrix *DiscreteProblem::create_bsr_matrix(Mesh *mesh, 
+                                                     int block_size) {
+  if (block_size == 0) block_size = mesh->get_n_eq();
+  if (block_size < 1) error("Invalid block size in create_bsr_matrix().");
+
+  // block columns of every block row
+  std::vector<std::vector<int> > block_cols;
+  this->get_matrix_pattern(mesh, block_size, false, block_cols);
+  PatternBSRMatrix *mat = new PatternBSRMatrix(mesh, block_size, block_cols);
+  this->set_vol_positions(mesh, mat);
+
+  return mat;
 }
 
 // construct Jacobi matrix or residual vector
@@ -296,8 +566,10 @@ void DiscreteProblem::process_surf_forms(Mesh *mesh, Matrix *mat, double *res,
 // matrix_flag == 2... assembling residual vector only
 // NOTE: Simultaneous assembling of the Jacobi matrix and residual
 // vector is more efficient than if they are assembled separately
+// If 'sv' is not NULL, the solution is taken from it instead of
+// from the elements.
 void DiscreteProblem::assemble(Mesh *mesh, Matrix *mat, double *res, 
-                               int matrix_flag) {
+                               int matrix_flag, SolutionVector *sv) {
   // number of equations in the system
   int n_eq = mesh->get_n_eq();
 
@@ -309,13 +581,13 @@ void DiscreteProblem::assemble(Mesh *mesh, Matrix *mat, double *res,
     for(int i=0; i<n_dof; i++) res[i] = 0;
 
   // process volumetric weak forms via an element loop
-  process_vol_forms(mesh, mat, res, matrix_flag);
+  process_vol_forms(mesh, mat, res, matrix_flag, sv);
 
   // process surface weak forms for the left boundary
-  process_surf_forms(mesh, mat, res, matrix_flag, BOUNDARY_LEFT);
+  process_surf_forms(mesh, mat, res, matrix_flag, BOUNDARY_LEFT, sv);
 
   // process surface weak forms for the right boundary
-  process_surf_forms(mesh, mat, res, matrix_flag, BOUNDARY_RIGHT);
+  process_surf_forms(mesh, mat, res, matrix_flag, BOUNDARY_RIGHT, sv);
 
   // DEBUG: print Jacobi matrix
   if(DEBUG && (matrix_flag == 0 || matrix_flag == 1)) {
@@ -355,11 +627,27 @@ void DiscreteProblem::assemble_vector(Mesh *mesh, double *res) {
   assemble(mesh, void_mat, res, 2);
 } 
 
+// construct residual vector for the coefficient vector 'y'
+void DiscreteProblem::assemble_residual(Mesh *mesh, double *y, double *res) {
+  SolutionVector sv = {y, NULL, 0};
+  assemble(mesh, NULL, res, 2, &sv);
+} 
+
+// the perturbed residual is assembled into 'J_dot_vec' directly
+void DiscreteProblem::jacobian_dot_vec(Mesh *mesh, double *y, double *f_y, 
+                                       double *vec, double eps, 
+                                       double *J_dot_vec) {
+  SolutionVector sv = {y, vec, eps};
+  assemble(mesh, NULL, J_dot_vec, 2, &sv);
+  int n_dof = mesh->get_n_dof();
+  for (int i=0; i<n_dof; i++) J_dot_vec[i] = (J_dot_vec[i] - f_y[i])/eps;
+} 
+
 // Newton's iteration
 void newton(DiscreteProblem *dp, Mesh *mesh,
             CommonSolver *solver,
             double newton_tol, int newton_maxiter,
-            bool verbose)
+            bool verbose, bool condense)
 {
   int newton_iter_num = 0;
   int n_dof = mesh->get_n_dof();
@@ -373,12 +661,21 @@ void newton(DiscreteProblem *dp, Mesh *mesh,
   // in elements
   copy_mesh_to_vector(mesh, y);
 
+  // Jacobi matrix with fixed sparsity pattern (symbolic phase is done 
+  // only once, the dofs do not change during the Newton's iteration)
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh);
+
+  // static condensation of bubbles
+  CondensedSolver *condensed_solver = NULL;
+  if (condense) {
+    condensed_solver = new CondensedSolver(mesh, solver);
+    solver = condensed_solver;
+  }
+
   // Newton iteration
-  CooMatrix *mat = NULL;
   while (1) {
     // Reset the matrix:
-    if (mat != NULL) delete mat;
-    mat = new CooMatrix();
+    mat->set_zero();
 
     // construct matrix and residual vector
     dp->assemble_matrix_and_vector(mesh, mat, res);
@@ -425,27 +722,89 @@ void newton(DiscreteProblem *dp, Mesh *mesh,
     }
   }
 
+  if (condensed_solver != NULL) delete condensed_solver;
   if (mat != NULL) delete mat;
   if (y != NULL) delete [] y;
   if (res != NULL) delete [] res;
 }
 
-void J_dot_vec_jfnk(DiscreteProblem *dp, Mesh *mesh, double* vec,
-                    double* y_orig, double* f_orig, 
-                    double* J_dot_vec,
-                    double jfnk_epsilon, int n_dof) 
+// Chord (modified Newton) iteration
+void newton_chord(DiscreteProblem *dp, Mesh *mesh,
+                  CommonSolver *solver,
+                  double newton_tol, int newton_maxiter,
+                  double jacobian_ratio, bool verbose)
 {
-  double y_perturbed[MAX_N_DOF];
-  double f_perturbed[MAX_N_DOF];
-  for (int i=0; i<n_dof; i++) {
-    y_perturbed[i] = y_orig[i] + jfnk_epsilon*vec[i];
-  }
-  copy_vector_to_mesh(y_perturbed, mesh);
-  dp->assemble_vector(mesh, f_perturbed); 
-  copy_vector_to_mesh(y_orig, mesh);
-  for (int i=0; i<n_dof; i++) {
-    J_dot_vec[i] = (f_perturbed[i] - f_orig[i])/jfnk_epsilon;
+  int newton_iter_num = 0;
+  int n_factorizations = 0;
+  int n_dof = mesh->get_n_dof();
+  double *y = new double[n_dof];
+  if (y == NULL) error("vector y could not be allocated in newton_chord().");
+  double *res = new double[n_dof];
+  if (res == NULL)
+    error("vector res could not be allocated in newton_chord().");
+
+  CommonSolverBandLU default_solver;
+  if (solver == NULL) solver = &default_solver;
+  if (!solver->is_factorization_supported()) 
+    error("newton_chord() needs a solver with factorize() and backsolve().");
+
+  // fill vector y using dof and coeffs arrays
+  // in elements
+  copy_mesh_to_vector(mesh, y);
+
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh);
+
+  bool update_jacobian = true;
+  double res_norm_prev = -1;
+  while (1) {
+    // construct residual vector
+    dp->assemble_vector(mesh, res);
+
+    // calculate L2 norm of residual vector
+    double res_norm_squared = 0;
+    for(int i=0; i<n_dof; i++) res_norm_squared += res[i]*res[i];
+    double res_norm = sqrt(res_norm_squared);
+
+    // If residual norm less than 'newton_tol', quit
+    // (at least one full iteration forced, see newton())
+    if (verbose) printf("Residual norm: %.15f\n", res_norm);
+    if(res_norm < newton_tol && newton_iter_num > 1) break;
+
+    // slow convergence, the Jacobi matrix is outdated
+    if (res_norm_prev >= 0 && res_norm > jacobian_ratio * res_norm_prev)
+      update_jacobian = true;
+    if (update_jacobian) {
+      mat->set_zero();
+      dp->assemble_matrix(mesh, mat);
+      solver->factorize(mat);
+      n_factorizations++;
+      update_jacobian = false;
+    }
+    res_norm_prev = res_norm;
+
+    // changing sign of vector res
+    for(int i=0; i<n_dof; i++) res[i]*= -1;
+
+    // solving the matrix system with the last factorization
+    solver->backsolve(res);
+
+    // updating vector y by new solution which is in res
+    for(int i=0; i<n_dof; i++) y[i] += res[i];
+
+    // copy coefficients from vector y to elements
+    copy_vector_to_mesh(y, mesh);
+
+    newton_iter_num++;
+    if (newton_iter_num >= newton_maxiter) {
+      error("Newton's iteration did not converge.");
+    }
   }
+  if (verbose) printf("Jacobi matrix factorized %d times in %d iterations\n",
+                      n_factorizations, newton_iter_num);
+
+  if (mat != NULL) delete mat;
+  if (y != NULL) delete [] y;
+  if (res != NULL) delete [] res;
 }
 
 // CG method adjusted for JFNK
@@ -456,42 +815,30 @@ void jfnk_cg(DiscreteProblem *dp, Mesh *mesh,
 {
   int n_dof = mesh->get_n_dof();
   // vectors for JFNK
-  double f_orig[MAX_N_DOF];
-  double y_orig[MAX_N_DOF];
-  double vec[MAX_N_DOF];
-  double rhs[MAX_N_DOF];
+  std::vector<double> f_orig_buf(n_dof), y_orig_buf(n_dof), vec_buf(n_dof), 
+                      rhs_buf(n_dof);
+  double *f_orig = &f_orig_buf[0];
+  double *y_orig = &y_orig_buf[0];
+  double *vec = &vec_buf[0];
+  double *rhs = &rhs_buf[0];
 
   // vectors for the CG method
-  double r[MAX_N_DOF];
-  double p[MAX_N_DOF];
-  double J_dot_vec[MAX_N_DOF];
+  std::vector<double> r_buf(n_dof), p_buf(n_dof), J_dot_vec_buf(n_dof);
+  double *r = &r_buf[0];
+  double *p = &p_buf[0];
+  double *J_dot_vec = &J_dot_vec_buf[0];
 
-  /*
-  // debug
   // fill vector y_orig using dof and coeffs arrays in elements
+  // (the mesh is only updated at the end, the residuals and 
+  // products with the Jacobi matrix are assembled from y_orig)
   copy_mesh_to_vector(mesh, y_orig);
-  dp->assemble_vector(mesh, f_orig); 
-  double *w = new double[n_dof];
-  for(int i=0; i<n_dof; i++) w[i] = 0;
-  w[0] = 1;
-  J_dot_vec_jfnk(dp, mesh, w, y_orig, f_orig, 
-                 J_dot_vec, jfnk_epsilon, n_dof);
-  printf("   J_dot_vec = ");
-  for (int i=0; i < n_dof; i++) {
-    printf("%g ", J_dot_vec[i]);
-  }
-  printf("\n\n");
-  */
 
   // JFNK loop
   int jfnk_iter_num = 1;
   while (1) {
-    // fill vector y_orig using dof and coeffs arrays in elements
-    copy_mesh_to_vector(mesh, y_orig);
-
     // construct residual vector f_orig corresponding to y_orig
     // (f_orig stays unchanged through the entire CG loop)
-    dp->assemble_vector(mesh, f_orig); 
+    dp->assemble_residual(mesh, y_orig, f_orig); 
 
     // calculate L2 norm of f_orig
     double res_norm_squared = 0;
@@ -519,8 +866,7 @@ void jfnk_cg(DiscreteProblem *dp, Mesh *mesh,
     // initializing the solution vector with zero
     for(int i=0; i<n_dof; i++) vec[i] = 0;
     while (1) {
-      J_dot_vec_jfnk(dp, mesh, p, y_orig, f_orig,
-                     J_dot_vec, jfnk_epsilon, n_dof);
+      dp->jacobian_dot_vec(mesh, y_orig, f_orig, p, jfnk_epsilon, J_dot_vec);
       double r_times_r = vec_dot(r, r, n_dof);
       double alpha = r_times_r / vec_dot(p, J_dot_vec, n_dof); 
       for (int i=0; i < n_dof; i++) {
@@ -554,9 +900,6 @@ void jfnk_cg(DiscreteProblem *dp, Mesh *mesh,
     // updating vector y_orig by new solution which is in x
     for(int i=0; i<n_dof; i++) y_orig[i] += vec[i];
 
-    // copying vector y_orig to mesh elements
-    copy_vector_to_mesh(y_orig, mesh);
-
     jfnk_iter_num++;
     if (jfnk_iter_num >= jfnk_maxiter) {
       error("JFNK did not converge.");
@@ -567,3 +910,184 @@ void jfnk_cg(DiscreteProblem *dp, Mesh *mesh,
   copy_vector_to_mesh(y_orig, mesh);
 }
 
+
+// Applies the right preconditioner: z = M^{-1} v (z = v if there is none).
+static void apply_precond(CommonSolver *precond_solver, double *v, double *z, 
+                          int n_dof)
+{
+  memcpy(z, v, sizeof(double)*n_dof);
+  if (precond_solver != NULL) precond_solver->backsolve(z);
+}
+
+// Matrix-free product J*vec, the perturbation has the norm 'jfnk_epsilon'.
+static void jfnk_matvec(DiscreteProblem *dp, Mesh *mesh, double *y, 
+                        double *f, double *vec, double jfnk_epsilon, 
+                        double *J_dot_vec, int n_dof)
+{
+  double vec_norm = sqrt(vec_dot(vec, vec, n_dof));
+  if (vec_norm == 0) {
+    for (int i=0; i<n_dof; i++) J_dot_vec[i] = 0;
+    return;
+  }
+  dp->jacobian_dot_vec(mesh, y, f, vec, jfnk_epsilon/vec_norm, J_dot_vec);
+}
+
+// Right-preconditioned restarted GMRES for J*dy = -f in every JFNK 
+// step (the residuals of the preconditioned and original systems are 
+// the same). The Krylov basis, Hessenberg matrix and Givens rotations 
+// are allocated once.
+int jfnk_gmres(DiscreteProblem *dp, Mesh *mesh, 
+               int gmres_restart, int gmres_maxiter, 
+               double jfnk_epsilon, double jfnk_tol, int jfnk_maxiter, 
+               CommonSolver *precond_solver, int precond_update, 
+               bool verbose)
+{
+  if (gmres_restart < 1 || gmres_maxiter < 1) 
+    error("Invalid GMRES parameters in jfnk_gmres().");
+  if (precond_solver != NULL && !precond_solver->is_factorization_supported())
+    error("jfnk_gmres() needs a preconditioner with factorize() and backsolve().");
+  int n_dof = mesh->get_n_dof();
+  int m = gmres_restart;
+
+  // vectors for JFNK
+  std::vector<double> y_buf(n_dof), f_buf(n_dof), dy_buf(n_dof), 
+                      r_buf(n_dof), z_buf(n_dof);
+  double *y = &y_buf[0];
+  double *f = &f_buf[0];
+  double *dy = &dy_buf[0];
+  double *r = &r_buf[0];
+  double *z = &z_buf[0];
+
+  // Krylov basis, Hessenberg matrix (column by column), Givens rotations
+  // and the right-hand side of the least squares problem
+  std::vector<double> V((m + 1)*n_dof), H((m + 1)*m), cs(m), sn(m), g(m + 1);
+
+  // Jacobi matrix for the preconditioner
+  PatternCSCMatrix *mat = NULL;
+  if (precond_solver != NULL) mat = dp->create_csc_matrix(mesh);
+  int n_factorizations = 0;
+
+  // Eisenstat-Walker forcing terms (choice 2)
+  const double eta_max = 0.9, ew_gamma = 0.9, ew_alpha = 2;
+  double eta = eta_max;
+
+  // the mesh is only updated at the end
+  copy_mesh_to_vector(mesh, y);
+
+  int jfnk_iter_num = 0, gmres_iter_total = 0;
+  double res_norm_prev = -1;
+  while (1) {
+    // residual vector and its norm
+    dp->assemble_residual(mesh, y, f);
+    double res_norm = sqrt(vec_dot(f, f, n_dof));
+    if (verbose) printf("Residual norm: %.15f\n", res_norm);
+    if (res_norm < jfnk_tol) break;
+    if (jfnk_iter_num >= jfnk_maxiter) error("JFNK did not converge.");
+    if (verbose) printf("JFNK iteration: %d\n", jfnk_iter_num + 1);
+
+    // forcing term, safeguarded against too small values when the 
+    // previous one was large, and against oversolving near 'jfnk_tol'
+    if (res_norm_prev > 0) {
+      double eta_new = ew_gamma*pow(res_norm/res_norm_prev, ew_alpha);
+      double eta_safe = ew_gamma*pow(eta, ew_alpha);
+      if (eta_safe > 0.1) eta_new = std::max(eta_new, eta_safe);
+      eta = std::min(eta_new, eta_max);
+    }
+    eta = std::max(eta, 0.5*jfnk_tol/res_norm);
+
+    // (re)factorize the Jacobi matrix at 'y'
+    if (mat != NULL && (n_factorizations == 0 || 
+        (precond_update > 0 && jfnk_iter_num % precond_update == 0))) {
+      SolutionVector sv = {y, NULL, 0};
+      mat->set_zero();
+      dp->assemble(mesh, mat, NULL, 1, &sv);
+      precond_solver->factorize(mat);
+      n_factorizations++;
+    }
+
+    // restarted GMRES with zero initial guess
+    for (int i=0; i<n_dof; i++) dy[i] = 0;
+    double lin_res_norm = res_norm;
+    int gmres_iter = 0;
+    while (lin_res_norm > eta*res_norm && gmres_iter < gmres_maxiter) {
+      // r = -f - J*dy
+      if (gmres_iter == 0) {
+        for (int i=0; i<n_dof; i++) r[i] = -f[i];
+      }
+      else {
+        jfnk_matvec(dp, mesh, y, f, dy, jfnk_epsilon, r, n_dof);
+        for (int i=0; i<n_dof; i++) r[i] = -f[i] - r[i];
+      }
+      double beta = sqrt(vec_dot(r, r, n_dof));
+      if (beta == 0) break;
+      for (int i=0; i<n_dof; i++) V[i] = r[i]/beta;
+      for (int k=1; k <= m; k++) g[k] = 0;
+      g[0] = beta;
+
+      // Arnoldi process with modified Gram-Schmidt
+      int k = 0;
+      while (k < m && gmres_iter < gmres_maxiter) {
+        double *v_k = &V[k*n_dof], *w = &V[(k + 1)*n_dof];
+        double *h = &H[k*(m + 1)];
+        apply_precond(precond_solver, v_k, z, n_dof);
+        jfnk_matvec(dp, mesh, y, f, z, jfnk_epsilon, w, n_dof);
+        for (int i=0; i <= k; i++) {
+          h[i] = vec_dot(w, &V[i*n_dof], n_dof);
+          for (int l=0; l<n_dof; l++) w[l] -= h[i]*V[i*n_dof + l];
+        }
+        h[k + 1] = sqrt(vec_dot(w, w, n_dof));
+        if (h[k + 1] != 0) 
+          for (int l=0; l<n_dof; l++) w[l] /= h[k + 1];
+
+        // apply the previous rotations and eliminate h[k+1]
+        for (int i=0; i < k; i++) {
+          double tmp = cs[i]*h[i] + sn[i]*h[i + 1];
+          h[i + 1] = -sn[i]*h[i] + cs[i]*h[i + 1];
+          h[i] = tmp;
+        }
+        double denom = sqrt(h[k]*h[k] + h[k + 1]*h[k + 1]);
+        cs[k] = (denom == 0) ? 1 : h[k]/denom;
+        sn[k] = (denom == 0) ? 0 : h[k + 1]/denom;
+        h[k] = denom;
+        h[k + 1] = 0;
+        g[k + 1] = -sn[k]*g[k];
+        g[k] = cs[k]*g[k];
+
+        k++;
+        gmres_iter++;
+        lin_res_norm = fabs(g[k]);
+        if (lin_res_norm <= eta*res_norm || denom == 0) break;
+      }
+
+      // solve the triangular system and update dy += M^{-1} V*coeffs
+      for (int i=k-1; i >= 0; i--) {
+        double val = g[i];
+        for (int l=i+1; l < k; l++) val -= H[l*(m + 1) + i]*g[l];
+        g[i] = (H[i*(m + 1) + i] == 0) ? 0 : val/H[i*(m + 1) + i];
+      }
+      for (int l=0; l<n_dof; l++) r[l] = 0;
+      for (int i=0; i < k; i++) 
+        for (int l=0; l<n_dof; l++) r[l] += g[i]*V[i*n_dof + l];
+      apply_precond(precond_solver, r, z, n_dof);
+      for (int l=0; l<n_dof; l++) dy[l] += z[l];
+    }
+    gmres_iter_total += gmres_iter;
+    if (verbose) printf("GMRES (JFNK) made %d iteration(s) (relative "
+                        "residual %g, forcing term %g)\n", gmres_iter, 
+                        lin_res_norm/res_norm, eta);
+
+    // updating vector y by the Newton's step
+    for (int i=0; i<n_dof; i++) y[i] += dy[i];
+    res_norm_prev = res_norm;
+    jfnk_iter_num++;
+  }
+  if (verbose && mat != NULL) 
+    printf("Jacobi matrix factorized %d times in %d iterations\n",
+           n_factorizations, jfnk_iter_num);
+
+  // copy the solution to the mesh
+  copy_vector_to_mesh(y, mesh);
+
+  if (mat != NULL) delete mat;
+  return gmres_iter_total;
+}
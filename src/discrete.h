@@ -34,6 +34,87 @@ typedef double (*vector_form_surf) (double x, double u_prev[MAX_SLN_NUM][MAX_EQN
         double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], double v, double dvdx,
         void *user_data);
 
+// Element-to-nonzero scatter map of a matrix whose sparsity pattern is 
+// fixed by the element dof arrays of 'mesh' (symbolic phase, see 
+// DiscreteProblem::create_csc_matrix() and create_bsr_matrix()), so 
+// that repeated assembly on the same mesh only writes values into 
+// precomputed positions. The matrix has to be created again whenever 
+// the dofs of the mesh are reassigned (assign_dofs()).
+class AssemblyPattern {
+public:
+    virtual ~AssemblyPattern() {}
+    // index of entry (m, n) in get_values(), -1 if it is not in 
+    // the pattern
+    virtual int find_position(int m, int n) = 0;
+    virtual double *get_values() = 0;
+    // false if the mesh was refined or its dofs were renumbered 
+    // since the pattern was created (even if n_dof stayed the same)
+    bool is_valid(Mesh *mesh) 
+    {
+        return this->mesh == mesh && this->n_dof == mesh->get_n_dof() &&
+               this->tree_version == mesh->get_tree_version() &&
+               this->dof_version == mesh->get_dof_version();
+    }
+
+    Mesh *mesh;
+    int n_dof;
+    unsigned tree_version; // mesh->get_tree_version() at the creation
+    unsigned dof_version;  // mesh->get_dof_version() at the creation
+    // positions in get_values() for all entries of all local blocks 
+    // of volumetric matrix forms, in the order of assembly (-1 for 
+    // inactive test or basis functions)
+    std::vector<int> vol_pos;
+
+protected:
+    void set_mesh(Mesh *mesh) 
+    {
+        this->mesh = mesh;
+        this->n_dof = mesh->get_n_dof();
+        this->tree_version = mesh->get_tree_version();
+        this->dof_version = mesh->get_dof_version();
+    }
+};
+
+// CSC matrix with an assembly pattern.
+class PatternCSCMatrix : public CSCMatrix, public AssemblyPattern {
+public:
+    PatternCSCMatrix(Mesh *mesh, int size, int nnz, int *Ap, int *Ai, 
+                     double *Ax) : CSCMatrix(size, nnz, Ap, Ai, Ax) 
+    {
+        this->set_mesh(mesh);
+    }
+    int find_position(int m, int n) 
+    {
+        return CSCMatrix::find_position(m, n);
+    }
+    double *get_values() { return this->get_Ax(); }
+};
+
+// BSR matrix with an assembly pattern.
+class PatternBSRMatrix : public BSRMatrix, public AssemblyPattern {
+public:
+    PatternBSRMatrix(Mesh *mesh, int block_size, 
+                     const std::vector<std::vector<int> > &block_cols) 
+        : BSRMatrix(mesh->get_n_dof(), block_size, block_cols)
+    {
+        this->set_mesh(mesh);
+    }
+    int find_position(int m, int n) 
+    {
+        return BSRMatrix::find_position(m, n);
+    }
+    double *get_values() { return this->get_Bx(); }
+};
+
+// Coefficients of solution 0 given by a global vector y + eps*dir 
+// instead of the coeffs arrays of the elements ('dir' can be NULL). 
+// Coefficients of Dirichlet dofs are still taken from the elements.
+struct SolutionVector {
+    double *y;
+    double *dir;
+    double eps;
+};
+
 class DiscreteProblem {
 
 public:
@@ -42,18 +123,56 @@ public:
     void add_vector_form(int i, vector_form fn, int marker=ANY);
     void add_matrix_form_surf(int i, int j, matrix_form_surf fn, int bdy_index);
     void add_vector_form_surf(int i, vector_form_surf fn, int bdy_index);
+    // Number of threads used in the volumetric element loop. Values
+    // larger than 1 require the library to be built WITH_OPENMP and
+    // all volumetric forms to be thread-safe. Default is 1.
+    void set_num_threads(int num_threads);
+    int get_num_threads() { return this->num_threads; }
     // c is solution component
     void process_vol_forms(Mesh *mesh, Matrix *mat, double *res, 
-                           int matrix_flag);
+                           int matrix_flag, SolutionVector *sv=NULL);
     // c is solution component
     void process_surf_forms(Mesh *mesh, Matrix *mat, double *res, 
-                            int matrix_flag, int bdy_index);
-    void assemble(Mesh *mesh, Matrix *mat, double *res, int matrix_flag);
+                            int matrix_flag, int bdy_index, 
+                            SolutionVector *sv=NULL);
+    void assemble(Mesh *mesh, Matrix *mat, double *res, int matrix_flag, 
+                  SolutionVector *sv=NULL);
     void assemble_matrix_and_vector(Mesh *mesh, Matrix *mat, double *res); 
     void assemble_matrix(Mesh *mesh, Matrix *mat);
     void assemble_vector(Mesh *mesh, double *res);
+    // Residual vector for the coefficient vector 'y' (see 
+    // copy_mesh_to_vector()), the elements of 'mesh' are not changed.
+    void assemble_residual(Mesh *mesh, double *y, double *res);
+    // Matrix-free product of the Jacobi matrix at 'y' with 'vec' by 
+    // the forward difference J_dot_vec = (F(y + eps*vec) - F(y))/eps, 
+    // where 'f_y' is the residual F(y). The perturbed coefficients are 
+    // formed element by element during one assembly of the residual, 
+    // 'y' and the mesh are not changed.
+    void jacobian_dot_vec(Mesh *mesh, double *y, double *f_y, double *vec, 
+                          double eps, double *J_dot_vec);
+    // Symbolic phase: returns a zero Jacobi matrix with the sparsity 
+    // pattern of all matrix forms on 'mesh'. Reassembling into it (after 
+    // set_zero()) does not allocate and needs no format conversion.
+    PatternCSCMatrix *create_csc_matrix(Mesh *mesh);
+    // The same as a BSR matrix with blocks of 'block_size' x 'block_size' 
+    // (the number of equations if 0). The blocks are dense for systems 
+    // when the dofs are ordered by elements (DOF_ORDERING_ELEMENTS).
+    PatternBSRMatrix *create_bsr_matrix(Mesh *mesh, int block_size=0);
 
 private:
+    void eval_vol_forms_elem(Element *e, int matrix_flag, 
+                             std::vector<double> &mat_buf, 
+                             std::vector<double> &res_buf, 
+                             SolutionVector *sv);
+    void scatter_vol_forms_elem(Element *e, int matrix_flag, 
+                                double *&mat_vals, double *&res_vals,
+                                int *&mat_pos, double *pattern_vals,
+                                Matrix *mat, double *res);
+    void get_matrix_pattern(Mesh *mesh, int block_size, bool by_columns,
+                            std::vector<std::vector<int> > &pattern);
+    void set_vol_positions(Mesh *mesh, AssemblyPattern *mat);
+    int num_threads;
+
 	struct MatrixFormVol {
 		int i, j;
 		matrix_form fn;
@@ -91,15 +210,47 @@ void element_shapefn(double a, double b,
 void element_shapefn_point(double x_ref, double a, double b, 
 			   int k, double &val, double &der);
 
+// If 'condense' is true, the bubble dofs are eliminated element by
+// element in every Newton step and 'solver' (if any) is only used for 
+// the vertex system (see CondensedSolver).
 void newton(DiscreteProblem *dp, Mesh *mesh, 
             CommonSolver *solver,
             double newton_tol, int newton_maxiter,
-            bool verbose=true);
+            bool verbose=true, bool condense=false);
+
+// Chord (modified Newton) method: the Jacobi matrix is assembled and 
+// factorized only in the first iteration and when the residual norm 
+// decreases slowly, i.e., ||F(y_k)|| > jacobian_ratio * ||F(y_{k-1})||. 
+// Otherwise the last factorization is reused. 'solver' must support 
+// factorize()/backsolve(), if NULL then CommonSolverBandLU is used
+// (see also Mesh::set_dof_ordering()). 
+void newton_chord(DiscreteProblem *dp, Mesh *mesh, 
+                  CommonSolver *solver,
+                  double newton_tol, int newton_maxiter,
+                  double jacobian_ratio=0.5, bool verbose=true);
 
 void jfnk_cg(DiscreteProblem *dp, Mesh *mesh,
              double matrix_solver_tol, int matrix_solver_maxiter,  
 	     double jfnk_epsilon, double jfnk_tol, int jfnk_maxiter, bool verbose=true);
 
+// JFNK with restarted GMRES(gmres_restart), also for nonsymmetric 
+// Jacobi matrices. The Jacobi matrix is applied matrix-free (see 
+// DiscreteProblem::jacobian_dot_vec(), the perturbations have the norm 
+// 'jfnk_epsilon'), at most 'gmres_maxiter' GMRES iterations are made 
+// in every JFNK step. The GMRES tolerances (relative to the residual 
+// norm) are the Eisenstat-Walker forcing terms, so the linear systems 
+// are solved accurately only close to the solution. If 'precond_solver' 
+// is not NULL, the Jacobi matrix is assembled and factorized by it 
+// (it must support factorize() and backsolve()) and used as a right 
+// preconditioner. The factorization is updated every 'precond_update' 
+// JFNK steps (0... only in the first one). Returns the total number 
+// of GMRES iterations.
+int jfnk_gmres(DiscreteProblem *dp, Mesh *mesh, 
+               int gmres_restart, int gmres_maxiter, 
+               double jfnk_epsilon, double jfnk_tol, int jfnk_maxiter, 
+               CommonSolver *precond_solver=NULL, int precond_update=1, 
+               bool verbose=true);
+
 
 
 #endif
@@ -0,0 +1,107 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#include "ftr.h"
+#include "adapt.h"
+#include "solvers.h"
+
+#include <algorithm>
+
+FTRSolver::FTRSolver(DiscreteProblem *dp, int norm)
+{
+  this->dp = dp;
+  this->norm = norm;
+  this->patch_size = 1;
+  this->num_threads = 1;
+  this->newton_tol = 1e-8;
+  this->newton_maxiter = 150;
+}
+
+void FTRSolver::set_patch_size(int patch_size)
+{
+  if (patch_size < 0) error("Invalid patch size in FTRSolver.");
+  this->patch_size = patch_size;
+}
+
+void FTRSolver::set_num_threads(int num_threads)
+{
+  if (num_threads < 1) error("Invalid number of threads.");
+#ifndef H1D_WITH_OPENMP
+  if (num_threads > 1)
+    warning("hermes1d was built without OpenMP, solving FTR in one thread.");
+#endif
+  this->num_threads = num_threads;
+}
+
+void FTRSolver::set_newton(double newton_tol, int newton_maxiter)
+{
+  this->newton_tol = newton_tol;
+  this->newton_maxiter = newton_maxiter;
+}
+
+// FTR of element 'id' of 'mesh', returns the FTR error.
+double FTRSolver::solve_elem(Mesh *mesh, int id, ElemPtr2 ref_elem_pair)
+{
+  int n_elem = mesh->get_n_active_elem();
+  int first = std::max(id - this->patch_size, 0);
+  int last = std::min(id + this->patch_size + 1, n_elem);
+
+  // coarse patch and the patch with element 'id' refined (the dofs of
+  // the small system are ordered by elements for the band LU solver)
+  Mesh *patch = mesh->extract_patch(first, last - first);
+  Mesh *patch_ref = mesh->extract_patch(first, last - first);
+  patch_ref->set_dof_ordering(DOF_ORDERING_ELEMENTS);
+  patch_ref->reference_refinement(id - first, 1);
+
+  // Newton's loop on the refined patch
+  CommonSolverBandLU solver;
+  solver.set_quiet(true);
+  newton(this->dp, patch_ref, &solver, this->newton_tol,
+         this->newton_maxiter, false);
+
+  // norm of the difference between the coarse and FTR solutions
+  std::vector<double> err_array;
+  double err = calc_error_estimate(this->norm, patch, patch_ref, err_array);
+
+  // copy the reference elements of element 'id'
+  std::vector<Element*> &elems_ref = patch_ref->get_active_elems();
+  int i_ref = id - first;
+  for (int i=0; i < 2; i++) {
+    elems_ref[i_ref + i]->copy_into(ref_elem_pair[i]);
+    ref_elem_pair[i]->id = id;
+  }
+
+  delete patch;
+  delete patch_ref;
+  return err;
+}
+
+double FTRSolver::solve(Mesh *mesh, std::vector<double> &elem_errors,
+                        ElemPtr2 *ref_elem_pairs)
+{
+  // (the list of active elements is only built here,
+  // the threads below just read it)
+  int n_elem = mesh->get_active_elems().size();
+  if (n_elem != mesh->get_n_active_elem())
+    error("Number of active elements mismatched in FTRSolver::solve().");
+  mesh->assign_elem_ids();
+  elem_errors.resize(n_elem);
+  for (int i=0; i < n_elem; i++) {
+    for (int j=0; j < 2; j++)
+      if (ref_elem_pairs[i][j] == NULL) ref_elem_pairs[i][j] = new Element();
+  }
+
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(this->num_threads)
+#endif
+  for (int i=0; i < n_elem; i++) {
+    elem_errors[i] = this->solve_elem(mesh, i, ref_elem_pairs[i]);
+  }
+
+  double max_error = 0;
+  for (int i=0; i < n_elem; i++)
+    max_error = std::max(max_error, elem_errors[i]);
+  return max_error;
+}
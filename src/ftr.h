@@ -0,0 +1,58 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#ifndef _FTR_H_
+#define _FTR_H_
+
+#include <vector>
+
+#include "common.h"
+#include "mesh.h"
+#include "discrete.h"
+
+// Fast trial refinements (FTR): instead of one reference solution on
+// the globally refined mesh, every active element of the coarse mesh
+// is refined alone (see Mesh::reference_refinement()) and a small
+// local problem is solved by the Newton's method on the patch of the
+// refined element and 'patch_size' coarse elements on each side. At
+// the end points of the patch inside of the domain, all solution
+// components are fixed to the coarse mesh solution (see
+// Mesh::extract_patch()). The patches are independent, they are
+// solved in parallel (hermes1d must be built with OpenMP), so the
+// forms of 'dp' must be thread-safe when more threads are used.
+class FTRSolver
+{
+public:
+    FTRSolver(DiscreteProblem *dp, int norm=1);
+
+    // Number of coarse elements on each side of the refined element
+    // (default 1).
+    void set_patch_size(int patch_size);
+    void set_num_threads(int num_threads);
+    void set_newton(double newton_tol, int newton_maxiter);
+
+    // Performs the FTR of all active elements of 'mesh' (with the
+    // coarse mesh solution on it). 'elem_errors[i]' is the L2 or H1
+    // norm of the difference between the FTR and coarse solutions on
+    // the patch of element 'i', and copies of the reference elements
+    // of element 'i' are stored in 'ref_elem_pairs[i]' (NULL entries
+    // are allocated, the caller deletes them). 'ref_elem_pairs' must
+    // have at least as many entries as there are active elements.
+    // Returns the largest FTR error.
+    double solve(Mesh *mesh, std::vector<double> &elem_errors,
+                 ElemPtr2 *ref_elem_pairs);
+
+private:
+    double solve_elem(Mesh *mesh, int id, ElemPtr2 ref_elem_pair);
+
+    DiscreteProblem *dp;
+    int norm;
+    int patch_size;
+    int num_threads;
+    double newton_tol;
+    int newton_maxiter;
+};
+
+#endif
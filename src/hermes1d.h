@@ -20,6 +20,8 @@
 #include "legendre.h"
 #include "lobatto.h"
 #include "discrete.h"
+#include "condensation.h"
+#include "ftr.h"
 #include "solution.h"
 #include "linearizer.h"
 #include "transforms.h"
@@ -5,12 +5,13 @@
 
 #include "legendre.h"
 
-double legendre_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double legendre_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double legendre_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double legendre_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double legendre_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double legendre_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+H1D_ALIGN(64) double legendre_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double legendre_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double legendre_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double legendre_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double legendre_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double legendre_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+int legendre_ref_tab_ready[MAX_QUAD_ORDER];
 
 int legendre_order_1d[] = {
 0,
@@ -110,25 +111,26 @@ void legendre_val_phys_quad(int flag, int quad_order, int fns_num,
 { 
   double norm_const = sqrt(2/(b-a));
   int pts_num = g_quad_1d_std.get_num_points(quad_order);
+  legendre_ref_tab_init(quad_order);
   if (flag == 0) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_val[j][m] = norm_const*legendre_val_ref_tab[quad_order][j][m];
       }
     }
   }
   if (flag == -1) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_val[j][m] = norm_const*legendre_val_ref_tab_left[quad_order][j][m];
       }
     }
   }
   if (flag == 1) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_val[j][m] = norm_const*legendre_val_ref_tab_right[quad_order][j][m];
       }
@@ -156,25 +158,26 @@ void legendre_der_phys_quad(int flag, int quad_order, int fns_num,
   double norm_const = sqrt(2/(b-a));
   norm_const *= 2./(b-a); // to account for interval stretching/shortening
   int pts_num = g_quad_1d_std.get_num_points(quad_order);
+  legendre_ref_tab_init(quad_order);
   if (flag == 0) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_der[j][m] = norm_const*legendre_der_ref_tab[quad_order][j][m];
       }
     }
   }
   if (flag == -1) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_der[j][m] = norm_const*legendre_der_ref_tab_left[quad_order][j][m];
       }
     }
   }
   if (flag == 1) {
-    for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
-      for(int j=0; j<pts_num; j++) {  
+    for(int j=0; j<pts_num; j++) {  
+      for(int m=0; m < fns_num; m++) { // loop over transf. Leg. polynomials
         //leg_pol_val_left[j][m] = norm_const*legendre_val_ref(inverse_map(a, b, x), i);
         leg_pol_der[j][m] = 
             norm_const*legendre_der_ref_tab_right[quad_order][j][m];
@@ -183,76 +186,49 @@ void legendre_der_phys_quad(int flag, int quad_order, int fns_num,
   }
 }
 
-// Legendre polynomials in (-1, 1)
-void precalculate_legendre_1d() 
+// fills the tables for the quadrature order 'quad_order' (whole 
+// interval (-1, 1) and its halves (-1, 0), (0, 1))
+static void precalculate_legendre_1d_order(int quad_order) 
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        legendre_val_ref_tab[quad_order][point_id][poly_deg] = 0;
-        legendre_der_ref_tab[quad_order][point_id][poly_deg] = 0;
-      }
-    }
+  int pts_num = g_quad_1d_std.get_num_points(quad_order);
+  double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
+  for (int point_id=0; point_id < pts_num; point_id++) {
+    double x_ref = ref_tab[point_id][0];
+    fill_legendre_array_ref(x_ref, 
+              legendre_val_ref_tab[quad_order][point_id],
+              legendre_der_ref_tab[quad_order][point_id]);
+    // half-polynomials in (-1, 0)
+    fill_legendre_array_ref((x_ref - 1.) / 2., 
+              legendre_val_ref_tab_left[quad_order][point_id],
+              legendre_der_ref_tab_left[quad_order][point_id]);
+    // half-polynomials in (0, 1)
+    fill_legendre_array_ref((x_ref + 1.) / 2., 
+              legendre_val_ref_tab_right[quad_order][point_id],
+              legendre_der_ref_tab_right[quad_order][point_id]);
   }
+}
 
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
-    for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = ref_tab[point_id][0];
-      fill_legendre_array_ref(x_ref, legendre_val_ref_tab[quad_order][point_id],
-                          legendre_der_ref_tab[quad_order][point_id]);
-    }
-  }
+void legendre_ref_tab_init_order(int quad_order)
+{
+  if (quad_order < 0 || quad_order >= MAX_QUAD_ORDER) 
+    error("Quadrature order out of range in legendre_ref_tab_init().");
+  init_once_locked(legendre_ref_tab_ready + quad_order, 
+                   precalculate_legendre_1d_order, quad_order);
 }
 
-// half polynomials in (-1, 0)
-void precalculate_legendre_1d_left() 
+// all quadrature orders
+void precalculate_legendre_1d() 
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        legendre_val_ref_tab_left[quad_order][point_id][poly_deg] = 0;
-        legendre_der_ref_tab_left[quad_order][point_id][poly_deg] = 0;
-      }
-    }
-  }
+  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) 
+    legendre_ref_tab_init(quad_order);
+}
 
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
-    for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = (ref_tab[point_id][0] - 1.) / 2.; // transf to (-1, 0)
-      fill_legendre_array_ref(x_ref, 
-                legendre_val_ref_tab_left[quad_order][point_id],
-                legendre_der_ref_tab_left[quad_order][point_id]);
-    }
-  }
+void precalculate_legendre_1d_left() 
+{
+  precalculate_legendre_1d();
 }
 
-// half polynomials in (0, 1)
 void precalculate_legendre_1d_right() 
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        legendre_val_ref_tab_right[quad_order][point_id][poly_deg] = 0;
-        legendre_der_ref_tab_right[quad_order][point_id][poly_deg] = 0;
-      }
-    }
-  }
-
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
-    for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = (ref_tab[point_id][0] + 1.) / 2.; // transf to (0, 1)
-      fill_legendre_array_ref(x_ref, 
-            legendre_val_ref_tab_right[quad_order][point_id],
-            legendre_der_ref_tab_right[quad_order][point_id]);
-    }
-  }
+  precalculate_legendre_1d();
 }
@@ -21,14 +21,28 @@ extern double legendre_der_ref(double x, int n);
 // Poly orders of Legendre polynomials
 extern int legendre_order_1d[];
 
+// The tables below are filled on first use, for every quadrature order
+// separately and once per process. legendre_ref_tab_init(quad_order) must 
+// be called before the tables are accessed for 'quad_order' (it is 
+// cheap and thread-safe). The precalculate_legendre_1d*() functions fill 
+// the tables for all orders.
+extern int legendre_ref_tab_ready[MAX_QUAD_ORDER];
+void legendre_ref_tab_init_order(int quad_order);
+inline void legendre_ref_tab_init(int quad_order)
+{
+  if (quad_order < 0 || quad_order >= MAX_QUAD_ORDER || 
+      !init_done(legendre_ref_tab_ready + quad_order))
+    legendre_ref_tab_init_order(quad_order);
+}
+
 // Precalculated values of Legendre polynomials and their derivatives 
 // at all Gauss quadrature rules on the reference
 // interval (-1, 1). The first index runs through Gauss quadrature 
 // orders. The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
-// Lobatto polynomials at that point. 
-extern double legendre_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double legendre_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+// Lobatto polynomials at that point. The rows are 64-byte aligned.
+extern double legendre_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double legendre_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_legendre_1d();
 
 // Precalculated values of Legendre polynomials and their derivatives 
@@ -38,8 +52,8 @@ extern void precalculate_legendre_1d();
 // orders. The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
 // Lobatto polynomials at that point. 
-extern double legendre_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double legendre_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+extern double legendre_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double legendre_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_legendre_1d_left();
 
 // Precalculated values of Legendre polynomials and their derivatives 
@@ -49,8 +63,8 @@ extern void precalculate_legendre_1d_left();
 // orders. The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
 // Lobatto polynomials at that point. 
-extern double legendre_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double legendre_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+extern double legendre_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double legendre_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_legendre_1d_right();
 
 // transforms point 'x_phys' from element (x1, x2) to (-1, 1)
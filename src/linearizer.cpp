@@ -5,7 +5,6 @@
 
 #include "mesh.h"
 #include "linearizer.h"
-#include "iterator.h"
 
 // Evaluate (vector-valued) approximate solution at reference 
 // point 'x_ref' in element 'm'. Here 'y' is the global vector 
@@ -14,11 +13,12 @@ void Linearizer::eval_approx(int sln, Element *e, double x_ref,
                              double *x_phys, double *val) 
 {
   int n_eq = this->mesh->get_n_eq();
+  double shape_val[MAX_P + 1], shape_der[MAX_P + 1];
+  fill_lobatto_array_ref(x_ref, shape_val, shape_der, e->p);
   for(int c=0; c<n_eq; c++) { // loop over solution components
     val[c] = 0;
     for(int i=0; i <= e->p; i++) { // loop over shape functions
-      if(e->dof[c][i] >= 0) val[c] += 
-                  e->coeffs[sln][c][i]*lobatto_val_ref(x_ref, i);
+      if(e->dof[c][i] >= 0) val[c] += e->coeffs[sln][c][i]*shape_val[i];
     }
   }
   double a = e->x1;
@@ -121,8 +121,8 @@ void Linearizer::get_xy_mesh(int comp,
                         double **x, double **y, int *n)
 {
     int n_eq = this->mesh->get_n_eq();
-    int n_active_elem = this->mesh->get_n_active_elem();
-    Iterator *I = new Iterator(this->mesh);
+    std::vector<Element*> &elems = this->mesh->get_active_elems();
+    int n_active_elem = elems.size();
 
     *n = n_active_elem * (plotting_elem_subdivision+1);
     double *x_out = new double[*n];
@@ -139,16 +139,8 @@ void Linearizer::get_xy_mesh(int comp,
     double phys_u_prev[MAX_EQN_NUM][MAX_PLOT_PTS_NUM];
     double phys_du_prevdx[MAX_EQN_NUM][MAX_PLOT_PTS_NUM];
         
-    Element *e;
-    int counter = 0;
-    while ((e = I->next_active_element()) != NULL) {
-        //printf("linearizer: in element (%g, %g)\n", e->x1, e->x2);
-        if (counter >= n_active_elem) {
-	  printf("n_active_elem = %d\n", n_active_elem);
-	  printf("counter = %d\n", counter);
-            error("Internal error: wrong n_active_elem");
-        }
-
+    for (int counter=0; counter < n_active_elem; counter++) {
+        Element *e = elems[counter];
         double x_phys[MAX_PLOT_PTS_NUM];
         double h = (e->x2 - e->x1)/plotting_elem_subdivision;
 
@@ -163,11 +155,9 @@ void Linearizer::get_xy_mesh(int comp,
             y_out[counter*(plotting_elem_subdivision+1) + j] =
                 phys_u_prev[comp][j];
         }
-        counter++;
     }
     *x = x_out;
     *y = y_out;
-    delete I;
 }
 
 void Linearizer::get_xy_ref_array(int comp, ElemPtr2* ref_elem_pairs,
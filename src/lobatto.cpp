@@ -6,12 +6,15 @@
 #include "lobatto.h"
 #include "legendre.h"
 
-double lobatto_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double lobatto_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double lobatto_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double lobatto_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double lobatto_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-double lobatto_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+H1D_ALIGN(64) double lobatto_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+H1D_ALIGN(64) double lobatto_val_ref_tab_fn[MAX_QUAD_ORDER][MAX_P + 1][MAX_QUAD_PTS_PAD];
+H1D_ALIGN(64) double lobatto_der_ref_tab_fn[MAX_QUAD_ORDER][MAX_P + 1][MAX_QUAD_PTS_PAD];
+int lobatto_ref_tab_ready[MAX_QUAD_ORDER];
 
 int lobatto_order_1d[] = {
 1,
@@ -43,18 +46,20 @@ static double lobatto_der_1(double x) {
     return 1.0/2.0;
 }
 
-// Fills an array of length MAX_P + 1 with Lobatto shape 
+// Fills an array of length p + 1 with Lobatto shape 
 // functions (integrated normalized Legendre polynomials) 
 // at point 'x'. 
 extern void fill_lobatto_array_ref(double x, 
                                    double lobatto_array_val[MAX_P+1],
-                                   double lobatto_array_der[MAX_P+1]) {
+                                   double lobatto_array_der[MAX_P+1], 
+                                   int p) {
+    if (p > MAX_P) error("Max poly degree exceeded in fill_lobatto_array_ref().");
     double legendre_array[MAX_P + 1];
     // calculating (non-normalized) Legendre polynomials
     legendre_array[0] = 1.;
     legendre_array[1] = x;
-    for (int i=1; i < MAX_P; i++) {
-      legendre_array[i+1]  = (2*i+1)*x*legendre_array[i] // last index is MAX_P
+    for (int i=1; i < p; i++) {
+      legendre_array[i+1]  = (2*i+1)*x*legendre_array[i] // last index is p
                              - i*legendre_array[i-1]; 
       legendre_array[i+1] /= i+1; 
     }
@@ -65,8 +70,8 @@ extern void fill_lobatto_array_ref(double x,
     lobatto_array_der[1] = lobatto_der_1(x);
     // then fill the quadratic and higher which actually are 
     // the integrated Legendre polynomials
-    for (int i=1; i < MAX_P; i++) {
-      lobatto_array_val[i+1] =                           // last index is MAX_P
+    for (int i=1; i < p; i++) {
+      lobatto_array_val[i+1] =                           // last index is p
         (legendre_array[i+1] - legendre_array[i-1]) / (2.*i + 1.);
       lobatto_array_val[i+1] /= leg_norm_const_ref(i);
       lobatto_array_der[i+1] = legendre_array[i]; 
@@ -74,97 +79,78 @@ extern void fill_lobatto_array_ref(double x,
     }
 }
 
-// FIXME - this function is inefficient, it fills the
-// whole array
+// NOTE - use fill_lobatto_array_ref() when more functions 
+// are needed at the same point
 extern double lobatto_val_ref(double x, int n) 
 {
     double val_array[MAX_P + 1];
     double der_array[MAX_P + 1];
-    fill_lobatto_array_ref(x, val_array, der_array);
-    //printf("val_array[%d] = %g\n", n, val_array[n]);
+    fill_lobatto_array_ref(x, val_array, der_array, n);
     return val_array[n];
 }
 
-// FIXME - this function is inefficient, it fills the
-// whole array
+// NOTE - use fill_lobatto_array_ref() when more functions 
+// are needed at the same point
 extern double lobatto_der_ref(double x, int n) 
 {
     double val_array[MAX_P + 1];
     double der_array[MAX_P + 1];
-    fill_lobatto_array_ref(x, val_array, der_array);
+    fill_lobatto_array_ref(x, val_array, der_array, n);
     return der_array[n];
 }
 
-// integrated Legendre polynomials in (-1, 1)
-void precalculate_lobatto_1d() 
+// fills the tables for the quadrature order 'quad_order' (whole 
+// interval (-1, 1) and its halves (-1, 0), (0, 1))
+static void precalculate_lobatto_1d_order(int quad_order) 
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        lobatto_val_ref_tab[quad_order][point_id][poly_deg] = 0;
-      }
-    }
+  int pts_num = g_quad_1d_std.get_num_points(quad_order);
+  double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
+  for (int point_id=0; point_id < pts_num; point_id++) {
+    double x_ref = ref_tab[point_id][0];
+    fill_lobatto_array_ref(x_ref, 
+              lobatto_val_ref_tab[quad_order][point_id],
+              lobatto_der_ref_tab[quad_order][point_id]);
+    // half-polynomials in (-1, 0)
+    fill_lobatto_array_ref((x_ref - 1.) / 2., 
+              lobatto_val_ref_tab_left[quad_order][point_id],
+              lobatto_der_ref_tab_left[quad_order][point_id]);
+    // half-polynomials in (0, 1)
+    fill_lobatto_array_ref((x_ref + 1.) / 2., 
+              lobatto_val_ref_tab_right[quad_order][point_id],
+              lobatto_der_ref_tab_right[quad_order][point_id]);
   }
-
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
+  // function-major copy
+  for (int k=0; k <= MAX_P; k++) {
     for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = ref_tab[point_id][0];
-      fill_lobatto_array_ref(x_ref, lobatto_val_ref_tab[quad_order][point_id],
-                             lobatto_der_ref_tab[quad_order][point_id]);
+      lobatto_val_ref_tab_fn[quad_order][k][point_id] = 
+        lobatto_val_ref_tab[quad_order][point_id][k];
+      lobatto_der_ref_tab_fn[quad_order][k][point_id] = 
+        lobatto_der_ref_tab[quad_order][point_id][k];
     }
   }
 }
 
-// half-polynomials in (-1, 0)
-void precalculate_lobatto_1d_left() 
+void lobatto_ref_tab_init_order(int quad_order)
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        lobatto_val_ref_tab_left[quad_order][point_id][poly_deg] = 0;
-        lobatto_der_ref_tab_left[quad_order][point_id][poly_deg] = 0;
-      }
-    }
-  }
-
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
-    for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = (ref_tab[point_id][0] - 1.) / 2.;  // transf to (-1, 0)
-      fill_lobatto_array_ref(x_ref, 
-            lobatto_val_ref_tab_left[quad_order][point_id],
-            lobatto_der_ref_tab_left[quad_order][point_id]);
-    }
-  }
+  if (quad_order < 0 || quad_order >= MAX_QUAD_ORDER) 
+    error("Quadrature order out of range in lobatto_ref_tab_init().");
+  init_once_locked(lobatto_ref_tab_ready + quad_order, 
+                   precalculate_lobatto_1d_order, quad_order);
 }
 
-// half-polynomials in (0, 1)
-void precalculate_lobatto_1d_right() 
+// all quadrature orders
+void precalculate_lobatto_1d() 
 {
-  // erasing
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    for (int point_id=0; point_id < MAX_QUAD_PTS_NUM; point_id++) {
-      for (int poly_deg=0; poly_deg < MAX_P + 1; poly_deg++) {
-        lobatto_val_ref_tab_right[quad_order][point_id][poly_deg] = 0;
-        lobatto_der_ref_tab_right[quad_order][point_id][poly_deg] = 0;
-      }
-    }
-  }
+  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) 
+    lobatto_ref_tab_init(quad_order);
+}
 
-  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
-    int pts_num = g_quad_1d_std.get_num_points(quad_order);
-    double2 *ref_tab = g_quad_1d_std.get_points(quad_order);
-    for (int point_id=0; point_id < pts_num; point_id++) {
-      double x_ref = (ref_tab[point_id][0] + 1.) / 2.;  // transf to (0, 1)
-      fill_lobatto_array_ref(x_ref, 
-              lobatto_val_ref_tab_right[quad_order][point_id],
-              lobatto_der_ref_tab_right[quad_order][point_id]);
-    }
-  }
+void precalculate_lobatto_1d_left() 
+{
+  precalculate_lobatto_1d();
 }
 
+void precalculate_lobatto_1d_right() 
+{
+  precalculate_lobatto_1d();
+}
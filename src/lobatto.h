@@ -10,25 +10,49 @@
 
 #include "common.h"
 
+// Fills the values and derivatives of the Lobatto shape functions 
+// of degrees 0, 1, ..., max(p, 1) at point 'x' in (-1, 1).
 void fill_lobatto_array_ref(double x, 
 			double lobatto_array_val[MAX_P+1],
-			double lobatto_array_der[MAX_P+1]);
+			double lobatto_array_der[MAX_P+1], int p=MAX_P);
 double lobatto_val_ref(double x, int n);
 double lobatto_der_ref(double x, int n);
 
 // Poly orders of Lobatto functions
 extern int lobatto_order_1d[];
 
+// The tables below are filled on first use, for every quadrature order
+// separately and once per process. lobatto_ref_tab_init(quad_order) must 
+// be called before the tables are accessed for 'quad_order' (it is 
+// cheap and thread-safe). The precalculate_lobatto_1d*() functions fill 
+// the tables for all orders.
+extern int lobatto_ref_tab_ready[MAX_QUAD_ORDER];
+void lobatto_ref_tab_init_order(int quad_order);
+inline void lobatto_ref_tab_init(int quad_order)
+{
+  if (quad_order < 0 || quad_order >= MAX_QUAD_ORDER || 
+      !init_done(lobatto_ref_tab_ready + quad_order))
+    lobatto_ref_tab_init_order(quad_order);
+}
+
 // Precalculated values of Lobatto polynomials and their derivatives 
 // at all Gauss quadrature rules on the reference interval (-1, 1). 
 // The first index runs through Gauss quadrature 
 // orders. The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
-// Legendre polynomials at that point. 
-extern double lobatto_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double lobatto_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+// Legendre polynomials at that point. The rows are 64-byte aligned,
+// use these tables when all functions are needed at a point.
+extern double lobatto_val_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double lobatto_der_ref_tab[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_lobatto_1d();
 
+// The same values with the last two indices swapped: the second index 
+// runs through the Lobatto functions and the third through the 
+// quadrature points. Use these tables when one function is needed 
+// at all points (filled together with the tables above). 
+extern double lobatto_val_ref_tab_fn[MAX_QUAD_ORDER][MAX_P + 1][MAX_QUAD_PTS_PAD];
+extern double lobatto_der_ref_tab_fn[MAX_QUAD_ORDER][MAX_P + 1][MAX_QUAD_PTS_PAD];
+
 // The first index runs through Gauss quadrature 
 // Precalculated values of Lobatto polynomials and their derivatives 
 // defined in (-1, 1) at all Gauss quadrature rules which are 
@@ -36,8 +60,8 @@ extern void precalculate_lobatto_1d();
 // The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
 // Legendre polynomials at that point. 
-extern double lobatto_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double lobatto_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+extern double lobatto_val_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double lobatto_der_ref_tab_left[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_lobatto_1d_left();
 
 // Precalculated values of Lobatto polynomials and their derivatives 
@@ -47,8 +71,8 @@ extern void precalculate_lobatto_1d_left();
 // orders. The second index runs through the quadrature points of 
 // the corresponding rule, and the third through the values of 
 // Legendre polynomials at that point. 
-extern double lobatto_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
-extern double lobatto_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P + 1];
+extern double lobatto_val_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
+extern double lobatto_der_ref_tab_right[MAX_QUAD_ORDER][MAX_QUAD_PTS_NUM][MAX_P_PAD];
 extern void precalculate_lobatto_1d_right();
 
 #endif /* SHAPESET_LOBATTO_H_ */
@@ -9,21 +9,84 @@
 #include "transforms.h"
 #include "linearizer.h"
 
+#include <new>
+#include <string.h>
+#include <algorithm>
+
 // debug - prints element dof arrays in assign_dofs()
 int DEBUG_ELEM_DOF = 0;
 
+ElemArena::ElemArena()
+{
+  this->chunk_used = this->chunk_size = this->size = 0;
+  this->tree_version = 0;
+}
+
+void *ElemArena::alloc(size_t size)
+{
+  // all blocks are aligned to 8 bytes
+  size = (size + 7) / 8 * 8;
+  std::map<size_t, std::vector<void*> >::iterator it = 
+    this->free_blocks.find(size);
+  if (it != this->free_blocks.end() && !it->second.empty()) {
+    void *ptr = it->second.back();
+    it->second.pop_back();
+    memset(ptr, 0, size);
+    return ptr;
+  }
+  if (this->chunk_used + size > this->chunk_size) {
+    // new chunk (the rest of the last one is not used)
+    const size_t min_chunk_size = 1 << 20;
+    this->chunk_size = std::max(size, min_chunk_size);
+    char *chunk = new char[this->chunk_size];
+    if (chunk == NULL) error("Not enough memory in ElemArena::alloc().");
+    memset(chunk, 0, this->chunk_size);
+    this->chunks.push_back(chunk);
+    this->chunk_used = 0;
+    this->size += this->chunk_size;
+  }
+  void *ptr = this->chunks.back() + this->chunk_used;
+  this->chunk_used += size;
+  return ptr;
+}
+
+void ElemArena::release(void *ptr, size_t size)
+{
+  if (ptr == NULL) return;
+  size = (size + 7) / 8 * 8;
+  this->free_blocks[size].push_back(ptr);
+}
+
+Element *ElemArena::new_elements(int n)
+{
+  Element *elems = (Element *)this->alloc(n * sizeof(Element));
+  for (int i=0; i < n; i++) {
+    new (elems + i) Element();
+    elems[i].arena = this;
+  }
+  return elems;
+}
+
+// Elements in the arena own no other memory, so there is 
+// no need to call their destructors.
+void ElemArena::free_all()
+{
+  for (unsigned i=0; i < this->chunks.size(); i++) delete [] this->chunks[i];
+  this->chunks.clear();
+  this->free_blocks.clear();
+  this->chunk_used = this->chunk_size = this->size = 0;
+  this->tree_changed();
+}
+
 Element::Element() 
 {
   x1 = x2 = 0;
   p = 0; 
-  for (int j=0; j < MAX_EQN_NUM; j++) {
-    for (int k=0; k < MAX_P + 1; k++) {
-      dof[j][k] = 0;
-      for (int sln=0; sln < MAX_SLN_NUM; sln++) {
-        coeffs[sln][j][k] = 0;
-      }
-    }
-  }
+  dof.data = NULL;
+  dof.n = 0;
+  coeffs.data = NULL;
+  coeffs.n = coeffs.n_eq = 0;
+  arena = NULL;
   sons[0] = sons[1] = NULL; 
   active = 1;
   level = 0;
@@ -31,21 +94,91 @@ Element::Element()
   id = -1;
   n_eq = 0;
   n_sln = 0;
+  dof_p = -1;
 }
 
 Element::Element(double x_left, double x_right, int level, int deg, int n_eq, int n_sln, int marker) 
 {
-  x1 = x_left;
-  x2 = x_right;
-  p = deg; 
-  this->n_eq = n_eq;
-  this->n_sln = n_sln;
-  if (dof == NULL) error("Not enough memory in Element().");
+  dof.data = NULL;
+  dof.n = 0;
+  coeffs.data = NULL;
+  coeffs.n = coeffs.n_eq = 0;
+  arena = NULL;
+  this->n_eq = this->n_sln = 0;
+  this->init(x_left, x_right, deg, -1, 1, level, n_eq, n_sln, marker);
   sons[0] = sons[1] = NULL; 
-  active = 1;
-  this->level = level;
-  this->marker = marker;
-  id = -1;
+}
+
+// size of the coeffs and dof arrays with rows of length 'n'
+size_t Element::get_arrays_size(int n)
+{
+  return (size_t)this->n_sln * this->n_eq * n * sizeof(double) +
+         (size_t)this->n_eq * n * sizeof(int);
+}
+
+// (re)allocates the coeffs and dof arrays with rows of length 'n', 
+// the coeffs array comes first in the block
+void Element::alloc_arrays(int n)
+{
+  size_t size = this->get_arrays_size(n);
+  double *data;
+  if (this->arena != NULL) data = (double *)this->arena->alloc(size);
+  else {
+    data = new double[(size + sizeof(double) - 1) / sizeof(double)];
+    if (data == NULL) error("Not enough memory in Element::alloc_arrays().");
+    memset(data, 0, size);
+  }
+  int *dof_data = (int *)(data + this->n_sln * this->n_eq * n);
+  // keep the entries of the old arrays
+  if (this->coeffs.data != NULL) {
+    int n_copy = std::min(n, this->dof.n);
+    for (int c=0; c < this->n_eq; c++) {
+      memcpy(dof_data + c*n, this->dof[c], n_copy * sizeof(int));
+      for (int sln=0; sln < this->n_sln; sln++) 
+        memcpy(data + (sln*this->n_eq + c)*n, this->coeffs[sln][c], 
+               n_copy * sizeof(double));
+    }
+  }
+  this->free_arrays();
+  this->coeffs.data = data;
+  this->coeffs.n = n;
+  this->coeffs.n_eq = this->n_eq;
+  this->dof.data = dof_data;
+  this->dof.n = n;
+}
+
+void Element::free_arrays()
+{
+  if (this->coeffs.data == NULL) return;
+  if (this->arena != NULL) 
+    this->arena->release(this->coeffs.data, this->get_arrays_size(this->dof.n));
+  else delete [] this->coeffs.data;
+  this->coeffs.data = NULL;
+  this->dof.data = NULL;
+  this->coeffs.n = this->dof.n = 0;
+}
+
+void Element::resize(int p)
+{
+  this->p = p;
+  // the vertex entries are always there
+  int n = std::max(p + 1, 2);
+  if (this->coeffs.data == NULL || n > this->dof.n) this->alloc_arrays(n);
+}
+
+// new sons are taken from the arena of the element
+void Element::alloc_sons()
+{
+  if (this->arena != NULL) {
+    Element *sons = this->arena->new_elements(2);
+    this->sons[0] = sons;
+    this->sons[1] = sons + 1;
+    this->arena->tree_changed();
+  }
+  else {
+    this->sons[0] = new Element();
+    this->sons[1] = new Element();
+  }
 }
 
 unsigned Element::is_active() 
@@ -62,15 +195,17 @@ unsigned Element::is_active()
 void Element::refine(int type, int p_left, int p_right) 
 {
   if(type == 0) {         // p-refinement
-    this->p = p_left;
+    this->resize(p_left);
   }
   else {
     double x1 = this->x1;
     double x2 = this->x2;
     double midpoint = (x1 + x2)/2.; 
-    this->sons[0] = new Element(x1, midpoint, this->level + 1, p_left, this->n_eq, this->n_sln, this->marker);
-    this->sons[1] = new Element(midpoint, x2, this->level + 1, 
-                                p_right, this->n_eq, this->n_sln, this->marker);
+    this->alloc_sons();
+    this->sons[0]->init(x1, midpoint, p_left, -1, 1, this->level + 1, 
+                        this->n_eq, this->n_sln, this->marker);
+    this->sons[1]->init(midpoint, x2, p_right, -1, 1, this->level + 1, 
+                        this->n_eq, this->n_sln, this->marker);
     // Copy Dirichtel boundary conditions to sons
     for(int c=0; c<this->n_eq; c++) {
       if (this->dof[c][0] < 0) {
@@ -99,6 +234,26 @@ void Element::refine(int3 cand)
   this->refine(cand[0], cand[1], cand[2]);
 }
 
+void Element::unrefine()
+{
+  if (this->sons[0] == NULL) return;
+  if (!this->sons[0]->active || !this->sons[1]->active) 
+    error("Sons are not active in Element::unrefine().");
+  if (this->arena != NULL) {
+    // the sons were allocated together (see alloc_sons())
+    this->sons[0]->free_arrays();
+    this->sons[1]->free_arrays();
+    this->arena->release(this->sons[0], 2*sizeof(Element));
+    this->arena->tree_changed();
+  }
+  else {
+    delete this->sons[0];
+    delete this->sons[1];
+  }
+  this->sons[0] = this->sons[1] = NULL;
+  this->active = 1;
+}
+
 // initialize element and allocate dof and coeffs 
 // arrays for all solution components
 void Element::init(double x1, double x2, int p_init, 
@@ -106,13 +261,15 @@ void Element::init(double x1, double x2, int p_init,
 {
   this->x1 = x1;
   this->x2 = x2;
-  this->p = p_init;
   this->id = id;
   this->active = active;
   this->level = level;
   this->marker = marker;
+  if (n_eq != this->n_eq || n_sln != this->n_sln) this->free_arrays();
   this->n_eq = n_eq;
   this->n_sln = n_sln;
+  this->dof_p = -1;
+  this->resize(p_init);
 }
 
 // Copies coefficients from the solution vector into element.
@@ -154,7 +311,8 @@ void Element::copy_dofs(int sln_src, int sln_trg)
 // of order 'quad_order' in the element.
 void Element::get_solution_quad(int flag, int quad_order, 
                                 double val_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
-				double der_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], int sln)
+				double der_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], int sln,
+                                double *local_coeffs)
 {
   double phys_x[MAX_QUAD_PTS_NUM];          // quad points
   double phys_w[MAX_QUAD_PTS_NUM];          // quad weights
@@ -166,41 +324,36 @@ void Element::get_solution_quad(int flag, int quad_order,
   double jac = (this->x2 - this->x1)/2.; // Jacobian of reference map
   int p = this->p;
   double x_ref[MAX_QUAD_PTS_NUM];
-  // filling the values and derivatives
+  lobatto_ref_tab_init(quad_order);
+  // tables of all Lobatto functions at the integration points
+  double (*val_tab)[MAX_P_PAD], (*der_tab)[MAX_P_PAD];
   if (flag == 0) { // integration points in the whole element
-    for(int c=0; c<this->n_eq; c++) { 
-      for (int i=0 ; i < pts_num; i++) {
-        der_phys[c][i] = val_phys[c][i] = 0;
-        for(int j=0; j<=p; j++) {
-          val_phys[c][i] += this->coeffs[sln][c][j]*lobatto_val_ref_tab[quad_order][i][j];
-          der_phys[c][i] += this->coeffs[sln][c][j]*lobatto_der_ref_tab[quad_order][i][j];
-        }
-        der_phys[c][i] /= jac;
-      }
-    }
+    val_tab = lobatto_val_ref_tab[quad_order];
+    der_tab = lobatto_der_ref_tab[quad_order];
   }
-  if (flag == -1) { // integration points in the left half of element
-    for(int c=0; c<this->n_eq; c++) { 
-      for (int i=0 ; i < pts_num; i++) {
-        der_phys[c][i] = val_phys[c][i] = 0;
-        for(int j=0; j<=p; j++) {
-          val_phys[c][i] += this->coeffs[sln][c][j]*lobatto_val_ref_tab_left[quad_order][i][j];
-          der_phys[c][i] += this->coeffs[sln][c][j]*lobatto_der_ref_tab_left[quad_order][i][j];
-        }
-        der_phys[c][i] /= jac;
-      }
-    }
+  else if (flag == -1) { // integration points in the left half of element
+    val_tab = lobatto_val_ref_tab_left[quad_order];
+    der_tab = lobatto_der_ref_tab_left[quad_order];
   }
-  if (flag == 1) { // integration points in the right half of element
-    for(int c=0; c<this->n_eq; c++) { 
-      for (int i=0 ; i < pts_num; i++) {
-        der_phys[c][i] = val_phys[c][i] = 0;
-        for(int j=0; j<=p; j++) {
-          val_phys[c][i] += this->coeffs[sln][c][j]*lobatto_val_ref_tab_right[quad_order][i][j];
-          der_phys[c][i] += this->coeffs[sln][c][j]*lobatto_der_ref_tab_right[quad_order][i][j];
-        }
-        der_phys[c][i] /= jac;
+  else if (flag == 1) { // integration points in the right half of element
+    val_tab = lobatto_val_ref_tab_right[quad_order];
+    der_tab = lobatto_der_ref_tab_right[quad_order];
+  }
+  else error("Invalid flag in get_solution_quad().");
+  // filling the values and derivatives (the rows of the 
+  // tables are contiguous in the loop over 'j')
+  for(int c=0; c<this->n_eq; c++) { 
+    double *coeffs = (local_coeffs != NULL) ? local_coeffs + c*(p+1) : 
+                                              this->coeffs[sln][c];
+    for (int i=0 ; i < pts_num; i++) {
+      double *val_i = val_tab[i], *der_i = der_tab[i];
+      double val = 0, der = 0;
+      for(int j=0; j<=p; j++) {
+        val += coeffs[j]*val_i[j];
+        der += coeffs[j]*der_i[j];
       }
+      val_phys[c][i] = val;
+      der_phys[c][i] = der/jac;
     }
   }
 } 
@@ -219,12 +372,14 @@ void Element::get_solution_plot(double x_phys[MAX_PLOT_PTS_NUM], int pts_num,
   // transforming points to (-1, 1)
   for (int i=0 ; i < pts_num; i++) x_ref[i] = inverse_map(x1, x2, x_phys[i]);
   // filling the values and derivatives
-  for(int c=0; c<this->n_eq; c++) { 
-    for (int i=0 ; i < pts_num; i++) {
+  for (int i=0 ; i < pts_num; i++) {
+    double shape_val[MAX_P + 1], shape_der[MAX_P + 1];
+    fill_lobatto_array_ref(x_ref[i], shape_val, shape_der, p);
+    for(int c=0; c<this->n_eq; c++) { 
       der_phys[c][i] = val_phys[c][i] = 0;
       for(int j=0; j<=p; j++) {
-        val_phys[c][i] += this->coeffs[sln][c][j]*lobatto_val_ref(x_ref[i], j);
-        der_phys[c][i] += this->coeffs[sln][c][j]*lobatto_der_ref(x_ref[i], j);
+        val_phys[c][i] += this->coeffs[sln][c][j]*shape_val[j];
+        der_phys[c][i] += this->coeffs[sln][c][j]*shape_der[j];
       }
       der_phys[c][i] /= jac;
     }
@@ -271,7 +426,8 @@ double Element::calc_elem_norm_squared(int norm)
 // Evaluate solution and its derivative at point x_phys.
 void Element::get_solution_point(double x_phys, 
                                  double val[MAX_EQN_NUM], 
-                                 double der[MAX_EQN_NUM], int sln)
+                                 double der[MAX_EQN_NUM], int sln,
+                                 double *local_coeffs)
 {
   double x1 = this->x1;
   double x2 = this->x2;
@@ -279,11 +435,15 @@ void Element::get_solution_point(double x_phys,
   int p = this->p;
   // transforming point x_phys to (-1, 1)
   double x_ref = inverse_map(x1, x2, x_phys);
+  double shape_val[MAX_P + 1], shape_der[MAX_P + 1];
+  fill_lobatto_array_ref(x_ref, shape_val, shape_der, p);
   for(int c=0; c < this->n_eq; c++) {
+    double *coeffs = (local_coeffs != NULL) ? local_coeffs + c*(p+1) : 
+                                              this->coeffs[sln][c];
     der[c] = val[c] = 0;
     for(int j=0; j<=p; j++) {
-      val[c] += this->coeffs[sln][c][j]*lobatto_val_ref(x_ref, j);
-      der[c] += this->coeffs[sln][c][j]*lobatto_der_ref(x_ref, j);
+      val[c] += coeffs[j]*shape_val[j];
+      der[c] += coeffs[j]*shape_der[j];
     }
     der[c] /= jac;
   }
@@ -296,10 +456,11 @@ void Element::copy_into(Element *e_trg)
   // copy all variables of Element class
   e_trg->init(this->x1, this->x2, this->p, this->id, 
               this->active, this->level, this->n_eq, this->n_sln, this->marker);
+  e_trg->dof_p = this->dof_p;
 
   // copy dof arrays for all solution components
   for(int c=0; c < this->n_eq; c++) {
-    for(int i=0; i < MAX_P + 1; i++) {
+    for(int i=0; i < this->p + 1; i++) {
       e_trg->dof[c][i] = this->dof[c][i];
       for(int sln=0; sln < this->n_sln; sln++) {
         e_trg->coeffs[sln][c][i] = this->coeffs[sln][c][i];
@@ -317,8 +478,7 @@ void Element::copy_recursively_into(Element *e_trg)
 
   // replicate sons if relevant
   if(this->sons[0] != NULL) {          // element was split in space (sons will be replicated)
-    e_trg->sons[0] = new Element();
-    e_trg->sons[1] = new Element();
+    e_trg->alloc_sons();
     // left son
     this->sons[0]->copy_recursively_into(e_trg->sons[0]);
     // right son
@@ -338,13 +498,48 @@ double Element::get_x_phys(double x_ref)
   return (a+b)/2. + x_ref*(b-a)/2.;
 }
 
+ElemPairArray::~ElemPairArray()
+{
+  for (int i=0; i < this->size; i++) {
+    delete this->pairs[i][0];
+    delete this->pairs[i][1];
+  }
+  delete [] this->pairs;
+}
+
+void ElemPairArray::resize(int n)
+{
+  if (n <= this->size) return;
+  // (grow geometrically, the mesh usually grows step by step)
+  int size_new = std::max(n, 2*this->size);
+  ElemPtr2 *pairs_new = new ElemPtr2[size_new];
+  for (int i=0; i < size_new; i++) {
+    if (i < this->size) {
+      pairs_new[i][0] = this->pairs[i][0];
+      pairs_new[i][1] = this->pairs[i][1];
+    }
+    else {
+      pairs_new[i][0] = new Element();
+      pairs_new[i][1] = new Element();
+    }
+  }
+  delete [] this->pairs;
+  this->pairs = pairs_new;
+  this->size = size_new;
+}
+
 Mesh::Mesh() {
   n_eq = 0;
   n_sln = 0;
   n_base_elem = 0;
   n_active_elem = 0;
   n_dof = 0;
+  dof_ordering = DOF_ORDERING_COMPONENTS;
   base_elems = NULL;
+  active_elems_valid = false;
+  journal_on = false;
+  dofs_valid = false;
+  dof_version = 0;
 }
 
 // Creates equidistant mesh with uniform polynomial degree of elements.
@@ -368,10 +563,14 @@ Mesh::Mesh(double a, double b, int n_base_elem, int p_init, int n_eq, int
   this->n_eq = n_eq;
   this->n_sln = n_sln;
   this->n_active_elem = n_base_elem;
+  this->dof_ordering = DOF_ORDERING_COMPONENTS;
 
   // allocate element array
-  this->base_elems = new Element[this->n_base_elem];     
-  if (base_elems == NULL) error("Not enough memory in Mesh::create().");
+  this->base_elems = this->arena.new_elements(this->n_base_elem);
+  this->active_elems_valid = false;
+  this->journal_on = false;
+  this->dofs_valid = false;
+  this->dof_version = 0;
   if (p_init > MAX_P) 
     error("Max element order exceeded (set in common.h).");
   // element length
@@ -424,10 +623,14 @@ Mesh::Mesh(int n_macro_elem, double *pts_array, int *p_array, int *m_array, int
   this->n_eq = n_eq;
   this->n_sln = n_sln;
   this->n_active_elem = n_base_elem;
+  this->dof_ordering = DOF_ORDERING_COMPONENTS;
 
   // allocate base element array
-  this->base_elems = new Element[this->n_base_elem];     
-  if (base_elems == NULL) error("Not enough memory for base element array in Mesh::create().");
+  this->base_elems = this->arena.new_elements(this->n_base_elem);
+  this->active_elems_valid = false;
+  this->journal_on = false;
+  this->dofs_valid = false;
+  this->dof_version = 0;
 
   // initialize element array
   int count = 0;
@@ -445,21 +648,89 @@ Mesh::Mesh(int n_macro_elem, double *pts_array, int *p_array, int *m_array, int
   }
 }
 
-// CAUTION - this is expensive (traverses the entire tree 
-// from the beginning until the element is found)
-void Mesh::refine_single_elem(int id, int3 cand)
+// Returns the active element with the given id (ids are the indices 
+// in get_active_elems(), they are assigned by assign_dofs()).
+static Element *find_active_elem(std::vector<Element*> &elems, int id,
+                                 const char *fn)
 {
-    Iterator I(this);
-    Element *e;
-    while ((e = I.next_active_element()) != NULL) {
-        printf("%d %d\n", e->id, id);
-        if (e->id == id) {
-            e->refine(cand);
-            if (cand[0] == 1) this->n_active_elem++; // hp-refinement
-            return;
+    if (id < 0 || id >= (int)elems.size() || elems[id]->id != id) {
+        printf("%s: element id = %d\n", fn, id);
+        error("Element not found (element ids are not up to date?).");
+    }
+    return elems[id];
+}
+
+void Mesh::refine_elem(Element *e, int3 cand)
+{
+    if (this->journal_on) {
+        MeshJournalEntry entry;
+        entry.e = e;
+        entry.type = cand[0];
+        entry.p = e->p;
+        entry.coeffs_start = this->journal_coeffs.size();
+        // the sons get new arrays, the coefficients of 'e' stay
+        if (cand[0] == 0) {
+            for (int sln=0; sln < e->n_sln; sln++)
+                for (int c=0; c < e->n_eq; c++)
+                    this->journal_coeffs.insert(this->journal_coeffs.end(), 
+                        e->coeffs[sln][c], e->coeffs[sln][c] + e->p + 1);
+        }
+        this->journal.push_back(entry);
+    }
+    if (this->dofs_valid) {
+        MeshJournalEntry change = {e, cand[0], e->p, -1};
+        this->dof_changes.push_back(change);
+    }
+    e->refine(cand);
+    if (cand[0] == 1) this->n_active_elem++; // hp-refinement
+}
+
+void Mesh::start_journal()
+{
+    this->journal.clear();
+    this->journal_coeffs.clear();
+    this->journal_on = true;
+}
+
+void Mesh::stop_journal()
+{
+    this->journal.clear();
+    this->journal_coeffs.clear();
+    this->journal_on = false;
+}
+
+void Mesh::undo_refinements()
+{
+    for (int i = this->journal.size() - 1; i >= 0; i--) {
+        MeshJournalEntry &entry = this->journal[i];
+        Element *e = entry.e;
+        if (entry.type == 1) {
+            e->unrefine();
+            this->n_active_elem--;
+            continue;
+        }
+        // old poly degree and coefficients, the entries above 
+        // the old degree are zero again
+        e->resize(entry.p);
+        double *old_coeffs = &this->journal_coeffs[0] + entry.coeffs_start;
+        for (int sln=0; sln < e->n_sln; sln++) {
+            for (int c=0; c < e->n_eq; c++) {
+                double *coeffs = e->coeffs[sln][c];
+                for (int j=0; j < e->coeffs.n; j++) 
+                    coeffs[j] = (j <= entry.p) ? *old_coeffs++ : 0;
+            }
         }
     }
-    error("refine_single_elem: Element not found.");
+    this->journal.clear();
+    this->journal_coeffs.clear();
+    this->assign_dofs();
+}
+
+void Mesh::refine_single_elem(int id, int3 cand)
+{
+    Element *e = find_active_elem(this->get_active_elems(), id, 
+                                  "refine_single_elem");
+    this->refine_elem(e, cand);
 }
 
 // performs mesh refinement using a list of elements to be 
@@ -467,17 +738,11 @@ void Mesh::refine_single_elem(int id, int3 cand)
 // pairs for the sons
 void Mesh::refine_elems(int elem_num, int *id_array, int3 *cand_array)
 {
-    Iterator *I = new Iterator(this);
-    Element *e;
-    int count = 0;
-    while ((e = I->next_active_element()) != NULL) {
-        if (e->id == id_array[count]) {
-            if (count >= elem_num)
-                error("refine_multi_elems: not enough elems specified");
-            e->refine(cand_array[count]);
-            if (cand_array[count][0] == 1) this->n_active_elem++;
-            count++;
-        }
+    // the list is copied since the refinement changes the tree
+    std::vector<Element*> elems = this->get_active_elems();
+    for (int i=0; i < elem_num; i++) {
+        Element *e = find_active_elem(elems, id_array[i], "refine_elems");
+        this->refine_elem(e, cand_array[i]);
     }
 }
 
@@ -486,20 +751,16 @@ void Mesh::refine_elems(int elem_num, int *id_array, int3 *cand_array)
 // Solution is transfered to new elements.
 void Mesh::reference_refinement(int start_elem_id, int elem_num)
 {
-    Iterator *I = new Iterator(this);
-    Element *e;
-    int count = 0;
-    while ((e = I->next_active_element()) != NULL) {
-        if (e->id >= start_elem_id && e->id < start_elem_id + elem_num) {
-	    if (count >= elem_num) return;
-            int3 cand = {1, e->p + 1, e->p + 1};
-            e->refine(cand);
-            
-            if (cand[0] == 1) this->n_active_elem++; // if hp-refinement
-            count++;
-        }
+    // the list is copied since the refinement changes the tree
+    std::vector<Element*> elems = this->get_active_elems();
+    int first = std::max(start_elem_id, 0);
+    int last = std::min(start_elem_id + elem_num, (int)elems.size());
+    for (int i=first; i < last; i++) {
+        Element *e = find_active_elem(elems, i, "reference_refinement");
+        int3 cand = {1, e->p + 1, e->p + 1};
+        this->refine_elem(e, cand);
     }
-    this->assign_dofs();
+    this->assign_dofs_incremental();
 }
 
 void Mesh::set_bc_left_dirichlet(int eqn, double val)
@@ -515,6 +776,7 @@ void Mesh::set_bc_left_dirichlet(int eqn, double val)
     }
     e = e->sons[0];
   } while (e != NULL);
+  this->dofs_valid = false;
 }
 
 void Mesh::set_bc_right_dirichlet(int eqn, double val)
@@ -530,37 +792,90 @@ void Mesh::set_bc_right_dirichlet(int eqn, double val)
     }
     e = e->sons[1];
   } while (e != NULL);
+  this->dofs_valid = false;
 }
 
-// define element connectivities (dof arrays)
-int Mesh::assign_dofs()
+void Mesh::set_dof_ordering(int dof_ordering)
 {
-  Iterator *I = new Iterator(this);
-  // (1) enumerate vertex dofs
-  int count_dof = 0;
-  // loop over solution components
-  for(int c=0; c<this->n_eq; c++) {    
-    Element *e;
-    I->reset();
-    while ((e = I->next_active_element()) != NULL) {
-      if (e->dof[c][0] != -1) e->dof[c][0] = count_dof++; 
-      if (e->dof[c][1] != -1) e->dof[c][1] = count_dof; 
-      else count_dof--;
+  if (dof_ordering != DOF_ORDERING_COMPONENTS && 
+      dof_ordering != DOF_ORDERING_ELEMENTS) 
+    error("Unknown dof ordering in Mesh::set_dof_ordering().");
+  this->dof_ordering = dof_ordering;
+  this->dofs_valid = false;
+}
+
+// numbers the dofs of elems[m_start], elems[m_start+1], ... 
+// (all elements with DOF_ORDERING_COMPONENTS)
+int Mesh::number_dofs(std::vector<Element*> &elems, int m_start, 
+                      int count_dof)
+{
+  int n_elem = elems.size();
+  // the poly degrees may have been changed directly (e->p = ...),
+  // make sure that the dof and coeffs arrays are large enough
+  for (int m=m_start; m < n_elem; m++) {
+    elems[m]->resize(elems[m]->p);
+    elems[m]->dof_p = elems[m]->p;
+  }
+  if (this->dof_ordering == DOF_ORDERING_ELEMENTS) {
+    // dofs of the vertex shared with the previous element
+    int vertex_dof[MAX_EQN_NUM];
+    if (m_start > 0) {
+      for(int c=0; c<this->n_eq; c++) 
+        vertex_dof[c] = elems[m_start-1]->dof[c][1];
     }
-    count_dof++;
-    // (2) enumerate bubble dofs
-    I->reset();
-    while ((e = I->next_active_element()) != NULL) {
-      for(int j=2; j <= e->p; j++) {
-        e->dof[c][j] = count_dof;
-        count_dof++;
+    for (int m=m_start; m < n_elem; m++) {
+      Element *e = elems[m];
+      for(int c=0; c<this->n_eq; c++) {
+        if (e->dof[c][0] == -1) continue;
+        if (m == 0) e->dof[c][0] = count_dof++;
+        else e->dof[c][0] = vertex_dof[c];
+      }
+      for(int c=0; c<this->n_eq; c++) {
+        for(int j=2; j <= e->p; j++) e->dof[c][j] = count_dof++;
+      }
+      for(int c=0; c<this->n_eq; c++) {
+        if (e->dof[c][1] != -1) e->dof[c][1] = count_dof++;
+        vertex_dof[c] = e->dof[c][1];
+      }
+    }
+  }
+  else {
+    if (m_start != 0) error("Internal error in Mesh::number_dofs().");
+    // (1) enumerate vertex dofs
+    // loop over solution components
+    for(int c=0; c<this->n_eq; c++) {    
+      for (int m=0; m < n_elem; m++) {
+        Element *e = elems[m];
+        if (e->dof[c][0] != -1) e->dof[c][0] = count_dof++; 
+        if (e->dof[c][1] != -1) e->dof[c][1] = count_dof; 
+        else count_dof--;
+      }
+      count_dof++;
+      // (2) enumerate bubble dofs
+      for (int m=0; m < n_elem; m++) {
+        Element *e = elems[m];
+        for(int j=2; j <= e->p; j++) {
+          e->dof[c][j] = count_dof;
+          count_dof++;
+        }
       }
     }
   }
-  this->n_dof = count_dof;
-
   // enumerate elements
-  this->assign_elem_ids();
+  for (int m=m_start; m < n_elem; m++) elems[m]->id = m;
+  this->dof_version++;
+  return count_dof;
+}
+
+// define element connectivities (dof arrays)
+int Mesh::assign_dofs()
+{
+  std::vector<Element*> &elems = this->get_active_elems();
+  int n_elem = elems.size();
+  this->n_dof = this->number_dofs(elems, 0, 0);
+  this->dofs_valid = true;
+  this->dofs_tree_version = this->arena.get_tree_version();
+  this->dof_changes.clear();
 
   // print element connectivities
   if(DEBUG_ELEM_DOF) {
@@ -568,9 +883,8 @@ int Mesh::assign_dofs()
     printf("Elements = %d\n", this->n_base_elem);
     printf("DOF = %d", this->n_dof);
     for(int c = 0; c<this->n_eq; c++) {
-      I->reset();
-      Element *e;
-      while ((e = I->next_active_element()) != NULL) {
+      for (int m=0; m < n_elem; m++) {
+        Element *e = elems[m];
         printf("\nElement (%g, %g), id = %d, p = %d\n ", 
                e->x1, e->x2, e->id, e->p); 
         for(int j = 0; j<e->p + 1; j++) {
@@ -581,21 +895,238 @@ int Mesh::assign_dofs()
     printf("\n"); 
   }
 
-  delete I;
   return this->n_dof;
 }
 
+// order of split elements: by the left end point, longer first
+static bool split_elem_less(Element *e1, Element *e2)
+{
+  if (e1->x1 != e2->x1) return e1->x1 < e2->x1;
+  return e1->x2 > e2->x2;
+}
+
+// The elements refined since the last numbering are in 'dof_changes'. 
+// Split elements keep their old dof arrays and all active elements 
+// inside of them are new. The other active elements keep their old 
+// dofs (up to the old poly degree if they were p-refined).
+int Mesh::assign_dofs_incremental(std::vector<int> *dof_map)
+{
+  int n_dof_old = this->n_dof;
+  int n_split = 0;
+  for (unsigned i=0; i < this->dof_changes.size(); i++) 
+    if (this->dof_changes[i].type == 1) n_split++;
+  if (!this->dofs_valid || this->arena.get_tree_version() != 
+      this->dofs_tree_version + n_split) {
+    if (dof_map != NULL) dof_map->assign(n_dof_old, -1);
+    return this->assign_dofs();
+  }
+  std::vector<Element*> &elems = this->get_active_elems();
+  int n_elem = elems.size();
+
+  // split elements that were active at the last numbering (the 
+  // others lie inside of them), old poly degrees of p-refined 
+  // elements, and the left end point of the first refined element
+  std::vector<Element*> split_elems;
+  std::map<Element*, int> old_p;
+  double x_first = this->right_endpoint;
+  for (unsigned i=0; i < this->dof_changes.size(); i++) {
+    Element *e = this->dof_changes[i].e;
+    x_first = std::min(x_first, e->x1);
+    if (this->dof_changes[i].type == 1) split_elems.push_back(e);
+    else if (old_p.find(e) == old_p.end()) 
+      old_p[e] = this->dof_changes[i].p;
+  }
+  std::sort(split_elems.begin(), split_elems.end(), split_elem_less);
+  std::vector<Element*> top_elems;
+  for (unsigned i=0; i < split_elems.size(); i++) {
+    if (!top_elems.empty() && split_elems[i]->x2 <= top_elems.back()->x2) 
+      continue;
+    top_elems.push_back(split_elems[i]);
+  }
+
+  // poly degrees changed outside of the mesh (Element::refine(), 
+  // Element::resize(), e->p = ...) are not in 'dof_changes', the 
+  // old numbering cannot be updated then
+  for (int m=0, k=0; m < n_elem; m++) {
+    Element *e = elems[m];
+    if (e->p == e->dof_p) continue;
+    // (new sons of split elements)
+    while (k < (int) top_elems.size() && top_elems[k]->x2 <= e->x1) k++;
+    if (k < (int) top_elems.size() && top_elems[k]->x1 <= e->x1) continue;
+    if (old_p.find(e) == old_p.end()) {
+      if (dof_map != NULL) dof_map->assign(n_dof_old, -1);
+      return this->assign_dofs();
+    }
+  }
+  if (this->dof_changes.empty()) {
+    if (dof_map != NULL) {
+      dof_map->resize(n_dof_old);
+      for (int i=0; i < n_dof_old; i++) (*dof_map)[i] = i;
+    }
+    return this->n_dof;
+  }
+
+  // first element to renumber and its first dof (everything is 
+  // renumbered with DOF_ORDERING_COMPONENTS)
+  int m_first = 0, count_dof = 0;
+  if (this->dof_ordering == DOF_ORDERING_ELEMENTS) {
+    m_first = this->locate_point(x_first);
+    for (int m=m_first-1; m >= 0 && count_dof == 0; m--) {
+      Element *e = elems[m];
+      for (int c=0; c < this->n_eq; c++) 
+        for (int j=0; j <= e->p; j++) 
+          count_dof = std::max(count_dof, e->dof[c][j] + 1);
+    }
+  }
+
+  // old dofs of the elements that are not new (up to 'n_old[m]')
+  std::vector<int> n_old(n_elem), old_dofs;
+  if (dof_map != NULL) {
+    unsigned k = 0;
+    for (int m=m_first; m < n_elem; m++) {
+      Element *e = elems[m];
+      while (k < top_elems.size() && top_elems[k]->x2 <= e->x1) k++;
+      if (k < top_elems.size() && top_elems[k]->x1 <= e->x1) {
+        n_old[m] = 0;
+        continue;
+      }
+      std::map<Element*, int>::iterator it = old_p.find(e);
+      n_old[m] = (it == old_p.end()) ? e->p + 1 : 
+                                       std::min(it->second, e->p) + 1;
+      for (int c=0; c < this->n_eq; c++) 
+        for (int j=0; j < n_old[m]; j++) old_dofs.push_back(e->dof[c][j]);
+    }
+  }
+
+  this->n_dof = this->number_dofs(elems, m_first, count_dof);
+  this->dofs_valid = true;
+  this->dofs_tree_version = this->arena.get_tree_version();
+  this->dof_changes.clear();
+  if (dof_map == NULL) return this->n_dof;
+
+  // old-to-new map: the dofs before the renumbered elements are 
+  // kept, the other dofs of old elements are looked up in them, the 
+  // vertex dofs of split elements are now in their outer descendants
+  dof_map->assign(n_dof_old, -1);
+  for (int i=0; i < count_dof; i++) (*dof_map)[i] = i;
+  for (int m=m_first, k=0; m < n_elem; m++) {
+    Element *e = elems[m];
+    for (int c=0; c < this->n_eq; c++) {
+      for (int j=0; j < n_old[m]; j++, k++) {
+        if (old_dofs[k] >= 0) (*dof_map)[old_dofs[k]] = e->dof[c][j];
+      }
+    }
+  }
+  for (unsigned i=0; i < top_elems.size(); i++) {
+    Element *e_left = top_elems[i], *e_right = top_elems[i];
+    while (e_left->sons[0] != NULL) e_left = e_left->sons[0];
+    while (e_right->sons[1] != NULL) e_right = e_right->sons[1];
+    for (int c=0; c < this->n_eq; c++) {
+      if (top_elems[i]->dof[c][0] >= 0) 
+        (*dof_map)[top_elems[i]->dof[c][0]] = e_left->dof[c][0];
+      if (top_elems[i]->dof[c][1] >= 0) 
+        (*dof_map)[top_elems[i]->dof[c][1]] = e_right->dof[c][1];
+    }
+  }
+  return this->n_dof;
+}
+
+void Mesh::get_elem_dof_blocks(std::vector<std::vector<int> > &blocks)
+{
+  std::vector<Element*> &elems = this->get_active_elems();
+  int n_elem = elems.size();
+  blocks.assign(n_elem, std::vector<int>());
+  for (int m=0; m < n_elem; m++) {
+    Element *e = elems[m];
+    for (int c=0; c < this->n_eq; c++) {
+      for (int j=0; j <= e->p; j++) {
+        // the right vertex belongs to the next element
+        if (j == 1 && m < n_elem - 1) continue;
+        if (e->dof[c][j] >= 0) blocks[m].push_back(e->dof[c][j]);
+      }
+    }
+  }
+}
+
 int Mesh::assign_elem_ids()
 {
-    Iterator *I = new Iterator(this);
-    int count_id = 0;
-    Element *e;
-    I->reset();
-    while ((e = I->next_active_element()) != NULL) {
-        e->id = count_id;
-        count_id++;
+    std::vector<Element*> &elems = this->get_active_elems();
+    int n_elem = elems.size();
+    for (int m=0; m < n_elem; m++) elems[m]->id = m;
+    return n_elem;
+}
+
+std::vector<Element*> &Mesh::get_active_elems()
+{
+    if (this->active_elems_valid && 
+        this->active_elems_version == this->arena.get_tree_version())
+        return this->active_elems;
+    this->active_elems.clear();
+    this->active_elem_vertices.clear();
+    if (this->base_elems != NULL) {
+        Iterator I(this);
+        Element *e;
+        while ((e = I.next_active_element()) != NULL) {
+            this->active_elems.push_back(e);
+            this->active_elem_vertices.push_back(e->x1);
+        }
+        if (!this->active_elems.empty())
+            this->active_elem_vertices.push_back(this->active_elems.back()->x2);
+    }
+    this->active_elems_version = this->arena.get_tree_version();
+    this->active_elems_valid = true;
+    return this->active_elems;
+}
+
+// (the endpoints of the domain may differ from the element 
+// endpoints by rounding errors)
+int Mesh::locate_point(double x)
+{
+    int n_elem = this->get_active_elems().size();
+    std::vector<double> &v = this->active_elem_vertices;
+    if (n_elem == 0 || 
+        !(x >= std::min(v[0], this->left_endpoint) && 
+          x <= std::max(v[n_elem], this->right_endpoint))) return -1;
+    int m = std::upper_bound(v.begin(), v.end(), x) - v.begin() - 1;
+    return std::max(0, std::min(m, n_elem - 1));
+}
+
+void Mesh::get_solution_points(int n_pts, double *x, double *val, 
+                               double *der, int sln)
+{
+    std::vector<Element*> &elems = this->get_active_elems();
+    std::vector<double> &v = this->active_elem_vertices;
+    int n_elem = elems.size();
+    int n_eq = this->n_eq;
+    int m = -1;
+    for (int i=0; i < n_pts; i++) {
+        // sweep to the right as long as the points are sorted
+        if (m >= 0 && x[i] >= x[i-1] && x[i] <= v[n_elem]) {
+            while (m < n_elem - 1 && x[i] >= v[m+1]) m++;
+        }
+        else m = this->locate_point(x[i]);
+        if (m < 0) {
+            printf("x = %g\n", x[i]);
+            error("Point outside of the mesh in get_solution_points().");
+        }
+
+        // all shape functions of the element at once
+        Element *e = elems[m];
+        double jac = (e->x2 - e->x1)/2.;
+        double x_ref = inverse_map(e->x1, e->x2, x[i]);
+        double shape_val[MAX_P + 1], shape_der[MAX_P + 1];
+        fill_lobatto_array_ref(x_ref, shape_val, shape_der, e->p);
+        for (int c=0; c < n_eq; c++) {
+            double *coeffs = e->coeffs[sln][c];
+            double val_c = 0, der_c = 0;
+            for (int j=0; j <= e->p; j++) {
+                val_c += coeffs[j]*shape_val[j];
+                der_c += coeffs[j]*shape_der[j];
+            }
+            val[i*n_eq + c] = val_c;
+            if (der != NULL) der[i*n_eq + c] = der_c/jac;
+        }
     }
-    delete I;
 }
 
 Element* Mesh::first_active_element()
@@ -712,12 +1243,13 @@ void element_shapefn(double a, double b,
   //double2 *ref_tab = g_quad_1d_std.get_points(order);
   int pts_num = g_quad_1d_std.get_num_points(order);
   double jac = (b-a)/2.; 
+  lobatto_ref_tab_init(order);
   for (int i=0 ; i < pts_num; i++) {
     // change function values and derivatives to interval (a, b)
     //val[i] = lobatto_val_ref(ref_tab[i][0], k);
-    val[i] = lobatto_val_ref_tab[order][i][k];
+    val[i] = lobatto_val_ref_tab_fn[order][k][i];
     //der[i] = lobatto_der_ref(ref_tab[i][0], k) / jac; 
-    der[i] = lobatto_der_ref_tab[order][i][k]/jac;
+    der[i] = lobatto_der_ref_tab_fn[order][k][i]/jac;
   }
 };
 
@@ -747,6 +1279,7 @@ Mesh *Mesh::replicate()
   mesh_new->set_left_endpoint(this->left_endpoint);
   mesh_new->set_right_endpoint(this->right_endpoint);
   mesh_new->set_n_dof(this->n_dof);
+  mesh_new->set_dof_ordering(this->dof_ordering);
 
   // replicate all base mesh elements including all their 
   // variables, dof arrays, and tree-structure
@@ -757,9 +1290,51 @@ Mesh *Mesh::replicate()
     e_src->copy_recursively_into(e_trg);
   }
 
+  // the copied dofs are a numbering to start from 
+  // in assign_dofs_incremental()
+  if (this->dofs_valid && this->dof_changes.empty()) {
+    mesh_new->dofs_valid = true;
+    mesh_new->dofs_tree_version = mesh_new->arena.get_tree_version();
+  }
+
   return mesh_new;
 }
 
+Mesh *Mesh::extract_patch(int start_elem_id, int elem_num)
+{
+  std::vector<Element*> &elems = this->get_active_elems();
+  int n_elem = elems.size();
+  int first = std::max(start_elem_id, 0);
+  int last = std::min(start_elem_id + elem_num, n_elem);
+  if (first >= last) error("Empty patch in Mesh::extract_patch().");
+
+  // (the constructors are not used, they print)
+  Mesh *patch = new Mesh();
+  patch->n_eq = this->n_eq;
+  patch->n_sln = this->n_sln;
+  patch->n_base_elem = patch->n_active_elem = last - first;
+  patch->left_endpoint = (first == 0) ? 
+                         this->left_endpoint : elems[first]->x1;
+  patch->right_endpoint = (last == n_elem) ? 
+                          this->right_endpoint : elems[last-1]->x2;
+  patch->dof_ordering = this->dof_ordering;
+  patch->base_elems = patch->arena.new_elements(patch->n_base_elem);
+  for (int m=first; m < last; m++) {
+    Element *e = patch->base_elems + m - first;
+    elems[m]->copy_into(e);
+    e->sons[0] = e->sons[1] = NULL;
+  }
+
+  // the coefficients of the fixed vertex functions are the 
+  // values of the solutions there
+  for (int c=0; c < this->n_eq; c++) {
+    if (first > 0) patch->base_elems[0].dof[c][0] = -1;
+    if (last < n_elem) patch->base_elems[patch->n_base_elem - 1].dof[c][1] = -1;
+  }
+  patch->assign_dofs();
+  return patch;
+}
+
 void Mesh::plot(const char* filename) 
 {
     FILE *f = fopen(filename, "wb");
@@ -1032,9 +1607,9 @@ void Mesh::plot_error_exact(int norm, exact_sol_type exact_sol,
   if(f == NULL) error("problem opening file in plot_error_exact().");
 
   // traversal of 'this'
-  Element *e;
-  Iterator *I = new Iterator(this);
-  while ((e = I->next_active_element()) != NULL) {
+  std::vector<Element*> &elems = this->get_active_elems();
+  for (int m=0; m < (int)elems.size(); m++) {
+    Element *e = elems[m];
     if (e->p >= MAX_P) {
       printf("Try to increase MAX_P in common.h.\n");
       error("Max poly degree exceeded in plot_error_exact().");
@@ -1049,7 +1624,8 @@ void Mesh::plot_error_exact(int norm, exact_sol_type exact_sol,
 // Use the err_array[] and threshold to create a list of 
 // elements to be refined.
 void create_ref_index_array(double threshold, double *err_array, 
-                            int n_elem, int *adapt_list, int &num_to_adapt) 
+                            int n_elem, std::vector<int> &adapt_list, 
+                            int &num_to_adapt) 
 {
   // debug
   //printf("num_to_adapt = %d\n", num_to_adapt);
@@ -1064,7 +1640,7 @@ void create_ref_index_array(double threshold, double *err_array,
   }
 
   // Create auxiliary array of element indices
-  int id_array[MAX_ELEM_NUM];
+  std::vector<int> id_array(n_elem);
   for(int i=0; i < n_elem; i++) {
     if(err_array[i] < threshold*max_elem_error) id_array[i] = -1; 
     else id_array[i] = i;
@@ -1081,13 +1657,11 @@ void create_ref_index_array(double threshold, double *err_array,
   */
 
   // Create list of elements to be refined, in increasing order
-  num_to_adapt = 0;
+  adapt_list.clear();
   for (int i=0; i < n_elem; i++) {
-    if (id_array[i] >= 0) {
-      adapt_list[num_to_adapt] = id_array[i];
-      num_to_adapt++;
-    }
+    if (id_array[i] >= 0) adapt_list.push_back(id_array[i]);
   }
+  num_to_adapt = adapt_list.size();
  
   /*
   // Debug: Printing list of elements to be refined
@@ -1097,263 +1671,242 @@ void create_ref_index_array(double threshold, double *err_array,
   */
 }
 
+// Selection phase of adapt(): for the k-th element in 'adapt_elems' 
+// with reference element(s) 'ref_left[k]' and 'ref_right[k]' (NULL if 
+// the reference refinement was p-refinement), the best refinement 
+// candidate is stored in 'choices[k]'. The elements are independent 
+// and they are processed in 'num_threads' threads.
+static void select_refinements(int norm, int adapt_type, 
+                               std::vector<Element*> &adapt_elems,
+                               std::vector<Element*> &ref_left,
+                               std::vector<Element*> &ref_right,
+                               int num_threads, int3 *choices)
+{
+  if (num_threads < 1) error("Invalid number of threads in adapt().");
+#ifndef H1D_WITH_OPENMP
+  if (num_threads > 1) 
+    warning("hermes1d was built without OpenMP, adapting in one thread.");
+#endif
+  int num_to_adapt = adapt_elems.size();
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (int k=0; k < num_to_adapt; k++) {
+    // Every refinement candidate consists of three
+    // and then either one or two polynomial degrees
+    int3 cand_list[MAX_CAND_NUM];   
+    Element *e = adapt_elems[k];
+    int choice;
+    // Element 'e' was not refined in space
+    // for reference solution.
+    if (ref_right[k] == NULL) {
+      int num_cand = e->create_cand_list(adapt_type, ref_left[k]->p, -1, 
+                                         cand_list);
+      // debug:
+      //e->print_cand_list(num_cand, cand_list);
+      // reference element was p-refined
+      choice = select_hp_refinement(e, ref_left[k], NULL, num_cand, 
+                                    cand_list, 0, norm);
+    }
+    // Element 'e' was refined in space for reference solution.
+    else {
+      int num_cand = e->create_cand_list(adapt_type, ref_left[k]->p, 
+                                         ref_right[k]->p, cand_list);
+      choice = select_hp_refinement(e, ref_left[k], ref_right[k], 
+                                    num_cand, cand_list, 1, norm);
+    }
+    for (int i=0; i < 3; i++) choices[k][i] = cand_list[choice][i];
+  }
+}
+
 // Returns updated coarse and reference meshes, with the last 
 // coarse and reference mesh solutions on them, respectively. 
 // The coefficient vectors and numbers of degrees of freedom 
-// on both meshes are also updated. 
+// on both meshes are also updated. The meshes are refined 
+// in place.
 void adapt(int norm, int adapt_type, double threshold, 
            double *err_array, 
-           Mesh* &mesh, Mesh* &mesh_ref) 
+           Mesh* &mesh, Mesh* &mesh_ref, int num_threads) 
 {
   int n_elem = mesh->get_n_active_elem();
   
   // Use the err_array[] and threshold to create a list of 
   // elements to be refined.
-  int adapt_list[MAX_ELEM_NUM];
+  std::vector<int> adapt_list;
   int num_to_adapt;
   create_ref_index_array(threshold, err_array, n_elem, adapt_list, num_to_adapt);
 
-  // Replicate the coarse and fine meshes. The original meshes become
-  // backup and refinements will only be done in the new ones.
-  Mesh *mesh_new = mesh->replicate();
-  Mesh *mesh_ref_new = mesh_ref->replicate();
+  // Active elements of both meshes (copies of the lists, the 
+  // meshes are refined in place below). Every element of 'mesh' 
+  // corresponds to one element of 'mesh_ref' (reference p-refinement)
+  // or to two of them (reference hp-refinement), the first one 
+  // is ref_idx[m].
+  std::vector<Element*> elems = mesh->get_active_elems();
+  std::vector<Element*> elems_ref = mesh_ref->get_active_elems();
+  std::vector<int> ref_idx(n_elem);
+  int n_elem_ref = elems_ref.size();
+  int r = 0;
+  for (int m=0; m < n_elem; m++) {
+    if (r >= n_elem_ref) error("Reference mesh does not match the mesh in adapt().");
+    ref_idx[m] = r;
+    r += (elems[m]->level == elems_ref[r]->level) ? 1 : 2;
+  }
+  if (r != n_elem_ref) error("Reference mesh does not match the mesh in adapt().");
 
-  // Simultaneous traversal of all meshes.
-  // For each element in 'mesh_new', create a list of refinement 
+  // For each element to be refined, create a list of refinement 
   // candidates and select the one that best resembles the reference 
-  // solution on 'mesh_ref_new'. While elements in 'mesh_new' are refined, 
-  // corresponding refinements are also done in 'mesh_ref_new'.
-  Iterator *I = new Iterator(mesh);
-  Iterator *I_new = new Iterator(mesh_new);
-  Iterator *I_ref = new Iterator(mesh_ref);
-  Iterator *I_ref_new = new Iterator(mesh_ref_new);
-  Element *e = I->next_active_element();
-  Element *e_new = I_new->next_active_element();
-  Element *e_ref = I_ref->next_active_element();
-  Element *e_ref_new = I_ref_new->next_active_element();
-  int counter = 0;
-  while (counter != num_to_adapt) {
-    if (e->id == adapt_list[counter]) {
-      counter++;
-      int choice = 0;
-      // Every refinement candidate consists of three
-      // and then either one or two polynomial degrees
-      int3 cand_list[MAX_CAND_NUM];   
-      Element* e_ref_left;
-      Element* e_ref_right;
-      Element* e_ref_new_left;
-      Element* e_ref_new_right;
-      // Element 'e' was not refined in space
-      // for reference solution.
-      if (e->level == e_ref->level) {
-        e_ref_left = e_ref;
-        e_ref_new_left = e_ref_new;
-        e_ref_right = NULL;
-        e_ref_new_right = NULL;
-        int num_cand = e->create_cand_list(adapt_type, e_ref->p, -1, cand_list);
-        // debug:
-        //e->print_cand_list(num_cand, cand_list);
-        // reference element was p-refined
-        choice = select_hp_refinement(e, e_ref, NULL, num_cand, cand_list, 
-                                      0, norm);
+  // solution on 'mesh_ref'. 
+  std::vector<Element*> adapt_elems(num_to_adapt);
+  std::vector<Element*> ref_left(num_to_adapt), ref_right(num_to_adapt);
+  for (int k=0; k < num_to_adapt; k++) {
+    int m = adapt_list[k];
+    adapt_elems[k] = elems[m];
+    ref_left[k] = elems_ref[ref_idx[m]];
+    ref_right[k] = (elems[m]->level == ref_left[k]->level) ? 
+                   NULL : elems_ref[ref_idx[m] + 1];
+  }
+  int3 *choices = new int3[std::max(num_to_adapt, 1)];
+  select_refinements(norm, adapt_type, adapt_elems, ref_left, ref_right, 
+                     num_threads, choices);
+
+  // Perform the selected refinements in 'mesh' and the 
+  // corresponding refinements in 'mesh_ref'. All candidates were
+  // selected before, so the elements can be refined in place.
+  for (int k=0; k < num_to_adapt; k++) {
+    int m = adapt_list[k];
+    // e_last... element in mesh that will be refined,
+    // e_ref_left... corresponding element in the fine mesh (if 
+    //               reference refinement was p-refinement). In this case 
+    //               e_ref_right == NULL
+    // e_ref_left, e_ref_right... corresponding pair of elements 
+    //               in the fine mesh if reference refinement was 
+    //               hp-refinement
+    Element *e_last = elems[m];
+    Element *e_ref_left = ref_left[k];
+    Element *e_ref_right = ref_right[k];
+    int *cand = choices[k];
+    // perform the refinement of element e_last
+    mesh->refine_elem(e_last, cand);
+    //printf("  Refined element (%g, %g), cand = (%d %d %d)\n", 
+    //       e_last->x1, e_last->x2, cand[0], cand[1], cand[2]);
+    // perform corresponding refinement(s) in the fine mesh
+    if (e_ref_right == NULL) { // ref. refinement of 'e_last' was 
+                               // p-refinement so also future ref. 
+                               // refinements will be p-refinements
+      if (cand[0] == 0) { // e_last is being p-refined, thus also
+                          // e_ref_left needs to be p-refined
+        int new_p = cand[1];
+        int3 cand_ref = {0, new_p + 1, -1};
+        mesh_ref->refine_elem(e_ref_left, cand_ref);
       }
-      // Element 'e' was refined in space for reference solution.
-      else {
-        e_ref_left = e_ref;
-        e_ref_new_left = e_ref_new;
-        e_ref_right = I_ref->next_active_element();
-        e_ref_new_right = I_ref_new->next_active_element();
-        int num_cand = e->create_cand_list(adapt_type, e_ref_left->p, 
-                                           e_ref_right->p, cand_list);
-        choice = select_hp_refinement(e, e_ref_left, e_ref_right, 
-                                      num_cand, cand_list, 1, norm);
+      else { // e_last is being split, thus e_ref_left needs to be 
+             // split as well
+        int new_p_left = cand[1];
+        int new_p_right = cand[2];
+        int3 cand_ref = {1, new_p_left + 1, new_p_right + 1};
+        mesh_ref->refine_elem(e_ref_left, cand_ref);
       }
-
-      // Next we perform the refinement defined by cand_list[choice]
-      // e_new_last... element in mesh_new that will be refined,
-      // e_ref_left... corresponding element in fine mesh (if reference 
-      //               refinement was p-refinement). In this case 
-      //               e_ref_right == NULL
-      // e_ref_left, e_ref_right... corresponding pair of elements 
-      //               in the fine mesh if reference refinement was hp-refinement
-      Element *e_new_last = e_new;
-      // moving pointers 'e' and 'e_new' to the next position in coarse meshes
-      // and 'e_ref' and 'e_ref_new' to the next position in fine meshes 
-      e = I->next_active_element();
-      e_new = I_new->next_active_element();
-      e_ref = I_ref->next_active_element();
-      e_ref_new = I_ref_new->next_active_element();
-      // perform the refinement of element e_new_last
-      e_new_last->refine(cand_list[choice]);
-      //printf("  Refined element (%g, %g), cand = (%d %d %d)\n", 
-      //       e_new_last->x1, e_new_last->x2, cand_list[choice][0], 
-      //       cand_list[choice][1], cand_list[choice][2]);
-      if(cand_list[choice][0] == 1) mesh_new->n_active_elem++; 
-      // perform corresponding refinement(s) in the new fine mesh
-      if (e_new_last->level == e_ref_left->level) { // ref. refinement of 'e_last' was 
-                                                    // p-refinement so also future ref. 
-                                                    // refinements will be p-refinements
-        if (cand_list[choice][0] == 0) { // e_last is being p-refined, thus also
-                                         // e_ref_new_left needs to be p-refined
-          int new_p = cand_list[choice][1];
-	  e_ref_new_left->refine(0, new_p + 1, -1);
-        }
-        else { // e_new_last is being split, thus e_ref_new_left needs to be 
-               // split as well
-          int new_p_left = cand_list[choice][1];
-          int new_p_right = cand_list[choice][2];
-	  e_ref_new_left->refine(1, new_p_left + 1, new_p_right + 1);
-          mesh_ref_new->n_active_elem++;
-        }
+    }
+    else { // ref. refinement was hp-refinement, so also future
+           // ref. refinements will be hp-refinements
+      if (cand[0] == 0) { // e_last is being p-refined, thus also 
+                          // e_ref_left and e_ref_right  
+                          // will just be p-refined
+        int new_p = cand[1];
+        int3 cand_ref = {0, new_p + 1, -1};
+        mesh_ref->refine_elem(e_ref_left, cand_ref);
+        mesh_ref->refine_elem(e_ref_right, cand_ref);
       }
-      else { // ref. refinement was hp-refinement, so also future
-             // ref. refinements will be hp-refinements
-        if (cand_list[choice][0] == 0) { // e_new_last is being p-refined, thus also 
-                                         // e_ref_new_left and e_ref_new_right  
-                                         // will just be p-refined
-          int new_p = cand_list[choice][1];
-	  e_ref_new_left->refine(0, new_p + 1, -1);
-	  e_ref_new_right->refine(0, new_p + 1, -1);
-        }
-        else { // e_new_last is being hp-refined, so we need to 
-               // split both e_ref_new_left and e_ref_new_right
-          int new_p_left = cand_list[choice][1];
-          int new_p_right = cand_list[choice][2];
-	  e_ref_new_left->refine(1, new_p_left + 1, new_p_left + 1);
-          mesh_ref_new->n_active_elem++;
-	  e_ref_new_right->refine(1, new_p_right + 1, new_p_right + 1);
-          mesh_ref_new->n_active_elem++;
-        }
+      else { // e_last is being hp-refined, so we need to 
+             // split both e_ref_left and e_ref_right
+        int new_p_left = cand[1];
+        int new_p_right = cand[2];
+        int3 cand_ref_left = {1, new_p_left + 1, new_p_left + 1};
+        int3 cand_ref_right = {1, new_p_right + 1, new_p_right + 1};
+        mesh_ref->refine_elem(e_ref_left, cand_ref_left);
+        mesh_ref->refine_elem(e_ref_right, cand_ref_right);
       }
     }
-    else {
-      e = I->next_active_element();
-      e_new = I_new->next_active_element();
-      e_ref = I_ref->next_active_element();
-      e_ref_new = I_ref_new->next_active_element();
-      if (e->level != e_ref->level) { 
-        e_ref = I_ref->next_active_element();
-        e_ref_new = I_ref_new->next_active_element();
-      }    
-    }
   }
-  // enumerate dofs in both new meshes
-  int n_dof_new = mesh_new->assign_dofs();
-  int n_dof_ref_new = mesh_ref_new->assign_dofs();
+  delete [] choices;
+
+  // enumerate dofs in both meshes
+  int n_dof = mesh->assign_dofs_incremental();
+  int n_dof_ref = mesh_ref->assign_dofs_incremental();
   printf("Coarse mesh refined (%d elem, %d DOF)\n", 
-         mesh_new->get_n_active_elem(), n_dof_new);
+         mesh->get_n_active_elem(), n_dof);
   printf("Fine mesh refined (%d elem, %d DOF)\n", 
-  	 mesh_ref_new->get_n_active_elem(), n_dof_ref_new);
-
-  // Delete old meshes and copy the new ones in place of them
-  delete mesh;
-  delete mesh_ref;
-  mesh = mesh_new;
-  mesh_ref = mesh_ref_new;
-
-  // Last adjust the number of dofs in each mesh
-  mesh->set_n_dof(n_dof_new);
-  mesh_ref->set_n_dof(n_dof_ref_new);
+  	 mesh_ref->get_n_active_elem(), n_dof_ref);
 }
 
 // Returns updated coarse mesh, with the last 
 // coarse solution on it. 
 // The coefficient vector and number of degrees of freedom 
-// also is updated. 
+// also is updated. The mesh is refined in place.
 void adapt(int norm, int adapt_type, double threshold, 
            double *err_array, 
-           Mesh* &mesh, ElemPtr2 *ref_elem_pairs) 
+           Mesh* &mesh, ElemPtr2 *ref_elem_pairs, int num_threads) 
 {
   int n_elem = mesh->get_n_active_elem();
   
   // Use the err_array[] and threshold to create a list of 
   // elements to be refined.
-  int adapt_list[MAX_ELEM_NUM];
+  std::vector<int> adapt_list;
   int num_to_adapt;
   create_ref_index_array(threshold, err_array, n_elem, adapt_list, num_to_adapt);
 
-  // Replicate the coarse mesh. The original coarse mesh becomes
-  // backup and refinements will only be done in the new one.
-  Mesh *mesh_new = mesh->replicate();
+  // (a copy of the list, the mesh is refined in place below)
+  std::vector<Element*> elems = mesh->get_active_elems();
 
-  // Simultaneous traversal of mesh_new and the ref_elem_pairs[] array.
-  // For each element in mesh_new create a list of refinement 
+  // For each element to be refined, create a list of refinement 
   // candidates and select the one that best resembles the reference 
   // solution in ref_elem_pairs[]. 
-  Iterator *I = new Iterator(mesh);
-  Iterator *I_new = new Iterator(mesh_new);
-  Element *e = I->next_active_element();
-  Element *e_new = I_new->next_active_element();
-  int counter_adapt = 0;
-  while (counter_adapt != num_to_adapt) {
-    if (e->id == adapt_list[counter_adapt]) {
-      counter_adapt++;
-      int choice = 0;
-      // Every refinement candidate consists of three
-      // and then either one or two polynomial degrees
-      int3 cand_list[MAX_CAND_NUM];   
-      Element* e_ref = ref_elem_pairs[e->id][0];
-      Element* e_ref_left;
-      Element* e_ref_right;
-      // Element 'e' was not refined in space
-      // for reference solution.
-      if (e->level == e_ref->level) {
-        e_ref_left = e_ref;
-        e_ref_right = NULL;
-        int num_cand = e->create_cand_list(adapt_type, e_ref->p, -1, cand_list);
-        // debug:
-        //e->print_cand_list(num_cand, cand_list);
-        // reference element was p-refined
-        choice = select_hp_refinement(e, e_ref, NULL, num_cand, cand_list, 
-                                      0, norm);
-      }
-      // Element 'e' was refined in space for reference solution.
-      else {
-        e_ref_left = e_ref;
-        e_ref_right = ref_elem_pairs[e->id][1];
-        int num_cand = e->create_cand_list(adapt_type, e_ref_left->p, 
-                                           e_ref_right->p, cand_list);
-        choice = select_hp_refinement(e, e_ref_left, e_ref_right, 
-                                      num_cand, cand_list, 1, norm);
-      }
-
-      // Next we perform the refinement defined by cand_list[choice]
-      // e_new_last... element in mesh_new that will be refined,
-      // e_ref_left... corresponding element in ref_elem_pairs[] (if reference 
-      //               refinement was p-refinement). In this case 
-      //               e_ref_right == NULL
-      // e_ref_left, e_ref_right... corresponding pair of elements 
-      //               in ref_elem_pairs[] (if reference refinement was hp-refinement)
-      Element *e_new_last = e_new;
-      // moving pointers 'e' and 'e_new' to the next position in coarse meshes
-      e = I->next_active_element();
-      e_new = I_new->next_active_element();
-      // perform the refinement of element e_new_last
-      e_new_last->refine(cand_list[choice]);
-      printf("  Refined element (%g, %g), cand = (%d %d %d)\n", 
-             e_new_last->x1, e_new_last->x2, cand_list[choice][0], 
-             cand_list[choice][1], cand_list[choice][2]);
-      if(cand_list[choice][0] == 1) mesh_new->n_active_elem++;
-    }
-    else {
-      e = I->next_active_element();
-      e_new = I_new->next_active_element();
-    }
+  std::vector<Element*> adapt_elems(num_to_adapt);
+  std::vector<Element*> ref_left(num_to_adapt), ref_right(num_to_adapt);
+  for (int k=0; k < num_to_adapt; k++) {
+    Element *e = elems[adapt_list[k]];
+    adapt_elems[k] = e;
+    ref_left[k] = ref_elem_pairs[e->id][0];
+    ref_right[k] = (e->level == ref_left[k]->level) ? 
+                   NULL : ref_elem_pairs[e->id][1];
   }
-  // enumerate dofs in both new meshes
-  int n_dof_new = mesh_new->assign_dofs();
-  printf("New mesh has %d elements.\n",
-         mesh_new->get_n_active_elem(), n_dof_new);
+  int3 *choices = new int3[std::max(num_to_adapt, 1)];
+  select_refinements(norm, adapt_type, adapt_elems, ref_left, ref_right, 
+                     num_threads, choices);
+
+  // Perform the selected refinements in 'mesh'.
+  for (int k=0; k < num_to_adapt; k++) {
+    Element *e_last = adapt_elems[k];
+    int *cand = choices[k];
+    mesh->refine_elem(e_last, cand);
+    printf("  Refined element (%g, %g), cand = (%d %d %d)\n", 
+           e_last->x1, e_last->x2, cand[0], cand[1], cand[2]);
+  }
+  delete [] choices;
 
-  // Delete old coarse mesh
-  delete mesh;
-  mesh = mesh_new;
+  // enumerate dofs in the mesh
+  mesh->assign_dofs_incremental();
+  printf("New mesh has %d elements.\n", mesh->get_n_active_elem());
+}
 
-  // check on DOF overflow
-  if (n_dof_new > MAX_N_DOF) error("MAX_N_DOF exceeded in adapt().");
+void adapt(int norm, int adapt_type, double threshold, 
+           std::vector<double> &err_array, 
+           Mesh* &mesh, Mesh* &mesh_ref, int num_threads) 
+{
+  if ((int)err_array.size() < mesh->get_n_active_elem()) 
+    error("err_array is shorter than the number of elements in adapt().");
+  adapt(norm, adapt_type, threshold, &err_array[0], mesh, mesh_ref, 
+        num_threads);
+}
 
-  // Adjust the number of dofs
-  mesh->set_n_dof(n_dof_new);
+void adapt(int norm, int adapt_type, double threshold, 
+           std::vector<double> &err_array, 
+           Mesh* &mesh, ElemPtr2 *ref_elem_pairs, int num_threads) 
+{
+  if ((int)err_array.size() < mesh->get_n_active_elem()) 
+    error("err_array is shorter than the number of elements in adapt().");
+  adapt(norm, adapt_type, threshold, &err_array[0], mesh, ref_elem_pairs, 
+        num_threads);
 }
 
 void adapt_plotting(Mesh *mesh, Mesh *mesh_ref, 
@@ -1408,20 +1961,14 @@ void adapt_plotting(Mesh *mesh, ElemPtr2 *ref_elem_pairs,
 }
 
 void copy_mesh_to_vector(Mesh *mesh, double *y, int sln) {
-  Element *e;
-  Iterator *I = new Iterator(mesh);
-  while ((e = I->next_active_element()) != NULL) {
-    e->copy_coeffs_to_vector(y, sln);
-  }
-  delete I;
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+  for (int m=0; m < n_elem; m++) elems[m]->copy_coeffs_to_vector(y, sln);
 }
 
 void copy_vector_to_mesh(double *y, Mesh *mesh, int sln) 
 {
-  Element *e;
-  Iterator *I = new Iterator(mesh);
-  while ((e = I->next_active_element()) != NULL) {
-    e->get_coeffs_from_vector(y, sln);
-  }
-  delete I;
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_elem = elems.size();
+  for (int m=0; m < n_elem; m++) elems[m]->get_coeffs_from_vector(y, sln);
 }
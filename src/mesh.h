@@ -6,24 +6,110 @@
 #ifndef _MESH_H_
 #define _MESH_H_
 
+#include <vector>
+#include <map>
+
 #include "common.h"
 #include "legendre.h"
 #include "lobatto.h"
 
+class Element;
+
+// Storage of the elements of a mesh and of their dof and coeffs arrays.
+// Memory is taken from large chunks, so elements that are created
+// together (base elements, pairs of sons) lie next to each other.
+// Blocks given back by release() are reused for blocks of the same
+// size, everything else is freed when the arena is destroyed.
+// Not thread-safe.
+class ElemArena {
+public:
+    ElemArena();
+    ~ElemArena() {
+        this->free_all();
+    }
+    // Returns zero-initialized memory of 'size' bytes.
+    void *alloc(size_t size);
+    void release(void *ptr, size_t size);
+    // Returns 'n' contiguous default elements owned by the arena.
+    Element *new_elements(int n);
+    void free_all();
+    // Number of bytes taken from the system.
+    size_t get_size() {
+        return this->size;
+    }
+    // Changes whenever elements get new sons or are freed (used to 
+    // invalidate the list of active elements of the mesh).
+    unsigned get_tree_version() {
+        return this->tree_version;
+    }
+    void tree_changed() {
+        this->tree_version++;
+    }
+
+private:
+    std::vector<char*> chunks;
+    size_t chunk_used, chunk_size, size;
+    unsigned tree_version;
+    std::map<size_t, std::vector<void*> > free_blocks;
+};
+
+// Rows of the dof array of an element, e->dof[c] is the row of
+// component 'c'.
+class ElemDofArray {
+public:
+    int *operator[](int c) const {
+        return this->data + c*this->n;
+    }
+    int *data;
+    int n;             // row length (at least p+1)
+};
+
+// Rows of the coeffs array of one solution, e->coeffs[sln][c] 
+// is the row of component 'c'.
+class ElemCoeffRows {
+public:
+    double *operator[](int c) const {
+        return this->data + c*this->n;
+    }
+    double *data;
+    int n;
+};
+
+class ElemCoeffArray {
+public:
+    ElemCoeffRows operator[](int sln) const {
+        ElemCoeffRows rows;
+        rows.data = this->data + sln*this->n_eq*this->n;
+        rows.n = this->n;
+        return rows;
+    }
+    double *data;
+    int n;             // row length (at least p+1)
+    int n_eq;
+};
+
 class Element {
 public:
     Element();
     Element(double x_left, double x_right, int level, int deg, 
             int n_eq, int n_sln, int marker);
+    // Elements owned by a mesh (created by an ElemArena) are freed 
+    // together with the mesh, only standalone elements free their 
+    // sons and arrays.
     void free_element() {
+        if (this->arena != NULL) return;
         if (this->sons[0] != NULL) delete this->sons[0];
         if (this->sons[1] != NULL) delete this->sons[1];
     }
     ~Element() {
         this->free_element();
+        if (this->arena == NULL) this->free_arrays();
     }
     void init(double x1, double x2, int p_init, 
 	      int id, int active, int level, int n_eq, int n_sln, int marker);
+    // Sets the poly degree and enlarges the dof and coeffs arrays 
+    // if needed (existing entries are kept, new ones are zero).
+    void resize(int p);
     void copy_into(Element *e_trg);
     void copy_recursively_into(Element *e_trg);
     double get_x_phys(double x_ref); // gets physical coordinate of a reference poin
@@ -31,18 +117,26 @@ public:
     void get_coeffs_from_vector(double *y, int sln=0);
     void copy_coeffs_to_vector(double *y, int sln=0);
     void copy_dofs(int sln_src, int sln_trg);
+    // If 'local_coeffs' is given, it is used instead of the coeffs 
+    // array of solution 'sln', local_coeffs[c*(p+1) + j] is the 
+    // coefficient of shape function 'j' of component 'c'.
     void get_solution_quad(int flag, int quad_order, 
                            double val_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
-			   double der_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], int sln=0);
+			   double der_phys[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], int sln=0,
+                           double *local_coeffs=NULL);
     void get_solution_plot(double x_phys[MAX_PLOT_PTS_NUM], int pts_num,
          double val_phys[MAX_EQN_NUM][MAX_PLOT_PTS_NUM], 
 			   double der_phys[MAX_EQN_NUM][MAX_PLOT_PTS_NUM], int sln=0);
     void get_solution_point(double x_phys, 
-			    double val[MAX_EQN_NUM], double der[MAX_EQN_NUM], int sln=0);
+			    double val[MAX_EQN_NUM], double der[MAX_EQN_NUM], int sln=0,
+                            double *local_coeffs=NULL);
     int create_cand_list(int adapt_type, int p_ref_left, int p_ref_right, int3 *cand_list);
     void print_cand_list(int num_cand, int3 *cand_list);
     void refine(int3 cand);
     void refine(int type, int p_left, int p_right);
+    // Undoes the hp-refinement of the element: the (active) sons are 
+    // freed and the element becomes active again.
+    void unrefine();
     unsigned is_active();
     unsigned active;   // flag used by assembling algorithm
     double x1, x2;     // endpoints
@@ -50,17 +144,64 @@ public:
     int marker;        // can be used to distinguish between material parameters
     int n_eq;          // number of equations (= number of solution components)
     int n_sln;         // number of solution copies
-    int dof[MAX_EQN_NUM][MAX_P + 1];   // connectivity array of length p+1 
-                                       // for every solution component
-    double coeffs[MAX_SLN_NUM][MAX_EQN_NUM][MAX_P + 1];   // solution coefficient array of length p+1 
-                                                          // for every component and every solution 
+    ElemDofArray dof;      // connectivity array of length p+1 
+                           // for every solution component
+    ElemCoeffArray coeffs; // solution coefficient array of length p+1 
+                           // for every component and every solution 
     int id;
     unsigned level;    // refinement level (zero for initial mesh elements) 
+    int dof_p;         // poly degree at the last numbering of dofs (-1 if 
+                       // never numbered), see Mesh::assign_dofs_incremental()
     Element *sons[2];  // for refinement
+    ElemArena *arena;  // owner of the element (NULL if standalone)
+
+private:
+    // Elements own their dof and coeffs arrays, hence they must not
+    // be copied by value (use copy_into() instead). Not implemented.
+    Element(const Element &e);
+    Element &operator=(const Element &e);
+    void alloc_arrays(int n);
+    void free_arrays();
+    size_t get_arrays_size(int n);
+    void alloc_sons();
 };
 
 typedef Element* ElemPtr2[2];
 
+// Array of element pairs that grows with the mesh, one pair per active 
+// element (e.g. the reference elements of the fast trial refinement, 
+// see FTRSolver::solve(), adapt() and adapt_plotting()). The elements 
+// are allocated by resize() and deleted together with the array.
+class ElemPairArray {
+public:
+    ElemPairArray() : pairs(NULL), size(0) {}
+    ~ElemPairArray();
+    // Makes room for at least 'n' pairs, existing pairs are kept.
+    void resize(int n);
+    int get_size() {
+        return this->size;
+    }
+    ElemPtr2 *get_pairs() {
+        return this->pairs;
+    }
+
+private:
+    // Not implemented (the array owns its elements).
+    ElemPairArray(const ElemPairArray &a);
+    ElemPairArray &operator=(const ElemPairArray &a);
+    ElemPtr2 *pairs;
+    int size;
+};
+
+// One refinement recorded in the journal of a mesh (also used 
+// for the incremental numbering of dofs).
+struct MeshJournalEntry {
+    Element *e;
+    int type;          // 0... p-refinement, 1... hp-refinement
+    int p;             // poly degree before the refinement
+    int coeffs_start;  // old coefficients in the journal (p-refinement)
+};
+
 class Mesh;
 
 void copy_mesh_to_vector(Mesh *mesh, double *y, int sln=0);
@@ -82,19 +223,59 @@ class Mesh {
         Mesh(int n_macro_elem, double *pts_array, int *p_array, int *m_array, 
              int *div_array, int n_eq=1, int n_sln=1, bool print_banner=true);
         ~Mesh() {
-            if (this->base_elems != NULL) {
-                delete[] this->base_elems;
-            }
+            this->free_elements();
         }
         void free_elements() {
-            if (this->base_elems != NULL) {
-                delete[] this->base_elems;
-            }
+            this->arena.free_all();
+            this->base_elems = NULL;
+            this->active_elems.clear();
+            this->active_elem_vertices.clear();
+            this->active_elems_valid = false;
+            this->journal.clear();
+            this->journal_coeffs.clear();
+            this->dofs_valid = false;
+            this->dof_changes.clear();
         }
         int assign_dofs();
+        // Renumbers the dofs after refinements done through the mesh 
+        // (refine_elem(), refine_single_elem(), refine_elems(), 
+        // reference_refinement(), adapt()) since the last numbering, 
+        // the result is the same as by assign_dofs(). With 
+        // DOF_ORDERING_ELEMENTS only the dofs from the first refined 
+        // element on are renumbered and only the ids of the elements 
+        // from there on are reassigned. If 'dof_map' is given, 
+        // (*dof_map)[i] is the new number of the old dof 'i', or -1 if 
+        // the dof was removed (bubbles of split elements and bubbles 
+        // above a lowered poly degree), so vectors and matrix patterns 
+        // can be updated instead of rebuilt. If there is no valid 
+        // numbering to start from (dofs were never assigned, boundary 
+        // conditions or dof ordering were changed, or elements were 
+        // refined directly by Element::refine(), Element::resize() or 
+        // by setting e->p), all dofs are numbered again and all entries 
+        // of 'dof_map' are -1.
+        int assign_dofs_incremental(std::vector<int> *dof_map=NULL);
+        // Dofs of the active elements as disjoint index sets, one per 
+        // element: the left vertex and bubble dofs of all components 
+        // (the last element also gets its right vertex). These are the 
+        // blocks for CG_PRECOND_BLOCK_JACOBI (CommonSolverCG::set_blocks()).
+        void get_elem_dof_blocks(std::vector<std::vector<int> > &blocks);
+        // DOF_ORDERING_COMPONENTS (default): all vertex dofs of component 0,
+        //   then all its bubble dofs, then the next component.
+        // DOF_ORDERING_ELEMENTS: element by element from left to right, 
+        //   the dofs of all components of an element are contiguous 
+        //   (left vertex, bubbles, right vertex). This gives a banded 
+        //   matrix also for systems (see CommonSolverBandLU).
+        void set_dof_ordering(int dof_ordering);
+        int get_dof_ordering() {
+            return this->dof_ordering;
+        }
         Element *get_base_elems() {
             return this->base_elems;
         }
+        // Memory taken by the elements (in bytes).
+        size_t get_elem_memory_size() {
+            return this->arena.get_size();
+        }
         int get_n_base_elem() {
             return this->n_base_elem;
         }
@@ -113,6 +294,15 @@ class Mesh {
         void set_n_dof(int n) {
             this->n_dof = n;
         }
+        // Changes whenever the dofs are numbered (assign_dofs(), 
+        // assign_dofs_incremental()), used with get_tree_version() to 
+        // detect stale matrix patterns.
+        unsigned get_dof_version() {
+            return this->dof_version;
+        }
+        unsigned get_tree_version() {
+            return this->arena.get_tree_version();
+        }
         int get_n_eq() {
             return this->n_eq;
         }
@@ -139,12 +329,57 @@ class Mesh {
         }
         Element* first_active_element();
         Element* last_active_element();
+        // Active elements from left to right. After assign_dofs() or 
+        // assign_elem_ids(), e->id is the index of 'e' in this array. 
+        // The array is rebuilt only when the refinement tree has 
+        // changed, so call it once before a parallel loop.
+        std::vector<Element*> &get_active_elems();
+        Element *get_active_elem(int i) {
+            return this->get_active_elems()[i];
+        }
+        // Index (in get_active_elems()) of the active element that 
+        // contains the point 'x', found by binary search over the 
+        // element endpoints. A vertex shared by two elements belongs 
+        // to the right one. Returns -1 if 'x' lies outside of the mesh.
+        int locate_point(double x);
+        // Evaluates solution 'sln' and its derivative at 'n_pts' points 
+        // 'x', val[i*n_eq + c] and der[i*n_eq + c] are the values at 
+        // point 'i' for component 'c' ('der' can be NULL). Points in 
+        // ascending order are located in one sweep over the elements, 
+        // the others by binary search.
+        void get_solution_points(int n_pts, double *x, double *val, 
+                                 double *der=NULL, int sln=0);
         void set_bc_left_dirichlet(int eqn, double val);
         void set_bc_right_dirichlet(int eqn, double val);
         void refine_single_elem(int id, int3 cand);
         void refine_elems(int elem_num, int *id_array, int3 *cand_array);
         void reference_refinement(int start_elem_id, int elem_num);
+        // Refines the active element 'e' of the mesh (see 
+        // Element::refine()) and records the change in the journal.
+        void refine_elem(Element *e, int3 cand);
+        // Journal of refinements: after start_journal(), every 
+        // refinement done through the mesh (also by adapt()) is recorded 
+        // with the old poly degree and, for p-refinements, the old 
+        // coefficients. undo_refinements() takes the recorded changes 
+        // back in reverse order and reassigns the dofs, so the previous 
+        // mesh is restored without keeping a copy of it. The solution 
+        // on the elements that were not refined is not recorded (use 
+        // copy_mesh_to_vector() to keep it). stop_journal() accepts the 
+        // changes and stops recording.
+        void start_journal();
+        void stop_journal();
+        void undo_refinements();
+        int get_journal_size() {
+            return this->journal.size();
+        }
         Mesh *replicate(); 
+        // Copies of the active elements 'start_elem_id', ..., 
+        // 'start_elem_id + elem_num - 1' with their solutions, as the 
+        // base elements of a new mesh. Dirichlet conditions at the end 
+        // points of the domain are kept, at the end points of the patch 
+        // inside of the domain all solution components are fixed to 
+        // their values (Dirichlet conditions). Dofs are assigned.
+        Mesh *extract_patch(int start_elem_id, int elem_num);
         void plot(const char* filename); // plots the mesh and polynomial degrees of elements
         void plot_element_error_p(int norm, FILE *f, Element *p, Element *e_ref,  
                                   int subdivision = 20); // plots error wrt. reference solution
@@ -172,30 +407,62 @@ class Mesh {
         }
 
     private:
+        // numbers the dofs of elems[m_start], elems[m_start+1], ... 
+        // starting with 'count_dof', returns the number of dofs
+        int number_dofs(std::vector<Element*> &elems, int m_start, 
+                        int count_dof);
+
         double left_endpoint, right_endpoint;
         int n_eq;            // number of equations in the system
         int n_sln;           // number of solution copies
         int n_base_elem;     // number of elements in the base mesh
         int n_dof;           // number of DOF (in each solution copy)
+        int dof_ordering;    // DOF_ORDERING_COMPONENTS or DOF_ORDERING_ELEMENTS
         Element *base_elems; // base mesh
+        ElemArena arena;     // all elements and their dof and coeffs arrays
+        std::vector<Element*> active_elems; // see get_active_elems()
+        std::vector<double> active_elem_vertices; // x1 of all active 
+                                                  // elements and x2 of the last
+        bool active_elems_valid;
+        unsigned active_elems_version;   // arena tree version of active_elems
+        bool journal_on;     // see start_journal()
+        std::vector<MeshJournalEntry> journal;
+        std::vector<double> journal_coeffs;
+        bool dofs_valid;     // see assign_dofs_incremental()
+        unsigned dofs_tree_version; // arena tree version of the numbering
+        std::vector<MeshJournalEntry> dof_changes; // refinements since then
+        unsigned dof_version; // see get_dof_version()
 
 };
 
 // Returns updated coarse and reference meshes, with the last 
 // coarse and reference mesh solutions on them, respectively. 
 // The coefficient vectors and numbers of degrees of freedom 
-// on both meshes are also updated. 
+// on both meshes are also updated. The meshes are refined in 
+// place (the pointers do not change), use Mesh::start_journal() 
+// to be able to go back to the previous meshes.
+// The refinements of the elements are selected in 'num_threads' 
+// threads (OpenMP), then they are performed in one thread.
 void adapt(int norm, int adapt_type, double threshold, 
            double *err_squared_array,
-           Mesh* &mesh, Mesh* &mesh_ref);
+           Mesh* &mesh, Mesh* &mesh_ref, int num_threads=1);
 
 // Returns updated coarse mesh, with the last 
 // coarse solution on it. 
 // The coefficient vector and number of degrees of freedom 
-// also is updated. 
+// also is updated. The mesh is refined in place.
 void adapt(int norm, int adapt_type, double threshold, 
            double *err_array, 
-           Mesh* &mesh, ElemPtr2 *ref_elem_pairs);
+           Mesh* &mesh, ElemPtr2 *ref_elem_pairs, int num_threads=1);
+
+// The same with 'err_array' of length at least the number 
+// of active elements (see calc_error_estimate()).
+void adapt(int norm, int adapt_type, double threshold, 
+           std::vector<double> &err_array,
+           Mesh* &mesh, Mesh* &mesh_ref, int num_threads=1);
+void adapt(int norm, int adapt_type, double threshold, 
+           std::vector<double> &err_array, 
+           Mesh* &mesh, ElemPtr2 *ref_elem_pairs, int num_threads=1);
 
 void adapt_plotting(Mesh *mesh, Mesh *mesh_ref,
                     int norm, int exact_sol_provided, 
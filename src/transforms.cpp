@@ -136,6 +136,12 @@ void fill_trans_matrices(TransMatrix trans_matrix_left,
     fprintf(stderr, "done.\n");
 }
 
+// (see init_once_locked())
+static void init_trans_matrices(int)
+{
+    fill_trans_matrices(trans_matrix_left, trans_matrix_right);
+}
+
 // Transfers solution from coarse mesh element 'e' to a pair of fine mesh elements 
 // 'e_ref_left' and 'e_ref_right' (obtained via hp-refinement of 'e'). Result are 
 // new solution coefficients on 'e_ref_left' and 'e_ref_right'. 
@@ -172,10 +178,8 @@ void transform_element_refined_forward(int sln, int comp, Element *e, Element *e
     }
     printf("\n");
   }
-  if (trans_matrices_initialized == 0) {
-    fill_trans_matrices(trans_matrix_left, trans_matrix_right);
-    trans_matrices_initialized = 1;
-  }
+  if (!init_done(&trans_matrices_initialized)) 
+    init_once_locked(&trans_matrices_initialized, init_trans_matrices, 0);
   // transform coefficients on the left son
   for (int i=0; i < fns_num_coarse; i++) {
       y_prev_loc_trans_left[i] = 0.;
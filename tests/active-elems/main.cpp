@@ -0,0 +1,92 @@
+#include "hermes1d.h"
+
+// This test makes sure that the list of active elements cached in
+// the mesh agrees with the element tree (Iterator) before and after
+// refinements, and that elements can be found by their ids.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+int N_elem = 10;                        // Number of elements
+int N_eq = 2;                           // Number of equations
+double A = 0, B = 1;                    // Domain end points
+int P_init = 2;                         // Initial polynomal degree
+
+// returns the number of differences between the cached list 
+// and the traversal of the element tree
+int check_active_elems(Mesh *mesh)
+{
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  Iterator I(mesh);
+  Element *e;
+  int n_wrong = 0, count = 0;
+  while ((e = I.next_active_element()) != NULL) {
+    if (count >= (int)elems.size() || elems[count] != e) n_wrong++;
+    else if (mesh->get_active_elem(e->id) != e) n_wrong++;
+    count++;
+  }
+  if (count != (int)elems.size()) n_wrong++;
+  if (count != mesh->get_n_active_elem()) n_wrong++;
+  return n_wrong;
+}
+
+int main()
+{
+  int ok = 1;
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->assign_dofs();
+  int n_wrong = check_active_elems(mesh);
+  printf("initial mesh: %d wrong\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // p-refinement does not change the list
+  int3 cand_p = {0, P_init + 1, 0};
+  mesh->refine_single_elem(3, cand_p);
+  if (mesh->get_active_elem(3)->p != P_init + 1) ok = 0;
+
+  // hp-refinement by id, the list is updated without assign_dofs()
+  int3 cand = {1, P_init, P_init + 1};
+  mesh->refine_single_elem(5, cand);
+  Element *e = mesh->get_active_elem(5);
+  if (e->level != 1 || e->p != P_init || 
+      mesh->get_active_elem(6)->p != P_init + 1) ok = 0;
+  mesh->assign_dofs();
+  n_wrong = check_active_elems(mesh);
+  printf("after single refinement: %d wrong\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // several refinements, the sons of element 0 are split again
+  int id_array[3] = {0, 1, 7};
+  int3 cand_array[3] = {{1, 2, 2}, {1, 3, 3}, {0, 4, 0}};
+  mesh->refine_elems(3, id_array, cand_array);
+  mesh->assign_dofs();
+  int3 cand_son = {1, 1, 1};
+  mesh->refine_single_elem(0, cand_son);
+  mesh->assign_dofs();
+  n_wrong = check_active_elems(mesh);
+  printf("after multiple refinements: %d wrong\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+  if (mesh->get_active_elem(0)->level != 2) ok = 0;
+
+  // reference refinement and replication
+  Mesh *mesh_ref = mesh->replicate();
+  n_wrong = check_active_elems(mesh_ref);
+  mesh_ref->reference_refinement(0, mesh_ref->get_n_active_elem());
+  n_wrong += check_active_elems(mesh_ref);
+  printf("reference mesh: %d wrong\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+  if (mesh_ref->get_n_active_elem() != 2*mesh->get_n_active_elem()) ok = 0;
+  delete mesh_ref;
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
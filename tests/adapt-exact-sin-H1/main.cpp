@@ -146,7 +146,7 @@ int main() {
 
     // In the next step, estimate element errors based on 
     // the difference between the fine mesh and coarse mesh solutions. 
-    double err_est_array[MAX_ELEM_NUM]; 
+    std::vector<double> err_est_array; 
     double err_est_total = calc_error_estimate(NORM, mesh, mesh_ref, 
                            err_est_array);
 
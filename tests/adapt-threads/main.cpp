@@ -0,0 +1,173 @@
+#include "hermes1d.h"
+
+// This test makes sure that adapt() selects the same refinements
+// when the candidates are evaluated in several threads, both for
+// reference meshes and for reference element pairs, and with
+// reference p-refinement and hp-refinement of the elements.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 40;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 1;                         // Initial polynomal degree
+int N_threads = 4;                      // Number of threads
+int N_adapt = 3;                        // Number of adaptivity steps
+
+// Tolerance for Newton's method
+double NEWTON_TOL = 1e-8;
+int NEWTON_MAXITER = 10;
+
+// Adaptivity
+const int NORM = 1;
+const int ADAPT_TYPE = 0;
+const double THRESHOLD = 0.3;
+
+// L2 projection of g(x) = atan(K*(x - 1/2))
+double K = 50;
+double g(double x)
+{
+  return atan(K*(x - 0.5));
+}
+
+// bilinear form for the Jacobi matrix
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += u[i]*v[i]*weights[i];
+  }
+  return val;
+};
+
+// (nonlinear) form for the residual vector
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (u_prev[0][0][i] - g(x[i]))*v[i]*weights[i];
+  }
+  return val;
+};
+
+// number of differences between the active elements of two meshes
+int compare_meshes(Mesh *mesh1, Mesh *mesh2)
+{
+  std::vector<Element*> &elems1 = mesh1->get_active_elems();
+  std::vector<Element*> &elems2 = mesh2->get_active_elems();
+  if (elems1.size() != elems2.size()) return 1;
+  int n_wrong = 0;
+  for (int m=0; m < (int)elems1.size(); m++) {
+    if (elems1[m]->x1 != elems2[m]->x1 || elems1[m]->x2 != elems2[m]->x2 ||
+        elems1[m]->p != elems2[m]->p) n_wrong++;
+  }
+  return n_wrong;
+}
+
+// reference mesh: even elements are p-refined, odd elements hp-refined
+Mesh *create_ref_mesh(Mesh *mesh)
+{
+  Mesh *mesh_ref = mesh->replicate();
+  std::vector<Element*> elems = mesh_ref->get_active_elems();
+  for (int m=0; m < (int)elems.size(); m++) {
+    int p = elems[m]->p;
+    if (m % 2 == 0) elems[m]->refine(0, p + 1, -1);
+    else {
+      elems[m]->refine(1, p, p);
+      mesh_ref->set_n_active_elem(mesh_ref->get_n_active_elem() + 1);
+    }
+  }
+  mesh_ref->assign_dofs();
+  return mesh_ref;
+}
+
+int main() {
+#ifndef H1D_WITH_OPENMP
+  // without OpenMP, both runs would be serial and compare nothing
+  printf("Built without OpenMP (WITH_OPENMP=NO), skipping the test.\n");
+  printf("Success!\n");
+  return ERROR_SUCCESS;
+#endif
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+  CommonSolverBandLU solver;
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->assign_dofs();
+  for (int step=0; step < N_adapt; step++) {
+    newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    Mesh *mesh_ref = create_ref_mesh(mesh);
+    newton(dp, mesh_ref, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    std::vector<double> err_est_array;
+    calc_error_estimate(NORM, mesh, mesh_ref, err_est_array);
+
+    // reference element pairs (taken before adapt() deletes mesh_ref)
+    Mesh *mesh_pairs = mesh->replicate();
+    Mesh *mesh_pairs_serial = mesh->replicate();
+    Mesh *mesh_ref_pairs = mesh_ref->replicate();
+    std::vector<Element*> &elems = mesh->get_active_elems();
+    std::vector<Element*> &elems_ref = mesh_ref_pairs->get_active_elems();
+    int n_elem = elems.size();
+    ElemPtr2 *ref_elem_pairs = new ElemPtr2[n_elem];
+    for (int m=0, r=0; m < n_elem; m++) {
+      ref_elem_pairs[m][0] = elems_ref[r++];
+      ref_elem_pairs[m][1] = (elems[m]->level == ref_elem_pairs[m][0]->level) ?
+                             NULL : elems_ref[r++];
+    }
+
+    // serial and parallel selection with reference meshes
+    Mesh *mesh_serial = mesh->replicate();
+    Mesh *mesh_ref_serial = mesh_ref->replicate();
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh_serial,
+          mesh_ref_serial, 1);
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh, mesh_ref,
+          N_threads);
+    int n_wrong = compare_meshes(mesh, mesh_serial) +
+                  compare_meshes(mesh_ref, mesh_ref_serial);
+    printf("step %d: %d elements, %d differences (reference meshes)\n",
+           step, mesh->get_n_active_elem(), n_wrong);
+    if (n_wrong > 0) ok = 0;
+    if (mesh->get_n_active_elem() <= n_elem) ok = 0;
+
+    // the same with reference element pairs
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh_pairs_serial,
+          ref_elem_pairs, 1);
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh_pairs,
+          ref_elem_pairs, N_threads);
+    n_wrong = compare_meshes(mesh_pairs, mesh_pairs_serial) +
+              compare_meshes(mesh_pairs, mesh);
+    printf("step %d: %d differences (reference element pairs)\n",
+           step, n_wrong);
+    if (n_wrong > 0) ok = 0;
+
+    delete mesh_serial;
+    delete mesh_ref_serial;
+    delete mesh_pairs;
+    delete mesh_pairs_serial;
+    delete [] ref_elem_pairs;
+    delete mesh_ref_pairs;
+    delete mesh_ref;
+  }
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
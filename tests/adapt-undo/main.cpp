@@ -0,0 +1,169 @@
+#include "hermes1d.h"
+
+// This test makes sure that adapt() refines the meshes in place, and
+// that Mesh::undo_refinements() restores the previous meshes (poly
+// degrees, elements and dofs, the solutions are saved in vectors),
+// both for reference meshes and for reference element pairs.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 20;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 1;                         // Initial polynomal degree
+int N_adapt = 3;                        // Number of adaptivity steps
+
+// Tolerance for Newton's method
+double NEWTON_TOL = 1e-8;
+int NEWTON_MAXITER = 10;
+
+// Adaptivity
+const int NORM = 1;
+const int ADAPT_TYPE = 0;
+const double THRESHOLD = 0.3;
+
+// L2 projection of g(x) = atan(K*(x - 1/2))
+double K = 50;
+double g(double x)
+{
+  return atan(K*(x - 0.5));
+}
+
+// bilinear form for the Jacobi matrix
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += u[i]*v[i]*weights[i];
+  }
+  return val;
+};
+
+// (nonlinear) form for the residual vector
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (u_prev[0][0][i] - g(x[i]))*v[i]*weights[i];
+  }
+  return val;
+};
+
+// number of differences between the active elements of two meshes
+// (including the dof and coeffs arrays)
+int compare_meshes(Mesh *mesh1, Mesh *mesh2)
+{
+  std::vector<Element*> &elems1 = mesh1->get_active_elems();
+  std::vector<Element*> &elems2 = mesh2->get_active_elems();
+  if (elems1.size() != elems2.size() ||
+      mesh1->get_n_active_elem() != mesh2->get_n_active_elem() ||
+      mesh1->get_n_dof() != mesh2->get_n_dof()) return 1;
+  int n_wrong = 0;
+  for (int m=0; m < (int)elems1.size(); m++) {
+    Element *e1 = elems1[m], *e2 = elems2[m];
+    if (e1->x1 != e2->x1 || e1->x2 != e2->x2 || e1->p != e2->p) {
+      n_wrong++;
+      continue;
+    }
+    for (int j=0; j <= e1->p; j++) {
+      if (e1->dof[0][j] != e2->dof[0][j]) n_wrong++;
+      if (e1->coeffs[0][0][j] != e2->coeffs[0][0][j]) n_wrong++;
+    }
+  }
+  return n_wrong;
+}
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+  CommonSolverBandLU solver;
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->assign_dofs();
+  for (int step=0; step < N_adapt; step++) {
+    newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    Mesh *mesh_ref = mesh->replicate();
+    mesh_ref->reference_refinement(0, mesh->get_n_active_elem());
+    newton(dp, mesh_ref, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    std::vector<double> err_est_array;
+    calc_error_estimate(NORM, mesh, mesh_ref, err_est_array);
+
+    // reference element pairs
+    std::vector<Element*> &elems_ref = mesh_ref->get_active_elems();
+    int n_elem = mesh->get_n_active_elem();
+    ElemPtr2 *ref_elem_pairs = new ElemPtr2[n_elem];
+    for (int m=0; m < n_elem; m++) {
+      ref_elem_pairs[m][0] = elems_ref[2*m];
+      ref_elem_pairs[m][1] = elems_ref[2*m + 1];
+    }
+
+    // copies of the meshes and solutions before adaptivity
+    Mesh *mesh_old = mesh->replicate();
+    Mesh *mesh_ref_old = mesh_ref->replicate();
+    std::vector<double> y(mesh->get_n_dof()), y_ref(mesh_ref->get_n_dof());
+    copy_mesh_to_vector(mesh, &y[0]);
+    copy_mesh_to_vector(mesh_ref, &y_ref[0]);
+
+    // adapt both meshes, solve on them and go back
+    Mesh *mesh_ptr = mesh, *mesh_ref_ptr = mesh_ref;
+    mesh->start_journal();
+    mesh_ref->start_journal();
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh, mesh_ref);
+    if (mesh != mesh_ptr || mesh_ref != mesh_ref_ptr) ok = 0;
+    if (mesh->get_n_dof() <= mesh_old->get_n_dof()) ok = 0;
+    int n_refined = mesh->get_journal_size();
+    newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    newton(dp, mesh_ref, &solver, NEWTON_TOL, NEWTON_MAXITER);
+    mesh->undo_refinements();
+    mesh_ref->undo_refinements();
+    copy_vector_to_mesh(&y[0], mesh);
+    copy_vector_to_mesh(&y_ref[0], mesh_ref);
+    int n_wrong = compare_meshes(mesh, mesh_old) +
+                  compare_meshes(mesh_ref, mesh_ref_old);
+    printf("step %d: %d elements refined, %d differences after undo "
+           "(reference meshes)\n", step, n_refined, n_wrong);
+    if (n_refined == 0 || n_wrong > 0) ok = 0;
+
+    // the same with reference element pairs
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh, ref_elem_pairs);
+    if (mesh->get_n_dof() <= mesh_old->get_n_dof()) ok = 0;
+    mesh->undo_refinements();
+    n_wrong = compare_meshes(mesh, mesh_old);
+    printf("step %d: %d differences after undo (reference element pairs)\n",
+           step, n_wrong);
+    if (n_wrong > 0) ok = 0;
+
+    // keep the refinements for the next step
+    mesh->stop_journal();
+    mesh_ref->stop_journal();
+    adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh, mesh_ref);
+    if (mesh->get_journal_size() > 0) ok = 0;
+
+    delete [] ref_elem_pairs;
+    delete mesh_old;
+    delete mesh_ref_old;
+    delete mesh_ref;
+  }
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
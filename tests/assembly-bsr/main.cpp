@@ -0,0 +1,150 @@
+#include "hermes1d.h"
+
+// This test makes sure that the assembly of a system into a BSR matrix
+// (DiscreteProblem::create_bsr_matrix()) gives the same Jacobi matrix
+// as the assembly into a PatternCSCMatrix, for both dof orderings and
+// with several threads, that the block product agrees with the CSC
+// product, and that the direct solvers (via the conversion to CSC)
+// give the same solution.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 3;
+int N_elem = 30;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 4;                         // Initial polynomal degree
+int N_threads = 2;                      // Number of threads
+
+// -u_c'' + sum_d K[c][d]*u_d = 1, u_c(A) = 0 for all c
+double K[3][3] = {{4, 1, 0.5}, {1, 3, 1}, {0.5, 1, 5}};
+
+template<int c, int d>
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += ((c == d ? dudx[i]*dvdx[i] : 0) + (1 + x[i])*K[c][d]*u[i]*v[i])
+           *weights[i];
+  }
+  return val;
+};
+
+template<int c>
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    double ku = 0;
+    for (int d=0; d < N_eq; d++) ku += (1 + x[i])*K[c][d]*u_prev[0][d][i];
+    val += (du_prevdx[0][c][i]*dvdx[i] + (ku - 1)*v[i])*weights[i];
+  }
+  return val;
+};
+
+// surface bilinear form (Newton condition on the right, component 1)
+double jacobian_surf_right(double x, double u, double dudx,
+        double v, double dvdx, double u_prev[MAX_SLN_NUM][MAX_EQN_NUM],
+        double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], void *user_data)
+{
+  return 2*u*v;
+}
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian<0, 0>);
+  dp->add_matrix_form(0, 1, jacobian<0, 1>);
+  dp->add_matrix_form(0, 2, jacobian<0, 2>);
+  dp->add_matrix_form(1, 0, jacobian<1, 0>);
+  dp->add_matrix_form(1, 1, jacobian<1, 1>);
+  dp->add_matrix_form(1, 2, jacobian<1, 2>);
+  dp->add_matrix_form(2, 0, jacobian<2, 0>);
+  dp->add_matrix_form(2, 1, jacobian<2, 1>);
+  dp->add_matrix_form(2, 2, jacobian<2, 2>);
+  dp->add_matrix_form_surf(1, 1, jacobian_surf_right, BOUNDARY_RIGHT);
+  dp->add_vector_form(0, residual<0>);
+  dp->add_vector_form(1, residual<1>);
+  dp->add_vector_form(2, residual<2>);
+
+  for (int ordering=0; ordering < 2; ordering++) {
+    Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+    for (int c=0; c < N_eq; c++) mesh->set_bc_left_dirichlet(c, 0);
+    mesh->set_dof_ordering(ordering == 0 ? DOF_ORDERING_COMPONENTS :
+                                           DOF_ORDERING_ELEMENTS);
+    Element *elems = mesh->get_base_elems();
+    for (int m=0; m < N_elem; m++) elems[m].p = 2 + m % 4;
+    int n_dof = mesh->assign_dofs();
+
+    // CSC and BSR assembly (the BSR one also with threads)
+    PatternCSCMatrix *csc = dp->create_csc_matrix(mesh);
+    PatternBSRMatrix *bsr = dp->create_bsr_matrix(mesh);
+    std::vector<double> res(n_dof), res_bsr(n_dof);
+    dp->assemble_matrix_and_vector(mesh, csc, &res[0]);
+    dp->assemble_matrix_and_vector(mesh, bsr, &res_bsr[0]);
+    int n_wrong = (res != res_bsr);
+    for (int j=0; j < n_dof; j++)
+      for (int k=csc->get_Ap()[j]; k < csc->get_Ap()[j+1]; k++)
+        if (bsr->get(csc->get_Ai()[k], j) != csc->get_Ax()[k]) n_wrong++;
+    std::vector<double> Bx(bsr->get_Bx(), bsr->get_Bx() +
+        bsr->get_nnz_blocks()*N_eq*N_eq);
+    dp->set_num_threads(N_threads);
+    bsr->set_zero();
+    dp->assemble_matrix(mesh, bsr);
+    dp->set_num_threads(1);
+    for (int k=0; k < (int)Bx.size(); k++) if (bsr->get_Bx()[k] != Bx[k]) n_wrong++;
+    printf("ordering %d: %d dofs, %d CSC entries, %d blocks (%d entries), "
+           "%d differences\n", ordering, n_dof, csc->get_nnz(),
+           bsr->get_nnz_blocks(), (int)Bx.size(), n_wrong);
+    if (n_wrong > 0) ok = 0;
+    // with the dofs ordered by elements all blocks are dense
+    if (ordering == 1 && (int)Bx.size() != csc->get_nnz()) ok = 0;
+
+    // block product
+    std::vector<double> vec(n_dof), prod(n_dof), prod_bsr(n_dof);
+    for (int i=0; i < n_dof; i++) vec[i] = cos(1.0*i);
+    csc->times_vector(&vec[0], &prod[0], n_dof);
+    bsr->times_vector(&vec[0], &prod_bsr[0], n_dof);
+    double max_diff = 0;
+    for (int i=0; i < n_dof; i++)
+      max_diff = std::max(max_diff, fabs(prod[i] - prod_bsr[i]));
+    printf("ordering %d: block product max difference %g\n", ordering,
+           max_diff);
+    if (max_diff > 1e-12) ok = 0;
+
+    // direct solver with the conversion to CSC
+    CommonSolverBandLU solver;
+    solver.set_quiet(true);
+    std::vector<double> sln(res), sln_bsr(res);
+    solver._solve(csc, &sln[0]);
+    solver._solve(bsr, &sln_bsr[0]);
+    max_diff = 0;
+    for (int i=0; i < n_dof; i++)
+      max_diff = std::max(max_diff, fabs(sln[i] - sln_bsr[i]));
+    printf("ordering %d: solution max difference %g\n", ordering, max_diff);
+    if (max_diff > 1e-10) ok = 0;
+
+    delete csc;
+    delete bsr;
+    delete mesh;
+  }
+  delete dp;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
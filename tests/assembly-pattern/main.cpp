@@ -0,0 +1,139 @@
+#include "../two_eq_system.h"
+
+// This test makes sure that repeated assembly into a PatternCSCMatrix 
+// (fixed sparsity pattern, value-only reassembly) gives the same Jacobi 
+// matrix as the assembly into a CooMatrix, also after the solution 
+// changes and with several threads, and that the pattern is recognized
+// as stale after an in-place refinement or a renumbering of the dofs.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// surface bilinear form (Newton condition on the right)
+double jacobian_surf_right(double x, double u, double dudx,
+        double v, double dvdx, double u_prev[MAX_SLN_NUM][MAX_EQN_NUM], 
+        double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], void *user_data)
+{
+  return 2*u*v;
+}
+
+/******************************************************************************/
+
+// Compares all entries of 'mat' with the CooMatrix 'coo'. Entries 
+// missing in 'coo' must be zero in 'mat'.
+int compare(CooMatrix *coo, CSCMatrix *mat)
+{
+  int nnz = coo->get_nnz();
+  int *row = new int[nnz];
+  int *col = new int[nnz];
+  double *data = new double[nnz];
+  coo->get_row_col_data(row, col, data);
+  double coo_sum = 0, mat_sum = 0;
+  int ok = 1;
+  for (int k=0; k < nnz; k++) {
+    coo_sum += fabs(data[k]);
+    if (mat->find_position(row[k], col[k]) == -1) {
+      printf("entry (%d, %d) missing in the pattern\n", row[k], col[k]);
+      ok = 0;
+    }
+    else if (mat->get(row[k], col[k]) != data[k]) {
+      printf("entry (%d, %d): %g, expected %g\n", row[k], col[k], 
+             mat->get(row[k], col[k]), data[k]);
+      ok = 0;
+    }
+  }
+  for (int k=0; k < mat->get_nnz(); k++) mat_sum += fabs(mat->get_Ax()[k]);
+  // (entries are summed in a different order)
+  if (fabs(mat_sum - coo_sum) > 1e-10 * coo_sum) {
+    printf("sum of entries %g, expected %g\n", mat_sum, coo_sum);
+    ok = 0;
+  }
+  delete [] row;
+  delete [] col;
+  delete [] data;
+  return ok;
+}
+
+int main() {
+  Mesh *mesh = create_two_eq_mesh();
+  int n_dof = mesh->get_n_dof();
+
+  DiscreteProblem *dp = create_two_eq_problem();
+  dp->add_matrix_form_surf(1, 1, jacobian_surf_right, BOUNDARY_RIGHT);
+
+  // symbolic phase
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh);
+  printf("nnz = %d\n", mat->get_nnz());
+
+  int success_test = 1;
+  double *y = new double[n_dof];
+  double *res = new double[n_dof];
+  double *res_coo = new double[n_dof];
+  for (int step=0; step < 3; step++) {
+    // nontrivial previous solution, different in every step
+    for (int i=0; i < n_dof; i++) y[i] = sin(1. + i + step);
+    copy_vector_to_mesh(y, mesh);
+    dp->set_num_threads(step == 2 ? 4 : 1);
+
+    CooMatrix *coo = new CooMatrix();
+    dp->assemble_matrix_and_vector(mesh, coo, res_coo);
+
+    mat->set_zero();
+    dp->assemble_matrix_and_vector(mesh, mat, res);
+
+    if (!compare(coo, mat)) {
+      printf("step %d: Jacobi matrix differs\n", step);
+      success_test = 0;
+    }
+    if (memcmp(res, res_coo, n_dof*sizeof(double))) {
+      printf("step %d: residual vector differs\n", step);
+      success_test = 0;
+    }
+    delete coo;
+  }
+
+  // In-place changes that keep the number of dofs: the first element 
+  // (p = 2) is split into two linear elements, then the dofs are 
+  // renumbered element-wise. The pattern must be recreated each time.
+  for (int change=0; change < 2; change++) {
+    if (change == 0) {
+      int3 cand = {1, 1, 1};
+      mesh->refine_single_elem(0, cand);
+      mesh->assign_dofs_incremental();
+    }
+    else {
+      mesh->set_dof_ordering(DOF_ORDERING_ELEMENTS);
+      mesh->assign_dofs();
+    }
+    if (mesh->get_n_dof() != n_dof) {
+      printf("change %d: N_dof = %d, expected %d\n", change, 
+             mesh->get_n_dof(), n_dof);
+      success_test = 0;
+    }
+    if (mat->is_valid(mesh)) {
+      printf("change %d: stale pattern not detected\n", change);
+      success_test = 0;
+    }
+    delete mat;
+    mat = dp->create_csc_matrix(mesh);
+
+    CooMatrix *coo = new CooMatrix();
+    dp->assemble_matrix_and_vector(mesh, coo, res_coo);
+    mat->set_zero();
+    dp->assemble_matrix_and_vector(mesh, mat, res);
+    if (!compare(coo, mat)) {
+      printf("change %d: Jacobi matrix differs\n", change);
+      success_test = 0;
+    }
+    delete coo;
+  }
+
+  if (success_test) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,76 @@
+#include "../two_eq_system.h"
+
+// This test makes sure that the volumetric assembly gives bitwise 
+// identical Jacobi matrix and residual vector regardless of the 
+// number of threads used in the element loop.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+/******************************************************************************/
+
+int main() {
+  Mesh *mesh = create_two_eq_mesh();
+  int n_dof = mesh->get_n_dof();
+
+  // Nontrivial previous solution
+  double *y = new double[n_dof];
+  for (int i=0; i < n_dof; i++) y[i] = sin(1. + i);
+  copy_vector_to_mesh(y, mesh);
+
+  DiscreteProblem *dp = create_two_eq_problem();
+
+  // Serial assembly
+  CooMatrix *mat_serial = new CooMatrix();
+  double *res_serial = new double[n_dof];
+  dp->assemble_matrix_and_vector(mesh, mat_serial, res_serial);
+  int nnz = mat_serial->get_nnz();
+  int *row_serial = new int[nnz];
+  int *col_serial = new int[nnz];
+  double *data_serial = new double[nnz];
+  mat_serial->get_row_col_data(row_serial, col_serial, data_serial);
+
+  int success_test = 1;
+  int num_threads[3] = {2, 3, 8};
+  for (int t=0; t < 3; t++) {
+    dp->set_num_threads(num_threads[t]);
+    CooMatrix *mat = new CooMatrix();
+    double *res = new double[n_dof];
+    dp->assemble_matrix_and_vector(mesh, mat, res);
+    if (mat->get_nnz() != nnz) {
+      printf("%d threads: nnz = %d, expected %d\n", num_threads[t], 
+             mat->get_nnz(), nnz);
+      success_test = 0;
+    }
+    else {
+      int *row = new int[nnz];
+      int *col = new int[nnz];
+      double *data = new double[nnz];
+      mat->get_row_col_data(row, col, data);
+      if (memcmp(row, row_serial, nnz*sizeof(int)) ||
+          memcmp(col, col_serial, nnz*sizeof(int)) ||
+          memcmp(data, data_serial, nnz*sizeof(double))) {
+        printf("%d threads: Jacobi matrix differs\n", num_threads[t]);
+        success_test = 0;
+      }
+      delete [] row;
+      delete [] col;
+      delete [] data;
+    }
+    if (memcmp(res, res_serial, n_dof*sizeof(double))) {
+      printf("%d threads: residual vector differs\n", num_threads[t]);
+      success_test = 0;
+    }
+    delete mat;
+    delete [] res;
+  }
+
+  if (success_test) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
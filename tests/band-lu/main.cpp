@@ -0,0 +1,58 @@
+#include "../two_eq_system.h"
+
+// This test makes sure that the element-wise dof ordering gives a 
+// banded matrix for a system of equations and that the Newton's method 
+// with CommonSolverBandLU gives the same solution as with the default 
+// dof ordering and CommonSolverDenseLU.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+/******************************************************************************/
+
+int main() {
+  DiscreteProblem *dp = create_two_eq_problem();
+
+  int success_test = 1;
+
+  Mesh *mesh = create_two_eq_mesh(DOF_ORDERING_COMPONENTS);
+  Mesh *mesh_band = create_two_eq_mesh(DOF_ORDERING_ELEMENTS);
+
+  // bandwidth of the Jacobi matrix: at most all dofs of two
+  // neighboring elements
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh_band);
+  int bandwidth = 0;
+  for (int j=0; j < mat->get_size(); j++)
+    for (int k=mat->get_Ap()[j]; k < mat->get_Ap()[j+1]; k++)
+      bandwidth = std::max(bandwidth, abs(mat->get_Ai()[k] - j));
+  printf("bandwidth = %d\n", bandwidth);
+  if (bandwidth > N_eq*(2 + 10)) success_test = 0;
+  delete mat;
+
+  CommonSolverDenseLU solver_lu;
+  CommonSolverBandLU solver_band;
+  newton(dp, mesh, &solver_lu, 1e-10, 20);
+  newton(dp, mesh_band, &solver_band, 1e-10, 20);
+
+  // compare solution coefficients element by element
+  Element *e = mesh->get_base_elems();
+  Element *e_band = mesh_band->get_base_elems();
+  double diff = 0;
+  for (int m=0; m < N_elem; m++) {
+    for (int c=0; c < N_eq; c++)
+      for (int j=0; j <= e[m].p; j++)
+        diff = std::max(diff, fabs(e[m].coeffs[0][c][j] 
+                                   - e_band[m].coeffs[0][c][j]));
+  }
+  printf("max difference of coefficients = %g\n", diff);
+  if (diff > 1e-10) success_test = 0;
+
+  if (success_test) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
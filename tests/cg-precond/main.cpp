@@ -0,0 +1,123 @@
+#include "hermes1d.h"
+
+// This test makes sure that the preconditioned CG solver (Jacobi,
+// block Jacobi on the element dofs from Mesh::get_elem_dof_blocks()
+// and IC(0)) solves a diffusion-reaction equation at high poly degrees
+// like the direct solver, and that the preconditioners reduce the
+// number of CG iterations. (For -u'' alone the bubble functions are
+// orthogonal and CG is not challenged.)
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 20;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 8;                         // Initial polynomal degree
+
+// Tolerances
+double CG_TOL = 1e-10;
+int CG_MAXITER = 10000;
+
+double a(double x)
+{
+  return 1 + 100*x*x;
+}
+
+double f(double x)
+{
+  return 1 + exp(x);
+}
+
+// -(a*u')' + u = f, u(A) = u(B) = 0
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (a(x[i])*dudx[i]*dvdx[i] + u[i]*v[i])*weights[i];
+  }
+  return val;
+};
+
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (a(x[i])*du_prevdx[0][0][i]*dvdx[i] +
+            (u_prev[0][0][i] - f(x[i]))*v[i])*weights[i];
+  }
+  return val;
+};
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_bc_left_dirichlet(0, 0);
+  mesh->set_bc_right_dirichlet(0, 0);
+  int n_dof = mesh->assign_dofs();
+
+  // the stiffness matrix and the right-hand side (zero initial guess)
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh);
+  std::vector<double> rhs(n_dof), y_lu(n_dof);
+  dp->assemble_matrix_and_vector(mesh, mat, &rhs[0]);
+  for (int i=0; i < n_dof; i++) rhs[i] = -rhs[i];
+  y_lu = rhs;
+  CommonSolverBandLU solver_lu;
+  solver_lu.set_quiet(true);
+  solver_lu._solve(mat, &y_lu[0]);
+
+  // the element blocks cover every dof exactly once
+  std::vector<std::vector<int> > blocks;
+  mesh->get_elem_dof_blocks(blocks);
+  std::vector<int> n_covered(n_dof, 0);
+  for (int b=0; b < (int)blocks.size(); b++)
+    for (int i=0; i < (int)blocks[b].size(); i++) n_covered[blocks[b][i]]++;
+  for (int i=0; i < n_dof; i++) if (n_covered[i] != 1) ok = 0;
+
+  const char *names[4] = {"none", "Jacobi", "block Jacobi", "IC(0)"};
+  int preconds[4] = {CG_PRECOND_NONE, CG_PRECOND_JACOBI,
+                     CG_PRECOND_BLOCK_JACOBI, CG_PRECOND_IC0};
+  int n_iter[4];
+  for (int k=0; k < 4; k++) {
+    CommonSolverCG solver;
+    solver.set_precond(preconds[k]);
+    solver.set_blocks(blocks);
+    solver.set_quiet(true);
+    std::vector<double> y(rhs);
+    bool converged = solver._solve(mat, &y[0], CG_TOL, CG_MAXITER);
+    n_iter[k] = solver.get_num_iters();
+    double max_diff = 0;
+    for (int i=0; i < n_dof; i++)
+      max_diff = std::max(max_diff, fabs(y[i] - y_lu[i]));
+    printf("preconditioner %s: %d CG iterations, max difference from "
+           "the direct solver %g\n", names[k], n_iter[k], max_diff);
+    if (!converged || max_diff > 1e-8) ok = 0;
+  }
+  for (int k=1; k < 4; k++) if (n_iter[k] >= n_iter[0]) ok = 0;
+
+  delete mat;
+  delete mesh;
+  delete dp;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,101 @@
+#include "../two_eq_system.h"
+
+// This test makes sure that the static condensation of bubbles
+// (CondensedSolver) gives the same solution of the linear system as the
+// solver applied to the full system, also with several threads and 
+// inside of the Newton's method.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// surface bilinear form (Newton condition on the right)
+double jacobian_surf_right(double x, double u, double dudx,
+        double v, double dvdx, double u_prev[MAX_SLN_NUM][MAX_EQN_NUM], 
+        double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], void *user_data)
+{
+  return 2*u*v;
+}
+
+/******************************************************************************/
+
+// Relative difference of two vectors in the max norm
+double rel_diff(double *x, double *x_ref, int n)
+{
+  double diff = 0, norm = 0;
+  for (int i=0; i < n; i++) {
+    diff = std::max(diff, fabs(x[i] - x_ref[i]));
+    norm = std::max(norm, fabs(x_ref[i]));
+  }
+  return diff / norm;
+}
+
+int main() {
+  Mesh *mesh = create_two_eq_mesh();
+  int n_dof = mesh->get_n_dof();
+
+  DiscreteProblem *dp = create_two_eq_problem();
+  dp->add_matrix_form_surf(1, 1, jacobian_surf_right, BOUNDARY_RIGHT);
+
+  int success_test = 1;
+
+  // linear system for a nontrivial previous solution
+  double *y = new double[n_dof];
+  for (int i=0; i < n_dof; i++) y[i] = sin(1. + i);
+  copy_vector_to_mesh(y, mesh);
+  CooMatrix *mat = new CooMatrix();
+  double *res = new double[n_dof];
+  dp->assemble_matrix_and_vector(mesh, mat, res);
+
+  double *x_ref = new double[n_dof];
+  memcpy(x_ref, res, n_dof*sizeof(double));
+  CommonSolverDenseLU lu;
+  lu._solve(mat, x_ref);
+
+  CondensedSolver solver(mesh, &lu);
+  double *x = new double[n_dof];
+  for (int threads=1; threads <= 3; threads += 2) {
+    solver.set_num_threads(threads);
+    memcpy(x, res, n_dof*sizeof(double));
+    solver._solve(mat, x);
+    // one vertex dof per vertex and equation, minus the Dirichlet one
+    if (solver.get_n_vertex_dof() != N_eq*(N_elem + 1) - 1) {
+      printf("wrong number of vertex dofs: %d\n", solver.get_n_vertex_dof());
+      success_test = 0;
+    }
+    double diff = rel_diff(x, x_ref, n_dof);
+    printf("threads = %d, relative difference = %g\n", threads, diff);
+    if (diff > 1e-10) success_test = 0;
+  }
+
+  // default vertex solver (banded LU)
+  CondensedSolver solver_default(mesh);
+  memcpy(x, res, n_dof*sizeof(double));
+  if (!solver_default._solve(mat, x)) success_test = 0;
+  double diff_default = rel_diff(x, x_ref, n_dof);
+  printf("default vertex solver, relative difference = %g\n", diff_default);
+  if (diff_default > 1e-10) success_test = 0;
+
+  // Newton's method with and without condensation (the surface form
+  // above has no counterpart in the residual, so it is left out here)
+  DiscreteProblem *dp_newton = create_two_eq_problem();
+  for (int i=0; i < n_dof; i++) y[i] = 0;
+  copy_vector_to_mesh(y, mesh);
+  newton(dp_newton, mesh, &lu, 1e-10, 20);
+  copy_mesh_to_vector(mesh, x_ref);
+  for (int i=0; i < n_dof; i++) y[i] = 0;
+  copy_vector_to_mesh(y, mesh);
+  newton(dp_newton, mesh, &lu, 1e-10, 20, true, true);
+  copy_mesh_to_vector(mesh, x);
+  double diff = rel_diff(x, x_ref, n_dof);
+  printf("newton: relative difference = %g\n", diff);
+  if (diff > 1e-10) success_test = 0;
+
+  if (success_test) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,176 @@
+#include "hermes1d.h"
+
+// This test makes sure that Mesh::assign_dofs_incremental() numbers
+// the dofs in the same way as Mesh::assign_dofs() after p-refinements,
+// p-coarsenings and (repeated) hp-refinements, for both dof orderings,
+// and that the old-to-new dof map connects the dofs that belong to the
+// same vertex or bubble function. Refinements and changes of poly 
+// degrees done outside of the mesh must lead to a full renumbering.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+int N_elem = 16;                        // Number of elements
+int N_eq = 2;                           // Number of equations
+double A = 0, B = 1;                    // Domain end points
+int P_init = 2;                         // Initial polynomal degree
+int N_steps = 4;                        // Number of refinement steps
+
+// vertex function at 'x' or bubble 'j' on (x1, x2), component 'c'
+typedef std::pair<std::pair<double, double>, int> DofKey;
+
+// the shape function of every dof of the mesh
+void get_dof_keys(Mesh *mesh, std::map<DofKey, int> &keys)
+{
+  keys.clear();
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  for (int m=0; m < (int)elems.size(); m++) {
+    Element *e = elems[m];
+    for (int c=0; c < N_eq; c++) {
+      for (int j=0; j <= e->p; j++) {
+        if (e->dof[c][j] < 0) continue;
+        DofKey key;
+        if (j < 2) key = DofKey(std::make_pair(j == 0 ? e->x1 : e->x2, 0.), c);
+        else key = DofKey(std::make_pair(e->x1, e->x2), 1000*j + c);
+        keys[key] = e->dof[c][j];
+      }
+    }
+  }
+}
+
+// number of differences between the dofs and element ids of two meshes
+int compare_dofs(Mesh *mesh1, Mesh *mesh2)
+{
+  std::vector<Element*> &elems1 = mesh1->get_active_elems();
+  std::vector<Element*> &elems2 = mesh2->get_active_elems();
+  if (elems1.size() != elems2.size() ||
+      mesh1->get_n_dof() != mesh2->get_n_dof()) return 1;
+  int n_wrong = 0;
+  for (int m=0; m < (int)elems1.size(); m++) {
+    if (elems1[m]->id != elems2[m]->id) n_wrong++;
+    for (int c=0; c < N_eq; c++)
+      for (int j=0; j <= elems1[m]->p; j++)
+        if (elems1[m]->dof[c][j] != elems2[m]->dof[c][j]) n_wrong++;
+  }
+  return n_wrong;
+}
+
+// number of wrong entries of the old-to-new dof map
+int check_dof_map(std::map<DofKey, int> &keys_old,
+                  std::map<DofKey, int> &keys_new, std::vector<int> &dof_map)
+{
+  int n_wrong = 0;
+  std::map<DofKey, int>::iterator it;
+  for (it = keys_old.begin(); it != keys_old.end(); it++) {
+    std::map<DofKey, int>::iterator it_new = keys_new.find(it->first);
+    int dof_new = (it_new == keys_new.end()) ? -1 : it_new->second;
+    if (it->second >= (int)dof_map.size() ||
+        dof_map[it->second] != dof_new) n_wrong++;
+  }
+  return n_wrong;
+}
+
+int main()
+{
+  int ok = 1;
+
+  for (int ordering=0; ordering < 2; ordering++) {
+    Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+    mesh->set_bc_left_dirichlet(0, 1);
+    mesh->set_bc_right_dirichlet(1, 2);
+    mesh->set_dof_ordering(ordering == 0 ? DOF_ORDERING_COMPONENTS :
+                                           DOF_ORDERING_ELEMENTS);
+    mesh->assign_dofs();
+    for (int step=0; step < N_steps; step++) {
+      std::map<DofKey, int> keys_old, keys_new;
+      get_dof_keys(mesh, keys_old);
+
+      // raise and lower poly degrees, split some elements and
+      // split some of the new sons again
+      std::vector<Element*> elems = mesh->get_active_elems();
+      int n_elem = elems.size();
+      for (int m=n_elem/3 + step; m < n_elem; m += 5) {
+        int3 cand_p = {0, elems[m]->p + 1, -1};
+        int3 cand_lower = {0, 1, -1};
+        int3 cand_split = {1, 2, 3};
+        if (m % 3 == 0) mesh->refine_elem(elems[m], cand_p);
+        else if (m % 3 == 1) mesh->refine_elem(elems[m], cand_lower);
+        else {
+          mesh->refine_elem(elems[m], cand_split);
+          mesh->refine_elem(elems[m]->sons[1], cand_split);
+          mesh->refine_elem(elems[m]->sons[1]->sons[0], cand_p);
+        }
+      }
+
+      std::vector<int> dof_map;
+      int n_dof = mesh->assign_dofs_incremental(&dof_map);
+      Mesh *mesh_full = mesh->replicate();
+      mesh_full->assign_dofs();
+      get_dof_keys(mesh, keys_new);
+      int n_wrong = compare_dofs(mesh, mesh_full);
+      int n_wrong_map = check_dof_map(keys_old, keys_new, dof_map);
+      printf("ordering %d, step %d: %d dofs, %d differences from "
+             "assign_dofs(), %d wrong dof map entries\n", ordering, step,
+             n_dof, n_wrong, n_wrong_map);
+      if (n_dof != mesh_full->get_n_dof() || n_wrong > 0 || n_wrong_map > 0)
+        ok = 0;
+      delete mesh_full;
+    }
+
+    // elements refined directly or with poly degrees changed outside 
+    // of the mesh (also together with a refinement through the mesh): 
+    // all dofs are numbered again
+    for (int change=0; change < 5; change++) {
+      std::vector<Element*> elems = mesh->get_active_elems();
+      Element *e = elems[change];
+      int3 cand_p = {0, elems[6]->p + 1, -1};
+      switch (change) {
+        case 0: e->refine(1, 2, 2);
+                mesh->set_n_active_elem(mesh->get_n_active_elem() + 1); 
+                break;
+        case 1: e->refine(0, e->p + 1, -1); break;
+        case 2: e->resize(e->p + 1); break;
+        case 3: e->p++; break;
+        case 4: e->p++;
+                mesh->refine_elem(elems[6], cand_p);
+                break;
+      }
+      std::vector<int> dof_map;
+      int n_dof_old = mesh->get_n_dof();
+      mesh->assign_dofs_incremental(&dof_map);
+      Mesh *mesh_full = mesh->replicate();
+      mesh_full->assign_dofs();
+      int n_wrong = compare_dofs(mesh, mesh_full);
+      for (int i=0; i < (int)dof_map.size(); i++) 
+        if (dof_map[i] != -1) n_wrong++;
+      printf("ordering %d, direct change %d: %d differences\n", ordering,
+             change, n_wrong);
+      if ((int)dof_map.size() != n_dof_old || n_wrong > 0) ok = 0;
+      delete mesh_full;
+    }
+
+    // reference_refinement() after a direct p-refinement of an element
+    // before the refined ones
+    Element *e = mesh->get_active_elems()[1];
+    e->refine(0, e->p + 1, -1);
+    mesh->reference_refinement(3, 2);
+    Mesh *mesh_full = mesh->replicate();
+    mesh_full->assign_dofs();
+    int n_wrong = compare_dofs(mesh, mesh_full);
+    printf("ordering %d, reference refinement: %d differences\n", ordering,
+           n_wrong);
+    if (n_wrong > 0) ok = 0;
+    delete mesh_full;
+    delete mesh;
+  }
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
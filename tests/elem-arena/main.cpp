@@ -0,0 +1,118 @@
+#include "hermes1d.h"
+
+// This test makes sure that the elements of a mesh take memory
+// according to their poly degree, number of equations and solutions,
+// and that the dof and coeffs arrays are kept correctly when elements
+// are refined, copied and replicated.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+int N_elem_large = 1000000;             // Number of elements (large mesh)
+int N_elem = 20;                        // Number of elements
+int N_eq = 2;                           // Number of equations
+int N_sln = 2;                          // Number of solutions
+double A = 0, B = 1;                    // Domain end points
+int P_init = 2;                         // Initial polynomal degree
+
+// coefficient stored in element 'id' for the given indices
+double coeff(int id, int sln, int c, int j)
+{
+  return id + 0.1*sln + 0.01*c + 0.001*j;
+}
+
+int main()
+{
+  int ok = 1;
+
+  // scalar linear problem on a large mesh
+  Mesh *mesh_large = new Mesh(A, B, N_elem_large, 1, 1, 1);
+  mesh_large->set_bc_left_dirichlet(0, 1);
+  int n_dof_large = mesh_large->assign_dofs();
+  double bytes_per_elem =
+    (double)mesh_large->get_elem_memory_size() / N_elem_large;
+  printf("N_dof = %d, memory per element = %g bytes\n", n_dof_large,
+         bytes_per_elem);
+  if (n_dof_large != N_elem_large) ok = 0;
+  if (bytes_per_elem > sizeof(Element) + 64) ok = 0;
+  delete mesh_large;
+
+  // system with two solutions
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq, N_sln);
+  mesh->assign_dofs();
+  Element *elems = mesh->get_base_elems();
+  for (int m=0; m < N_elem; m++) {
+    Element *e = elems + m;
+    for (int sln=0; sln < N_sln; sln++)
+      for (int c=0; c < N_eq; c++)
+        for (int j=0; j <= e->p; j++)
+          e->coeffs[sln][c][j] = coeff(m, sln, c, j);
+  }
+
+  // p-refinement keeps the coefficients and zeroes the new ones,
+  // hp-refinement allocates sons from the mesh
+  for (int m=0; m < N_elem; m += 2) elems[m].refine(0, P_init + 3, 0);
+  for (int m=1; m < N_elem; m += 4) {
+    elems[m].refine(1, P_init + 1, P_init);
+    mesh->set_n_active_elem(mesh->get_n_active_elem() + 1);
+  }
+  int n_wrong = 0;
+  for (int m=0; m < N_elem; m += 2) {
+    Element *e = elems + m;
+    if (e->p != P_init + 3) n_wrong++;
+    for (int sln=0; sln < N_sln; sln++)
+      for (int c=0; c < N_eq; c++)
+        for (int j=0; j <= e->p; j++) {
+          double expected = j <= P_init ? coeff(m, sln, c, j) : 0;
+          if (e->coeffs[sln][c][j] != expected) n_wrong++;
+        }
+  }
+  for (int m=1; m < N_elem; m += 4)
+    if (elems[m].sons[0]->arena != elems[m].arena ||
+        elems[m].sons[1] != elems[m].sons[0] + 1) n_wrong++;
+  printf("wrong entries after refinement: %d\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // replicated mesh and standalone copies hold the same data
+  int n_dof = mesh->assign_dofs();
+  Mesh *mesh_rep = mesh->replicate();
+  Iterator I(mesh), I_rep(mesh_rep);
+  Element *e, *e_rep;
+  n_wrong = 0;
+  while ((e = I.next_active_element()) != NULL) {
+    e_rep = I_rep.next_active_element();
+    Element *e_copy = new Element();
+    e->copy_into(e_copy);
+    if (e_rep == NULL || e_rep->p != e->p || e_copy->p != e->p) {
+      n_wrong++;
+      delete e_copy;
+      continue;
+    }
+    for (int c=0; c < N_eq; c++)
+      for (int j=0; j <= e->p; j++) {
+        if (e_rep->dof[c][j] != e->dof[c][j]) n_wrong++;
+        if (e_copy->dof[c][j] != e->dof[c][j]) n_wrong++;
+        for (int sln=0; sln < N_sln; sln++) {
+          if (e_rep->coeffs[sln][c][j] != e->coeffs[sln][c][j]) n_wrong++;
+          if (e_copy->coeffs[sln][c][j] != e->coeffs[sln][c][j]) n_wrong++;
+        }
+      }
+    delete e_copy;
+  }
+  if (I_rep.next_active_element() != NULL) n_wrong++;
+  if (mesh_rep->get_n_dof() != n_dof) n_wrong++;
+  printf("wrong entries after replication: %d\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+  delete mesh_rep;
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,154 @@
+#include "hermes1d.h"
+
+// This test makes sure that the fast trial refinements (FTRSolver)
+// solved on patches agree with the FTR solved on the whole mesh. For
+// the Poisson equation -u'' = f in 1D the Galerkin solution is exact
+// at the vertices, so the patch with Dirichlet conditions from the
+// coarse solution gives the same FTR for every patch size. Also the
+// results must not depend on the number of threads, and adapt() must
+// accept the reference element pairs.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 12;                        // Number of elements
+double A = 0, B = M_PI;                 // Domain end points
+int P_init = 2;                         // Initial polynomal degree
+int N_threads = 4;                      // Number of threads
+
+// Tolerance for Newton's method
+double NEWTON_TOL = 1e-10;
+int NEWTON_MAXITER = 10;
+
+// Adaptivity
+const int NORM = 1;
+const int ADAPT_TYPE = 0;
+const double THRESHOLD = 0.7;
+
+// right-hand side, the exact solution is u(x) = sin(x)*exp(x)
+double f(double x)
+{
+  return -2*cos(x)*exp(x);
+}
+
+// bilinear form for the Jacobi matrix
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += dudx[i]*dvdx[i]*weights[i];
+  }
+  return val;
+};
+
+// (nonlinear) form for the residual vector
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (du_prevdx[0][0][i]*dvdx[i] - f(x[i])*v[i])*weights[i];
+  }
+  return val;
+};
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+  CommonSolverBandLU solver;
+
+  // coarse mesh with varying poly degrees
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_bc_left_dirichlet(0, 0);
+  mesh->set_bc_right_dirichlet(0, 0);
+  for (int i=0; i < N_elem; i += 3) {
+    int3 cand = {0, P_init + 1, 0};
+    mesh->refine_single_elem(i, cand);
+  }
+  mesh->assign_dofs();
+  newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+
+  // FTR on the whole mesh
+  std::vector<double> err_global(N_elem);
+  for (int i=0; i < N_elem; i++) {
+    Mesh *mesh_ref = mesh->replicate();
+    mesh_ref->reference_refinement(i, 1);
+    newton(dp, mesh_ref, &solver, NEWTON_TOL, NEWTON_MAXITER, false);
+    std::vector<double> err_est_array;
+    err_global[i] = calc_error_estimate(NORM, mesh, mesh_ref, err_est_array);
+    delete mesh_ref;
+  }
+
+  // FTR on patches of several sizes and with several threads
+  ElemPtr2 *ref_elem_pairs = new ElemPtr2[N_elem];
+  ElemPtr2 *ref_elem_pairs_serial = new ElemPtr2[N_elem];
+  for (int i=0; i < N_elem; i++) {
+    ref_elem_pairs[i][0] = ref_elem_pairs[i][1] = NULL;
+    ref_elem_pairs_serial[i][0] = ref_elem_pairs_serial[i][1] = NULL;
+  }
+  FTRSolver ftr(dp, NORM);
+  ftr.set_newton(NEWTON_TOL, NEWTON_MAXITER);
+  int patch_sizes[3] = {0, 1, N_elem};
+  std::vector<double> err_patch, err_patch_serial;
+  for (int k=0; k < 3; k++) {
+    ftr.set_patch_size(patch_sizes[k]);
+    ftr.set_num_threads(1);
+    double max_err_serial = ftr.solve(mesh, err_patch_serial,
+                                      ref_elem_pairs_serial);
+    ftr.set_num_threads(N_threads);
+    double max_err = ftr.solve(mesh, err_patch, ref_elem_pairs);
+    double max_diff = 0;
+    int n_wrong = 0;
+    for (int i=0; i < N_elem; i++) {
+      max_diff = std::max(max_diff, fabs(err_patch[i] - err_global[i]));
+      if (err_patch[i] != err_patch_serial[i]) n_wrong++;
+      for (int j=0; j < 2; j++) {
+        Element *e = ref_elem_pairs[i][j], *e_serial = ref_elem_pairs_serial[i][j];
+        if (e->p != e_serial->p || e->x1 != e_serial->x1) n_wrong++;
+        for (int m=0; m <= e->p; m++)
+          if (e->coeffs[0][0][m] != e_serial->coeffs[0][0][m]) n_wrong++;
+      }
+    }
+    printf("patch size %d: max FTR error = %g, max |err_patch - err_global| "
+           "= %g, %d differences between threads\n", patch_sizes[k],
+           max_err, max_diff, n_wrong);
+    if (max_diff > 1e-8 * max_err || max_err != max_err_serial ||
+        n_wrong > 0) ok = 0;
+  }
+
+  // the element pairs decide how the elements are refined
+  int n_dof = mesh->get_n_dof();
+  adapt(NORM, ADAPT_TYPE, THRESHOLD, err_patch, mesh, ref_elem_pairs);
+  printf("adapted mesh: %d dofs (%d before)\n", mesh->get_n_dof(), n_dof);
+  if (mesh->get_n_dof() <= n_dof) ok = 0;
+
+  for (int i=0; i < N_elem; i++) {
+    for (int j=0; j < 2; j++) {
+      delete ref_elem_pairs[i][j];
+      delete ref_elem_pairs_serial[i][j];
+    }
+  }
+  delete [] ref_elem_pairs;
+  delete [] ref_elem_pairs_serial;
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
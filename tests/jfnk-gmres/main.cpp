@@ -0,0 +1,115 @@
+#include "hermes1d.h"
+
+// This test makes sure that JFNK with restarted GMRES (jfnk_gmres())
+// converges to the Newton's solution of a nonsymmetric problem, both
+// without and with the factorized Jacobi matrix as the preconditioner,
+// and that the preconditioner reduces the number of GMRES iterations.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 40;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 2;                         // Initial polynomal degree
+
+// Boundary conditions
+double Val_dir_left = 1;                // Dirichlet condition left
+
+// Tolerances
+double NEWTON_TOL = 1e-10;
+int NEWTON_MAXITER = 20;
+int GMRES_RESTART = 30;
+int GMRES_MAXITER = 1000;
+double JFNK_EPSILON = 1e-7;
+double JFNK_TOL = 1e-9;
+int JFNK_MAXITER = 30;
+
+// y' = f(y, x) = x - y^2, y(A) = 1
+double f(double y, double x)
+{
+  return x - y*y;
+}
+
+double dfdy(double y, double x)
+{
+  return -2*y;
+}
+
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (dudx[i]*v[i] - dfdy(u_prev[0][0][i], x[i])*u[i]*v[i])*weights[i];
+  }
+  return val;
+};
+
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (du_prevdx[0][0][i] - f(u_prev[0][0][i], x[i]))*v[i]*weights[i];
+  }
+  return val;
+};
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_bc_left_dirichlet(0, Val_dir_left);
+  int n_dof = mesh->assign_dofs();
+  std::vector<double> y_init(n_dof);
+  copy_mesh_to_vector(mesh, &y_init[0]);
+
+  // Newton's method with the band LU solver
+  CommonSolverBandLU solver;
+  solver.set_quiet(true);
+  newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER, false);
+  std::vector<double> y_newton(n_dof), y_jfnk(n_dof);
+  copy_mesh_to_vector(mesh, &y_newton[0]);
+
+  // JFNK without and with the preconditioner (factorized only once, 
+  // and in every step)
+  int n_iter[3];
+  for (int k=0; k < 3; k++) {
+    copy_vector_to_mesh(&y_init[0], mesh);
+    CommonSolver *precond = (k == 0) ? NULL : &solver;
+    n_iter[k] = jfnk_gmres(dp, mesh, GMRES_RESTART, GMRES_MAXITER,
+                           JFNK_EPSILON, JFNK_TOL, JFNK_MAXITER,
+                           precond, k - 1, false);
+    copy_mesh_to_vector(mesh, &y_jfnk[0]);
+    double max_diff = 0;
+    for (int i=0; i < n_dof; i++)
+      max_diff = std::max(max_diff, fabs(y_jfnk[i] - y_newton[i]));
+    printf("preconditioner %d: %d GMRES iterations, max difference from "
+           "Newton's solution %g\n", k, n_iter[k], max_diff);
+    if (max_diff > 1e-7) ok = 0;
+  }
+  if (n_iter[1] >= n_iter[0] || n_iter[2] > n_iter[1]) ok = 0;
+
+  delete mesh;
+  delete dp;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
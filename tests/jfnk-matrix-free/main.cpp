@@ -0,0 +1,159 @@
+#include "hermes1d.h"
+
+// This test makes sure that the residual assembled from a coefficient
+// vector (DiscreteProblem::assemble_residual()) is the same as the
+// residual assembled from the elements, that the matrix-free products
+// with the Jacobi matrix (DiscreteProblem::jacobian_dot_vec()) do not
+// change the mesh and agree with the assembled Jacobi matrix, and that
+// the JFNK method converges to the Newton's solution.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem = 20;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 3;                         // Initial polynomal degree
+
+// Boundary conditions
+double Val_dir_left = 1;                // Dirichlet condition left
+
+// Tolerances
+double NEWTON_TOL = 1e-10;
+int NEWTON_MAXITER = 20;
+double MATRIX_SOLVER_TOL = 1e-9;
+int MATRIX_SOLVER_MAXITER = 500;
+double JFNK_EPSILON = 1e-6;
+double JFNK_TOL = 1e-8;
+int JFNK_MAXITER = 20;
+
+double f(double x)
+{
+  return 1 + x*x;
+}
+
+// -u'' + u^3 = f, u(A) = 1, u'(B) = -u(B)^2
+double jacobian_vol(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (dudx[i]*dvdx[i] + 3*u_prev[0][0][i]*u_prev[0][0][i]*u[i]*v[i])
+           *weights[i];
+  }
+  return val;
+};
+
+double residual_vol(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    double u = u_prev[0][0][i];
+    val += (du_prevdx[0][0][i]*dvdx[i] + (u*u*u - f(x[i]))*v[i])*weights[i];
+  }
+  return val;
+};
+
+double jacobian_surf_right(double x, double u, double dudx,
+        double v, double dvdx, double u_prev[MAX_SLN_NUM][MAX_EQN_NUM],
+        double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], void *user_data)
+{
+  return 2*u_prev[0][0]*u*v;
+}
+
+double residual_surf_right(double x, double u_prev[MAX_SLN_NUM][MAX_EQN_NUM],
+        double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM], double v,
+        double dvdx, void *user_data)
+{
+  return u_prev[0][0]*u_prev[0][0]*v;
+}
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian_vol);
+  dp->add_vector_form(0, residual_vol);
+  dp->add_matrix_form_surf(0, 0, jacobian_surf_right, BOUNDARY_RIGHT);
+  dp->add_vector_form_surf(0, residual_surf_right, BOUNDARY_RIGHT);
+
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_bc_left_dirichlet(0, Val_dir_left);
+  int n_dof = mesh->assign_dofs();
+
+  // some coefficient vector and direction
+  std::vector<double> y(n_dof), vec(n_dof), y_mesh(n_dof), y_mesh_after(n_dof);
+  for (int i=0; i < n_dof; i++) {
+    y[i] = 1 + 0.3*sin(7.0*i);
+    vec[i] = cos(3.0*i);
+  }
+  copy_mesh_to_vector(mesh, &y_mesh[0]);
+
+  // residual from the vector and from the elements
+  std::vector<double> res(n_dof), res_mesh(n_dof);
+  dp->assemble_residual(mesh, &y[0], &res[0]);
+  copy_mesh_to_vector(mesh, &y_mesh_after[0]);
+  int n_wrong = (y_mesh != y_mesh_after);
+  copy_vector_to_mesh(&y[0], mesh);
+  dp->assemble_vector(mesh, &res_mesh[0]);
+  for (int i=0; i < n_dof; i++) if (res[i] != res_mesh[i]) n_wrong++;
+  printf("residual from a vector: %d differences\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // matrix-free product and the product with the Jacobi matrix
+  copy_vector_to_mesh(&y_mesh[0], mesh);
+  std::vector<double> J_dot_vec(n_dof);
+  dp->jacobian_dot_vec(mesh, &y[0], &res[0], &vec[0], JFNK_EPSILON,
+                       &J_dot_vec[0]);
+  copy_mesh_to_vector(mesh, &y_mesh_after[0]);
+  if (y_mesh != y_mesh_after) ok = 0;
+  copy_vector_to_mesh(&y[0], mesh);
+  PatternCSCMatrix *mat = dp->create_csc_matrix(mesh);
+  dp->assemble_matrix(mesh, mat);
+  double max_diff = 0, max_val = 0;
+  for (int i=0; i < n_dof; i++) {
+    double val = 0;
+    for (int j=0; j < n_dof; j++) val += mat->get(i, j)*vec[j];
+    max_diff = std::max(max_diff, fabs(val - J_dot_vec[i]));
+    max_val = std::max(max_val, fabs(val));
+  }
+  delete mat;
+  printf("matrix-free product: max difference %g (max value %g)\n",
+         max_diff, max_val);
+  if (max_diff > 1e-4 * max_val) ok = 0;
+
+  // JFNK and Newton's method
+  copy_vector_to_mesh(&y_mesh[0], mesh);
+  jfnk_cg(dp, mesh, MATRIX_SOLVER_TOL, MATRIX_SOLVER_MAXITER,
+          JFNK_EPSILON, JFNK_TOL, JFNK_MAXITER);
+  std::vector<double> y_jfnk(n_dof), y_newton(n_dof);
+  copy_mesh_to_vector(mesh, &y_jfnk[0]);
+  copy_vector_to_mesh(&y_mesh[0], mesh);
+  CommonSolverBandLU solver;
+  newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+  copy_mesh_to_vector(mesh, &y_newton[0]);
+  max_diff = 0;
+  for (int i=0; i < n_dof; i++)
+    max_diff = std::max(max_diff, fabs(y_jfnk[i] - y_newton[i]));
+  printf("JFNK and Newton's solutions: max difference %g\n", max_diff);
+  if (max_diff > 1e-6) ok = 0;
+
+  delete mesh;
+  delete dp;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,133 @@
+#include "hermes1d.h"
+
+// This test makes sure that the solver and adaptivity paths are not
+// limited by MAX_N_DOF and MAX_ELEM_NUM: JFNK is run with 10^6 dofs
+// (compared with Newton's method with the band LU solver), and the
+// error estimate and adapt() are run with more than MAX_ELEM_NUM
+// elements.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int N_elem_large = 1000000;             // Number of elements (JFNK)
+int N_elem = 3*MAX_ELEM_NUM/2;          // Number of elements (adapt)
+double A = 0;                           // Domain end points, the
+double B = N_elem_large;                // elements have unit length
+int P_init = 1;                         // Initial polynomal degree
+
+// JFNK parameters
+double MATRIX_SOLVER_TOL = 1e-8;
+int MATRIX_SOLVER_MAXITER = 150;
+double JFNK_EPSILON = 1e-4;
+double JFNK_TOL = 1e-6;
+int JFNK_MAXITER = 10;
+
+// Tolerance for Newton's method
+double NEWTON_TOL = 1e-8;
+int NEWTON_MAXITER = 10;
+
+// Adaptivity
+const int NORM = 1;
+const int ADAPT_TYPE = 0;
+const double THRESHOLD = 0.7;
+
+// L2 projection of g(x) = sin(x/L)
+double L = 1e5;
+double g(double x)
+{
+  return sin(x/L);
+}
+
+// bilinear form for the Jacobi matrix
+double jacobian(int num, double *x, double *weights,
+                double *u, double *dudx, double *v, double *dvdx,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += u[i]*v[i]*weights[i];
+  }
+  return val;
+};
+
+// (nonlinear) form for the residual vector
+double residual(int num, double *x, double *weights,
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (u_prev[0][0][i] - g(x[i]))*v[i]*weights[i];
+  }
+  return val;
+};
+
+int main() {
+  int ok = 1;
+
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian);
+  dp->add_vector_form(0, residual);
+
+  // JFNK with 10^6 dofs
+  Mesh *mesh_jfnk = new Mesh(A, B, N_elem_large, P_init, N_eq);
+  int n_dof = mesh_jfnk->assign_dofs();
+  printf("N_dof = %d\n", n_dof);
+  if (n_dof < 1000000) ok = 0;
+  jfnk_cg(dp, mesh_jfnk, MATRIX_SOLVER_TOL, MATRIX_SOLVER_MAXITER,
+          JFNK_EPSILON, JFNK_TOL, JFNK_MAXITER);
+  std::vector<double> y_jfnk(n_dof);
+  copy_mesh_to_vector(mesh_jfnk, &y_jfnk[0]);
+  delete mesh_jfnk;
+
+  // the same with Newton's method
+  Mesh *mesh_newton = new Mesh(A, B, N_elem_large, P_init, N_eq);
+  mesh_newton->assign_dofs();
+  CommonSolverBandLU solver;
+  newton(dp, mesh_newton, &solver, NEWTON_TOL, NEWTON_MAXITER);
+  std::vector<double> y_newton(n_dof);
+  copy_mesh_to_vector(mesh_newton, &y_newton[0]);
+  delete mesh_newton;
+  double max_diff = 0;
+  for (int i=0; i < n_dof; i++)
+    max_diff = std::max(max_diff, fabs(y_jfnk[i] - y_newton[i]));
+  printf("max |y_jfnk - y_newton| = %g\n", max_diff);
+  if (max_diff > 1e-6) ok = 0;
+
+  // adaptivity with more than MAX_ELEM_NUM elements (the element 
+  // ordering of dofs keeps the band LU solver usable on the 
+  // reference mesh)
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_dof_ordering(DOF_ORDERING_ELEMENTS);
+  mesh->assign_dofs();
+  newton(dp, mesh, &solver, NEWTON_TOL, NEWTON_MAXITER);
+  Mesh *mesh_ref = mesh->replicate();
+  mesh_ref->reference_refinement(0, mesh_ref->get_n_active_elem());
+  newton(dp, mesh_ref, &solver, NEWTON_TOL, NEWTON_MAXITER);
+  std::vector<double> err_est_array;
+  double err_est_total = calc_error_estimate(NORM, mesh, mesh_ref,
+                                             err_est_array);
+  printf("Error estimate = %g (%d elements)\n", err_est_total,
+         (int)err_est_array.size());
+  if ((int)err_est_array.size() != N_elem) ok = 0;
+  adapt(NORM, ADAPT_TYPE, THRESHOLD, err_est_array, mesh, mesh_ref);
+  printf("Adapted mesh: %d elements, %d dofs\n", mesh->get_n_active_elem(),
+         mesh->get_n_dof());
+  if (mesh->get_n_dof() <= N_elem + 1) ok = 0;
+  delete mesh;
+  delete mesh_ref;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
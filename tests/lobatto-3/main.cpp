@@ -0,0 +1,87 @@
+#include "hermes1d.h"
+
+#include "legendre.h"
+#include "lobatto.h"
+#include "quad_std.h"
+
+// This test makes sure that the tables of Lobatto shape functions 
+// are filled on first use only for the quadrature orders that are 
+// needed, and that they are correct also when they are requested 
+// by several threads at the same time.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+int main(int argc, char* argv[])
+{
+  int ok = 1;
+
+  // creating a DiscreteProblem does not fill any tables
+  DiscreteProblem *dp = new DiscreteProblem();
+  delete dp;
+  double val[MAX_QUAD_PTS_NUM], der[MAX_QUAD_PTS_NUM];
+  element_shapefn(-1, 1, 2, 8, val, der);
+  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
+    if (lobatto_ref_tab_ready[quad_order] != (quad_order == 8)) {
+      printf("quad_order = %d: table ready = %d\n", quad_order, 
+             lobatto_ref_tab_ready[quad_order]);
+      ok = 0;
+    }
+  }
+
+  // maximum allowed error at an integration point
+  double max_allowed_error = 1e-12;
+
+  // all orders requested concurrently, compared with
+  // the values calculated directly
+  int n_failed = 0;
+#ifdef H1D_WITH_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4) reduction(+:n_failed)
+#endif
+  for (int m=0; m < 4*MAX_QUAD_ORDER; m++) {
+    int quad_order = MAX_QUAD_ORDER - 1 - m % MAX_QUAD_ORDER;
+    double val[MAX_QUAD_PTS_NUM], der[MAX_QUAD_PTS_NUM];
+    int num_pts = g_quad_1d_std.get_num_points(quad_order);
+    double2 *quad_tab = g_quad_1d_std.get_points(quad_order);
+    for (int k=0; k <= MAX_P; k++) {
+      element_shapefn(-1, 1, k, quad_order, val, der);
+      for (int i=0; i < num_pts; i++) {
+        double x = quad_tab[i][0];
+        if (fabs(val[i] - lobatto_val_ref(x, k)) > max_allowed_error ||
+            fabs(der[i] - lobatto_der_ref(x, k)) > max_allowed_error)
+          n_failed++;
+      }
+    }
+  }
+  printf("wrong values: %d\n", n_failed);
+  if (n_failed > 0) ok = 0;
+
+  // both layouts of the tables hold the same values, 
+  // their rows start at cache line boundaries
+  int n_mismatch = 0;
+  for (int quad_order=0; quad_order < MAX_QUAD_ORDER; quad_order++) {
+    int num_pts = g_quad_1d_std.get_num_points(quad_order);
+    for (int k=0; k <= MAX_P; k++) {
+      if ((size_t)lobatto_val_ref_tab_fn[quad_order][k] % 64 != 0) n_mismatch++;
+      for (int i=0; i < num_pts; i++) {
+        if (lobatto_val_ref_tab_fn[quad_order][k][i] != 
+            lobatto_val_ref_tab[quad_order][i][k] ||
+            lobatto_der_ref_tab_fn[quad_order][k][i] != 
+            lobatto_der_ref_tab[quad_order][i][k]) n_mismatch++;
+      }
+    }
+    for (int i=0; i < num_pts; i++)
+      if ((size_t)lobatto_val_ref_tab[quad_order][i] % 64 != 0) n_mismatch++;
+  }
+  printf("layout mismatches: %d\n", n_mismatch);
+  if (n_mismatch > 0) ok = 0;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,62 @@
+#include "../two_eq_system.h"
+
+// This test makes sure that the chord (modified Newton) method converges
+// to the same solution as the Newton's method while it factorizes the 
+// Jacobi matrix less often.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+/******************************************************************************/
+
+// band solver counting the factorizations
+class CountingSolver : public CommonSolverBandLU
+{
+public:
+  CountingSolver() : n_factorizations(0) {}
+  bool factorize(Matrix *mat) 
+  {
+    n_factorizations++;
+    return CommonSolverBandLU::factorize(mat);
+  }
+  int n_factorizations;
+};
+
+int main() {
+  DiscreteProblem *dp = create_two_eq_problem();
+
+  int success_test = 1;
+
+  Mesh *mesh = create_two_eq_mesh(DOF_ORDERING_ELEMENTS);
+  Mesh *mesh_chord = create_two_eq_mesh(DOF_ORDERING_ELEMENTS);
+
+  CommonSolverBandLU solver;
+  newton(dp, mesh, &solver, 1e-10, 20);
+  CountingSolver solver_chord;
+  newton_chord(dp, mesh_chord, &solver_chord, 1e-10, 50);
+  printf("chord method: %d factorizations\n", solver_chord.n_factorizations);
+  // Newton's method needs 5 iterations here
+  if (solver_chord.n_factorizations >= 5) success_test = 0;
+
+  // compare solution coefficients element by element
+  Element *e = mesh->get_base_elems();
+  Element *e_chord = mesh_chord->get_base_elems();
+  double diff = 0;
+  for (int m=0; m < N_elem; m++) {
+    for (int c=0; c < N_eq; c++)
+      for (int j=0; j <= e[m].p; j++)
+        diff = std::max(diff, fabs(e[m].coeffs[0][c][j] 
+                                   - e_chord[m].coeffs[0][c][j]));
+  }
+  printf("max difference of coefficients = %g\n", diff);
+  if (diff > 1e-9) success_test = 0;
+
+  if (success_test) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
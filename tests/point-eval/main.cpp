@@ -0,0 +1,117 @@
+#include "hermes1d.h"
+
+// This test makes sure that points are located in the right active
+// elements, and that the batched evaluation of a solution at sorted
+// (and unsorted) points gives the same values as the evaluation
+// element by element.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+int N_elem = 7;                         // Number of elements
+int N_eq = 2;                           // Number of equations
+double A = -1, B = 2;                   // Domain end points
+int P_init = 3;                         // Initial polynomal degree
+int N_pts = 1000000;                    // Number of evaluation points
+
+// active element containing 'x' found by traversing the tree 
+// (a vertex shared by two elements belongs to the right one)
+Element *find_elem(Mesh *mesh, double x)
+{
+  Iterator I(mesh);
+  Element *e, *e_found = NULL;
+  while ((e = I.next_active_element()) != NULL)
+    if (e->x1 <= x && x <= e->x2) e_found = e;
+  return e_found;
+}
+
+int main()
+{
+  int ok = 1;
+
+  // truncated Lobatto arrays agree with the full ones
+  double val_full[MAX_P + 1], der_full[MAX_P + 1];
+  double val_trunc[MAX_P + 1], der_trunc[MAX_P + 1];
+  for (int p=0; p <= MAX_P; p += 7) {
+    double x = -1 + 2.*p/MAX_P;
+    fill_lobatto_array_ref(x, val_full, der_full);
+    fill_lobatto_array_ref(x, val_trunc, der_trunc, p);
+    for (int j=0; j <= p; j++)
+      if (val_trunc[j] != val_full[j] || der_trunc[j] != der_full[j]) ok = 0;
+    if (lobatto_val_ref(x, p) != val_full[p] || 
+        lobatto_der_ref(x, p) != der_full[p]) ok = 0;
+  }
+  if (!ok) printf("truncated Lobatto arrays differ\n");
+
+  // mesh with hp-refinements and some (arbitrary) solution
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->assign_dofs();
+  int3 cand_hp = {1, 2, 5};
+  mesh->refine_single_elem(2, cand_hp);
+  mesh->assign_dofs();
+  mesh->refine_single_elem(0, cand_hp);
+  mesh->assign_dofs();
+  int3 cand_p = {0, 7, 0};
+  mesh->refine_single_elem(5, cand_p);
+  int n_dof = mesh->assign_dofs();
+  double *y = new double[n_dof];
+  for (int i=0; i < n_dof; i++) y[i] = sin(1.3*i) + 0.1*i;
+  copy_vector_to_mesh(y, mesh);
+  delete [] y;
+
+  // point location, including all element endpoints
+  std::vector<Element*> &elems = mesh->get_active_elems();
+  int n_wrong = 0;
+  for (int m=0; m < (int)elems.size(); m++) {
+    double pts[3] = {elems[m]->x1, (elems[m]->x1 + elems[m]->x2)/2, 
+                     elems[m]->x2};
+    for (int k=0; k < 3; k++) {
+      int id = mesh->locate_point(pts[k]);
+      if (id < 0 || elems[id] != find_elem(mesh, pts[k])) n_wrong++;
+    }
+  }
+  if (mesh->locate_point(A - 1e-12) != -1 || 
+      mesh->locate_point(B + 1e-12) != -1) n_wrong++;
+  printf("wrongly located points: %d\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // batched evaluation at sorted points
+  std::vector<double> x(N_pts), val(N_pts*N_eq), der(N_pts*N_eq);
+  for (int i=0; i < N_pts; i++) x[i] = A + (B - A)*i/(N_pts - 1);
+  mesh->get_solution_points(N_pts, &x[0], &val[0], &der[0]);
+  n_wrong = 0;
+  for (int i=0; i < N_pts; i += 997) {
+    double val_e[MAX_EQN_NUM], der_e[MAX_EQN_NUM];
+    find_elem(mesh, x[i])->get_solution_point(x[i], val_e, der_e);
+    for (int c=0; c < N_eq; c++)
+      if (val[i*N_eq + c] != val_e[c] || der[i*N_eq + c] != der_e[c]) 
+        n_wrong++;
+  }
+  printf("wrong values at sorted points: %d\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+
+  // unsorted points (every point is located separately), no derivatives
+  int n_unsorted = 1000;
+  std::vector<double> x_u(n_unsorted), val_u(n_unsorted*N_eq);
+  for (int i=0; i < n_unsorted; i++) x_u[i] = x[(i*7919L) % N_pts];
+  mesh->get_solution_points(n_unsorted, &x_u[0], &val_u[0]);
+  n_wrong = 0;
+  for (int i=0; i < n_unsorted; i++) {
+    int i_sorted = (i*7919L) % N_pts;
+    for (int c=0; c < N_eq; c++)
+      if (val_u[i*N_eq + c] != val[i_sorted*N_eq + c]) n_wrong++;
+  }
+  printf("wrong values at unsorted points: %d\n", n_wrong);
+  if (n_wrong > 0) ok = 0;
+  delete mesh;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
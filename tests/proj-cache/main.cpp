@@ -0,0 +1,141 @@
+#include "hermes1d.h"
+
+// This test makes sure that the cache of factorized H1 projection
+// matrices used by the adaptivity gives the same projections as
+// factorizing the matrix every time, that elements of equal length
+// share one entry, and that the factorizations returned when the
+// cache is full are not cached and can be deleted by the caller.
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                               -1
+
+// General input:
+static int N_eq = 1;
+int P = 6;                              // Poly degree of the projection
+int Quad_order = 20;                    // Quadrature order
+
+// projected function
+double f(double x)
+{
+  return sin(5*x) + x*x;
+}
+double dfdx(double x)
+{
+  return 5*cos(5*x) + 2*x;
+}
+
+// H1 projection of f() on (a, b) with the projection matrix from
+// 'cache', or factorized here if 'cache' is NULL; returns the error
+// squared of the projection
+double project(ProjMatrixCache *cache, double a, double b,
+               double proj_coeffs[MAX_EQN_NUM][MAX_P+1])
+{
+  int fns_num = P + 1;
+  int pts_num;
+  double phys_x[MAX_QUAD_PTS_NUM], phys_weights[MAX_QUAD_PTS_NUM];
+  create_phys_element_quadrature(a, b, Quad_order, phys_x, phys_weights,
+                                 &pts_num);
+  double pol_val[MAX_QUAD_PTS_NUM][MAX_P+1], pol_der[MAX_QUAD_PTS_NUM][MAX_P+1];
+  legendre_val_phys_quad(0, Quad_order, fns_num, a, b, pol_val);
+  legendre_der_phys_quad(0, Quad_order, fns_num, a, b, pol_der);
+  double u[MAX_EQN_NUM][MAX_QUAD_PTS_NUM], dudx[MAX_EQN_NUM][MAX_QUAD_PTS_NUM];
+  for (int j=0; j < pts_num; j++) {
+    u[0][j] = f(phys_x[j]);
+    dudx[0][j] = dfdx(phys_x[j]);
+  }
+
+  if (cache != NULL) {
+    calc_proj_coeffs_H1(N_eq, fns_num, pts_num, u, dudx, pol_val, pol_der,
+                        phys_weights, proj_coeffs, Quad_order, b - a, cache);
+  }
+  else {
+    double **matrix = get_proj_matrix_H1(N_eq, fns_num, pts_num,
+                                         pol_val, pol_der, phys_weights);
+    int indx[MAX_P+1];
+    double d;
+    ludcmp(matrix, fns_num, indx, &d);
+    for (int m=0; m < fns_num; m++) {
+      proj_coeffs[0][m] = 0;
+      for (int j=0; j < pts_num; j++)
+        proj_coeffs[0][m] += (u[0][j]*pol_val[j][m] + dudx[0][j]*pol_der[j][m])
+                             * phys_weights[j];
+    }
+    lubksb(matrix, fns_num, indx, proj_coeffs[0]);
+    delete [] matrix;
+  }
+
+  double err_squared = 0;
+  for (int j=0; j < pts_num; j++) {
+    double val = u[0][j], der = dudx[0][j];
+    for (int m=0; m < fns_num; m++) {
+      val -= proj_coeffs[0][m]*pol_val[j][m];
+      der -= proj_coeffs[0][m]*pol_der[j][m];
+    }
+    err_squared += (val*val + der*der) * phys_weights[j];
+  }
+  return err_squared;
+}
+
+// compares a projection with the one factorized without a cache
+int check_projection(const char *name, ProjMatrixCache *cache,
+                     double a, double b)
+{
+  double coeffs[MAX_EQN_NUM][MAX_P+1], coeffs_ref[MAX_EQN_NUM][MAX_P+1];
+  double err = project(cache, a, b, coeffs);
+  double err_ref = project(NULL, a, b, coeffs_ref);
+  double diff = fabs(err - err_ref);
+  for (int m=0; m <= P; m++)
+    diff = std::max(diff, fabs(coeffs[0][m] - coeffs_ref[0][m]));
+  printf("%s: error = %g, max. difference = %g, cache entries = %d\n",
+         name, sqrt(err), diff, cache->get_num_entries());
+  return diff < 1e-12;
+}
+
+int main()
+{
+  int ok = 1;
+
+  // cache miss, then cache hit for the same interval, and another
+  // interval of the same length
+  ProjMatrixCache cache;
+  ok &= check_projection("miss", &cache, 0, 0.25);
+  ok &= cache.get_num_entries() == 1;
+  ok &= check_projection("hit", &cache, 0, 0.25);
+  ok &= check_projection("equal length", &cache, 0.5, 0.75);
+  ok &= cache.get_num_entries() == 1;
+
+  // fill the cache up to the limit
+  for (int i=0; cache.get_num_entries() < PROJ_MATRIX_CACHE_SIZE; i++) {
+    ProjMatrixKey key = {2, 0, -1, 1. + i};
+    double **matrix = _new_matrix<double>(2, 2);
+    matrix[0][0] = matrix[1][1] = 2;
+    matrix[0][1] = matrix[1][0] = 1;
+    ProjMatrix *pm = cache.insert(key, matrix);
+    ok &= pm->cached;
+  }
+
+  // further factorizations are returned uncached, the existing
+  // entries are still found
+  ProjMatrixKey key = {2, 0, -1, -1.};
+  double **matrix = _new_matrix<double>(2, 2);
+  matrix[0][0] = matrix[1][1] = 2;
+  matrix[0][1] = matrix[1][0] = 1;
+  ProjMatrix *pm = cache.insert(key, matrix);
+  ok &= !pm->cached && pm->chol_ok;
+  ok &= cache.find(key) == NULL;
+  delete pm;
+  ok &= cache.get_num_entries() == PROJ_MATRIX_CACHE_SIZE;
+  ok &= check_projection("full cache, hit", &cache, 0.25, 0.5);
+  ok &= check_projection("full cache, not cached", &cache, 0, 0.3);
+  ok &= check_projection("full cache, not cached", &cache, 0, 0.3);
+  ok &= cache.get_num_entries() == PROJ_MATRIX_CACHE_SIZE;
+
+  if (ok) {
+    printf("Success!\n");
+    return ERROR_SUCCESS;
+  }
+  else {
+    printf("Failure!\n");
+    return ERROR_FAILURE;
+  }
+}
@@ -0,0 +1,117 @@
+// Two-equation nonlinear system shared by the tests of the assembly 
+// and of the solvers:
+//
+//   -u1'' + u1^3 - (sin(x) u2)' = cos(x),   -u2'' + u2 = x   in (A, B),
+//
+// with a Dirichlet condition for u1 on the left. The elements get
+// varying polynomial degrees so that all element sizes occur.
+
+#ifndef _TWO_EQ_SYSTEM_H_
+#define _TWO_EQ_SYSTEM_H_
+
+#include "hermes1d.h"
+
+// General input:
+static int N_eq = 2;
+int N_elem = 40;                        // Number of elements
+double A = 0, B = 1;                    // Domain end points
+int P_init = 5;                         // Initial polynomal degree
+
+// Boundary conditions
+double Val_dir_left = 1;                // Dirichlet condition left
+
+// bilinear forms for the Jacobi matrix 
+double jacobian_0_0(int num, double *x, double *weights, 
+                double *u, double *dudx, double *v, double *dvdx, 
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (dudx[i]*dvdx[i] + 3*u_prev[0][0][i]*u_prev[0][0][i]*u[i]*v[i])
+           *weights[i];
+  }
+  return val;
+};
+
+double jacobian_0_1(int num, double *x, double *weights, 
+                double *u, double *dudx, double *v, double *dvdx, 
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += sin(x[i])*u[i]*dvdx[i]*weights[i];
+  }
+  return val;
+};
+
+double jacobian_1_1(int num, double *x, double *weights, 
+                double *u, double *dudx, double *v, double *dvdx, 
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (dudx[i]*dvdx[i] + u[i]*v[i])*weights[i];
+  }
+  return val;
+};
+
+// (nonlinear) forms for the residual vector
+double residual_0(int num, double *x, double *weights, 
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],  
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    double u = u_prev[0][0][i];
+    val += (du_prevdx[0][0][i]*dvdx[i] + u*u*u*v[i] 
+            + sin(x[i])*u_prev[0][1][i]*dvdx[i] - cos(x[i])*v[i])*weights[i];
+  }
+  return val;
+};
+
+double residual_1(int num, double *x, double *weights, 
+                double u_prev[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM], 
+                double du_prevdx[MAX_SLN_NUM][MAX_EQN_NUM][MAX_QUAD_PTS_NUM],  
+                double *v, double *dvdx, void *user_data)
+{
+  double val = 0;
+  for(int i = 0; i<num; i++) {
+    val += (du_prevdx[0][1][i]*dvdx[i] + u_prev[0][1][i]*v[i] 
+            - x[i]*v[i])*weights[i];
+  }
+  return val;
+};
+
+// Creates the mesh with varying polynomial degrees and assigns dofs
+Mesh *create_two_eq_mesh(int dof_ordering=DOF_ORDERING_COMPONENTS)
+{
+  Mesh *mesh = new Mesh(A, B, N_elem, P_init, N_eq);
+  mesh->set_bc_left_dirichlet(0, Val_dir_left);
+  mesh->set_dof_ordering(dof_ordering);
+  Element *elems = mesh->get_base_elems();
+  for (int m=0; m < N_elem; m++) elems[m].p = 2 + m % 9;
+  int n_dof = mesh->assign_dofs();
+  printf("N_dof = %d\n", n_dof);
+  return mesh;
+}
+
+// Creates the discrete problem with the above forms
+DiscreteProblem *create_two_eq_problem()
+{
+  DiscreteProblem *dp = new DiscreteProblem();
+  dp->add_matrix_form(0, 0, jacobian_0_0);
+  dp->add_matrix_form(0, 1, jacobian_0_1);
+  dp->add_matrix_form(1, 1, jacobian_1_1);
+  dp->add_vector_form(0, residual_0);
+  dp->add_vector_form(1, residual_1);
+  return dp;
+}
+
+#endif